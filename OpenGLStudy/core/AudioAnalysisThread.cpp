@@ -0,0 +1,384 @@
+#include "AudioAnalysisThread.h"
+
+#include <chrono>
+#include <cstring>
+
+AudioAnalysisThread::AudioAnalysisThread(AudioSource * audioSource, int frameSize, int frameGap, int maxFrameSize) :
+	m_audioSource(audioSource),
+	m_ringBuffer(maxFrameSize * 2),
+	m_analyzer(frameSize),
+	m_defaultAnalyzer(&m_analyzer),
+	m_activeAnalyzer(&m_analyzer),
+	m_graph(nullptr),
+	m_newSpectrum(false),
+	m_leftRingBuffer(nullptr),
+	m_rightRingBuffer(nullptr),
+	m_stereoAnalyzer(nullptr),
+	m_started(false),
+	m_running(false),
+	m_sampleRate(0),
+	m_frameGap(frameGap),
+	m_frameEnd(0),
+	m_backlogPolicy(BACKLOG_PROCESS_ALL),
+	m_maxHops(4),
+	m_numProcessedHops(0),
+	m_numCoalescedHops(0),
+	m_numDroppedHops(0),
+	m_backlog(0),
+	m_lazyEvaluation(false),
+	m_spectrumRequested(true),
+	m_pendingSpectrum(nullptr)
+{
+	for (int i = 0; i < StereoSpectrumAnalyzer::NUM_CHANNELS; i++)
+		m_channelOutputs[i] = nullptr;
+}
+
+AudioAnalysisThread::~AudioAnalysisThread()
+{
+	stop();
+	if (m_stereoAnalyzer)
+	{
+		m_audioSource->setChannelRingBuffers(nullptr, nullptr);
+		delete m_leftRingBuffer;
+		delete m_rightRingBuffer;
+		delete m_stereoAnalyzer;
+	}
+}
+
+void AudioAnalysisThread::addFilter(SpectrumFilter * filter)
+{
+	m_filters.push_back(filter);
+}
+
+void AudioAnalysisThread::enableStereo()
+{
+	if (m_stereoAnalyzer)
+		return;
+
+	// The channel ring buffers match the mono one, so every ring buffer is always at the same write index
+	m_leftRingBuffer = new AudioRingBuffer(m_ringBuffer.getCapacity());
+	m_rightRingBuffer = new AudioRingBuffer(m_ringBuffer.getCapacity());
+	m_audioSource->setChannelRingBuffers(m_leftRingBuffer, m_rightRingBuffer);
+
+	m_stereoAnalyzer = new StereoSpectrumAnalyzer(m_analyzer.getFrameSize());
+	m_stereoAnalyzer->setChannelRingBuffers(m_leftRingBuffer, m_rightRingBuffer);
+	if (m_activeAnalyzer == m_defaultAnalyzer)
+		m_activeAnalyzer = m_stereoAnalyzer;
+	m_defaultAnalyzer = m_stereoAnalyzer;
+}
+
+void AudioAnalysisThread::setStereoAnalysis(bool stereoAnalysis)
+{
+	std::lock_guard<std::mutex> lock(m_parameterMutex);
+	if (!m_stereoAnalyzer)
+		return;
+
+	// The channels keep being captured while stereo analysis is off, so their ring buffers are full again as soon as it is back on
+	FrequencyAnalyzer * defaultAnalyzer = stereoAnalysis ? (FrequencyAnalyzer *)m_stereoAnalyzer : &m_analyzer;
+	if (defaultAnalyzer == m_defaultAnalyzer)
+		return;
+	defaultAnalyzer->setFrameSize(m_defaultAnalyzer->getFrameSize());
+	if (m_activeAnalyzer == m_defaultAnalyzer)
+		m_activeAnalyzer = defaultAnalyzer;
+	m_defaultAnalyzer = defaultAnalyzer;
+}
+
+bool AudioAnalysisThread::getStereoAnalysis()
+{
+	std::lock_guard<std::mutex> lock(m_parameterMutex);
+	return m_stereoAnalyzer && m_defaultAnalyzer == m_stereoAnalyzer;
+}
+
+void AudioAnalysisThread::addChannelFilter(StereoSpectrumAnalyzer::Channel channel, SpectrumFilter * filter)
+{
+	m_channelFilters[channel].push_back(filter);
+}
+
+void AudioAnalysisThread::setGraph(SpectrumGraph * graph)
+{
+	m_graph = graph;
+}
+
+void AudioAnalysisThread::start()
+{
+	if (m_running.load())
+		return;
+
+	// Publish a silent frame so the render thread sees the final spectrum size before any audio arrives
+	if (m_lazyEvaluation.load())
+		publish(finishFrame(processFrame(0, PASS_EVERY_HOP, 0)));
+	else
+		publish(processFrame(0, PASS_ALL, 0));
+
+	// Start the thread and wait for it to open the audio source
+	m_started = false;
+	m_running.store(true);
+	m_thread = std::thread(&AudioAnalysisThread::run, this);
+	std::unique_lock<std::mutex> lock(m_startMutex);
+	m_startCondition.wait(lock, [this] { return m_started; });
+}
+
+void AudioAnalysisThread::stop()
+{
+	m_running.store(false);
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+bool AudioAnalysisThread::update()
+{
+	m_newSpectrum = m_spectrumBuffer.update();
+	m_spectrumRequested.store(true);
+	return m_newSpectrum;
+}
+
+const FrequencySpectrum * AudioAnalysisThread::getFrequencySpectrum()
+{
+	update();
+	return &m_spectrumBuffer.getReadBuffer().spectrum;
+}
+
+const FrequencySpectrum * AudioAnalysisThread::getChannelSpectrum(StereoSpectrumAnalyzer::Channel channel)
+{
+	return &m_spectrumBuffer.getReadBuffer().channelSpectrums[channel];
+}
+
+int AudioAnalysisThread::getTapIndex(const std::string & name)
+{
+	return m_graph ? m_graph->getTapIndex(name) : -1;
+}
+
+const FrequencySpectrum * AudioAnalysisThread::getTapSpectrum(int tap)
+{
+	const std::vector<FrequencySpectrum> & tapSpectrums = m_spectrumBuffer.getReadBuffer().tapSpectrums;
+	if (tap < 0 || tap >= (int)tapSpectrums.size())
+		return &m_emptySpectrum;
+	return &tapSpectrums[tap];
+}
+
+int AudioAnalysisThread::getFrameSize()
+{
+	std::lock_guard<std::mutex> lock(m_parameterMutex);
+	return m_activeAnalyzer->getFrameSize();
+}
+
+void AudioAnalysisThread::setFrameSize(int frameSize)
+{
+	std::lock_guard<std::mutex> lock(m_parameterMutex);
+	m_activeAnalyzer->setFrameSize(frameSize);
+}
+
+void AudioAnalysisThread::setAnalysisMode(SpectrumAnalyzer::AnalysisMode analysisMode)
+{
+	std::lock_guard<std::mutex> lock(m_parameterMutex);
+	m_analyzer.setAnalysisMode(analysisMode);
+}
+
+void AudioAnalysisThread::setLazyEvaluation(bool lazyEvaluation)
+{
+	m_lazyEvaluation.store(lazyEvaluation);
+}
+
+void AudioAnalysisThread::setBacklogPolicy(BacklogPolicy backlogPolicy, int maxHops)
+{
+	m_maxHops.store(maxHops > 1 ? maxHops : 1);
+	m_backlogPolicy.store(backlogPolicy);
+}
+
+void AudioAnalysisThread::setAnalyzer(FrequencyAnalyzer * analyzer)
+{
+	std::lock_guard<std::mutex> lock(m_parameterMutex);
+	m_activeAnalyzer = analyzer ? analyzer : m_defaultAnalyzer;
+}
+
+void AudioAnalysisThread::run()
+{
+	// The source is opened on this thread, since capture APIs like WASAPI tie their objects to the thread that created them.
+	// A source without a sample rate can not be paced, so it counts as not opened
+	bool opened = m_audioSource->open() && m_audioSource->getSampleRate() > 0;
+	{
+		std::lock_guard<std::mutex> lock(m_startMutex);
+		m_sampleRate.store(opened ? m_audioSource->getSampleRate() : 0);
+		m_started = true;
+	}
+	m_startCondition.notify_all();
+	if (!opened)
+		return;
+
+	// Start analyzing from wherever the stream is now
+	m_frameEnd = m_ringBuffer.getWriteIndex();
+
+	while (m_running.load())
+	{
+		// Capture new audio into the ring buffer
+		m_audioSource->capture(&m_ringBuffer);
+
+		// Process the available hops, then publish only the newest result.
+		// The render thread reads the spectrum once per frame, so intermediate results would never be seen.
+		int frameGap = m_frameGap.load();
+		bool lazyEvaluation = m_lazyEvaluation.load();
+		if (!lazyEvaluation)
+			m_pendingSpectrum = nullptr;
+		processBacklog(frameGap, lazyEvaluation ? PASS_EVERY_HOP : PASS_ALL);
+
+		// With lazy evaluation the rest of the chain waits until the render thread has picked up the last spectrum.
+		// The newest hop's output stays valid until the next hop, so it can be finished on a later pass through this loop
+		if (m_pendingSpectrum && (!lazyEvaluation || m_spectrumRequested.exchange(false)))
+		{
+			std::lock_guard<std::mutex> lock(m_parameterMutex);
+			publish(lazyEvaluation ? finishFrame(m_pendingSpectrum) : m_pendingSpectrum);
+			m_pendingSpectrum = nullptr;
+		}
+
+		// Sources that are not real time are captured again as soon as the last batch is processed
+		if (!m_audioSource->isRealTime())
+		{
+			if (m_audioSource->isFinished())
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			continue;
+		}
+
+		// Sleep until the next hop should be available.
+		// Capture packets arrive every few milliseconds, so never sleep for less than half a millisecond.
+		long long samplesUntilHop = frameGap - (m_ringBuffer.getWriteIndex() - m_frameEnd);
+		long long sleepTime = samplesUntilHop * 1000000 / m_sampleRate.load();
+		std::this_thread::sleep_for(std::chrono::microseconds(sleepTime > 500 ? sleepTime : 500));
+	}
+}
+
+const FrequencySpectrum * AudioAnalysisThread::applyFilters(const std::vector<SpectrumFilter *> & filters, const FrequencySpectrum * frequencySpectrum,
+	FilterPass pass, int numCoalescedHops)
+{
+	for (SpectrumFilter * filter : filters)
+	{
+		if (pass == PASS_ALL || filter->needsEveryHop() == (pass == PASS_EVERY_HOP))
+			frequencySpectrum = filter->applyCoalesced(frequencySpectrum, numCoalescedHops);
+	}
+	return frequencySpectrum;
+}
+
+void AudioAnalysisThread::processBacklog(int frameGap, FilterPass pass)
+{
+	long long writeIndex = m_ringBuffer.getWriteIndex();
+	long long numHops = (writeIndex - m_frameEnd) / frameGap;
+	if (numHops <= 0)
+	{
+		m_backlog.store(0);
+		return;
+	}
+
+	// The parameters are locked for one hop at a time rather than the whole backlog,
+	// so a setter called during a long burst waits for one hop at most
+	long long numSkipped = 0;
+	long long numToProcess = 0;
+	int numCoalesced = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_parameterMutex);
+
+		// Hop i ends at m_frameEnd + i * frameGap, and can only be analyzed while its whole frame is still in the ring buffer
+		long long oldestFrameEnd = writeIndex - m_ringBuffer.getCapacity() + m_activeAnalyzer->getFrameSize();
+		if (m_frameEnd + frameGap < oldestFrameEnd)
+			numSkipped = utl::min((oldestFrameEnd - m_frameEnd + frameGap - 1) / frameGap - 1, numHops - 1);
+
+		int maxHops = m_maxHops.load();
+		BacklogPolicy backlogPolicy = m_backlogPolicy.load();
+		if (backlogPolicy == BACKLOG_SKIP_TO_NEWEST && numHops - numSkipped > maxHops)
+			numSkipped = numHops - maxHops;
+		numToProcess = numHops - numSkipped;
+		if (backlogPolicy == BACKLOG_CAP_HOPS && numToProcess > maxHops)
+			numToProcess = maxHops;
+
+		// The first processed hop stands in for the skipped hops the filters still remember
+		if (numSkipped > 0)
+			numCoalesced = (int)utl::min(numSkipped, (long long)utl::min(getHistoryLength(), MAX_COALESCED_HOPS));
+	}
+	m_frameEnd += numSkipped * frameGap;
+	for (long long i = 0; i < numToProcess; i++)
+	{
+		m_frameEnd += frameGap;
+		std::lock_guard<std::mutex> lock(m_parameterMutex);
+		m_pendingSpectrum = processFrame(m_frameEnd, pass, i == 0 ? numCoalesced : 0);
+	}
+
+	m_numProcessedHops.fetch_add(numToProcess);
+	m_numCoalescedHops.fetch_add(numCoalesced);
+	m_numDroppedHops.fetch_add(numSkipped - numCoalesced);
+	m_backlog.store((int)(numHops - numSkipped - numToProcess));
+}
+
+int AudioAnalysisThread::getHistoryLength()
+{
+	int historyLength = m_graph ? m_graph->getHistoryLength() : 0;
+	for (SpectrumFilter * filter : m_filters)
+		historyLength = utl::max(historyLength, filter->getHistoryLength());
+	for (int i = 0; i < StereoSpectrumAnalyzer::NUM_CHANNELS; i++)
+	{
+		for (SpectrumFilter * filter : m_channelFilters[i])
+			historyLength = utl::max(historyLength, filter->getHistoryLength());
+	}
+	return historyLength;
+}
+
+const FrequencySpectrum * AudioAnalysisThread::processFrame(long long frameEnd, FilterPass pass, int numCoalescedHops)
+{
+	m_activeAnalyzer->readFrame(&m_ringBuffer, frameEnd);
+	m_activeAnalyzer->processFrame();
+	const FrequencySpectrum * analyzerSpectrum = m_activeAnalyzer->getFrequencySpectrum();
+
+	// The skipped hops are stood in for by this one, so every filter coalesces them instead of running once per hop
+	if (m_graph)
+		m_graph->evaluate(analyzerSpectrum, numCoalescedHops);
+	const FrequencySpectrum * frequencySpectrum = applyFilters(m_filters, analyzerSpectrum, pass, numCoalescedHops);
+
+	// The stereo channels only exist while the stereo analyzer is the one running
+	bool stereo = m_stereoAnalyzer && m_activeAnalyzer == m_stereoAnalyzer;
+	for (int i = 0; i < StereoSpectrumAnalyzer::NUM_CHANNELS; i++)
+	{
+		m_channelOutputs[i] = nullptr;
+		if (!stereo)
+			continue;
+		const FrequencySpectrum * channelSpectrum = m_stereoAnalyzer->getChannelSpectrum((StereoSpectrumAnalyzer::Channel)i);
+		m_channelOutputs[i] = applyFilters(m_channelFilters[i], channelSpectrum, pass, numCoalescedHops);
+	}
+	return frequencySpectrum;
+}
+
+const FrequencySpectrum * AudioAnalysisThread::finishFrame(const FrequencySpectrum * frequencySpectrum)
+{
+	for (int i = 0; i < StereoSpectrumAnalyzer::NUM_CHANNELS; i++)
+	{
+		if (m_channelOutputs[i])
+			m_channelOutputs[i] = applyFilters(m_channelFilters[i], m_channelOutputs[i], PASS_DEFERRED);
+	}
+	return applyFilters(m_filters, frequencySpectrum, PASS_DEFERRED);
+}
+
+namespace
+{
+	void copySpectrum(FrequencySpectrum & destination, const FrequencySpectrum * source)
+	{
+		int size = source ? source->size : 0;
+		if (destination.size != size)
+			destination.resize(size);
+		if (size > 0)
+			memcpy(destination.data, source->data, size * sizeof(float));
+	}
+}
+
+void AudioAnalysisThread::publish(const FrequencySpectrum * frequencySpectrum)
+{
+	// With a graph and no main chain the main spectrum is only the raw analyzer output, which nothing reads, so it stays empty
+	AnalysisOutput & output = m_spectrumBuffer.getWriteBuffer();
+	if (!m_graph || !m_filters.empty())
+		copySpectrum(output.spectrum, frequencySpectrum);
+	for (int i = 0; i < StereoSpectrumAnalyzer::NUM_CHANNELS; i++)
+		copySpectrum(output.channelSpectrums[i], m_channelOutputs[i]);
+
+	// Each buffer gets its tap spectrums the first time it is written, after that they only grow when a tap does
+	int numTaps = m_graph ? m_graph->getNumTaps() : 0;
+	if ((int)output.tapSpectrums.size() != numTaps)
+		output.tapSpectrums.resize(numTaps);
+	for (int i = 0; i < numTaps; i++)
+		copySpectrum(output.tapSpectrums[i], m_graph->getTapSpectrum(i));
+	m_spectrumBuffer.publish();
+}
@@ -0,0 +1,310 @@
+#ifndef AUDIOANALYSISTHREAD_H
+#define AUDIOANALYSISTHREAD_H
+
+/*
+* Runs audio capture from an AudioSource, the SpectrumAnalyzer, and a chain of SpectrumFilters on a dedicated thread at the hop rate.
+* The newest filtered spectrum is published through a wait-free triple buffer that the render thread picks up once per frame,
+* so a slow frame never delays analysis, and a burst of hops never delays a frame.
+*/
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "AudioRingBuffer.h"
+#include "AudioSource.h"
+#include "FrequencyAnalyzer.h"
+#include "FrequencySpectrum.h"
+#include "SpectrumAnalyzer.h"
+#include "SpectrumFilter.h"
+#include "SpectrumGraph.h"
+#include "StereoSpectrumAnalyzer.h"
+#include "TripleBuffer.h"
+
+class AudioAnalysisThread
+{
+public:
+	enum BacklogPolicy
+	{
+		BACKLOG_PROCESS_ALL,	// process every hop, however many have piled up
+		BACKLOG_CAP_HOPS,		// process at most maxHops per pass, and leave the rest for the next pass
+		BACKLOG_SKIP_TO_NEWEST	// skip all but the newest maxHops hops
+	};
+
+	static const int MAX_COALESCED_HOPS = 256;
+	/*
+	* The most skipped hops that are stood in for in one pass. See setBacklogPolicy().
+	*/
+
+	AudioAnalysisThread(AudioSource * audioSource, int frameSize, int frameGap, int maxFrameSize);
+	/*
+	* Constructor
+	* Pre:
+	*	audioSource is the source of the audio. It is opened on the analysis thread and must outlive this object.
+	*	frameSize is the number of samples in each fourier transform
+	*	frameGap is the number of samples between the start of each frame (the hop size)
+	*	maxFrameSize is the largest frame size that setFrameSize() will be called with. It sizes the audio ring buffer.
+	* Post:
+	*	The analyzer and ring buffer are created. The thread is not started until start() is called.
+	*/
+
+	~AudioAnalysisThread();
+	/*
+	* Stops the thread if it is running. Filters added with addFilter() and addChannelFilter() are not deleted.
+	*/
+
+	void addFilter(SpectrumFilter * filter);
+	/*
+	* Appends a filter to the end of the filter chain. Filters are applied in the order they are added.
+	* Filter parameters can be set from one other thread while the thread runs, and take effect at the next hop.
+	* Pre:
+	*	The thread is not running. filter must outlive this object.
+	*/
+
+	void enableStereo();
+	/*
+	* Captures the left and right channels into their own ring buffers and analyzes them with a StereoSpectrumAnalyzer,
+	* which replaces the built in SpectrumAnalyzer. The main filter chain then runs on the mid channel.
+	* Pre:
+	*	The thread is not running
+	* Post:
+	*	getChannelSpectrum() returns the left, right, mid and side spectrums, each through its own filter chain
+	*/
+
+	void setStereoAnalysis(bool stereoAnalysis);
+	bool getStereoAnalysis();
+	/*
+	* Switches the built in analyzer between the StereoSpectrumAnalyzer and the mono SpectrumAnalyzer while the thread runs,
+	* so the extra fft and the channel chains only cost time while something shows the channels. The frame size carries over.
+	* Does nothing until enableStereo() was called, which turns it on.
+	*/
+
+	void addChannelFilter(StereoSpectrumAnalyzer::Channel channel, SpectrumFilter * filter);
+	/*
+	* Appends a filter to the chain of one stereo channel. Channels without filters are published unfiltered.
+	* Pre:
+	*	The thread is not running. filter must outlive this object. The filter is not also in another chain.
+	*/
+
+	void setGraph(SpectrumGraph * graph);
+	/*
+	* Runs graph on the analyzer output every hop, next to the filter chain, and publishes every tap of it.
+	* Several layers can read taps of one graph, so the analysis runs once per hop however many layers there are.
+	* Pre:
+	*	The thread is not running. graph must outlive this object, and has all its taps.
+	*/
+
+	void start();
+	/*
+	* Starts the analysis thread.
+	* Post:
+	*	A silent frame has been run through the filter chain and graph and published, so the spectrum and taps have their final output size.
+	*	The audio source is opened on the analysis thread, and this returns once the sample rate is known.
+	*/
+
+	void stop();
+	/*
+	* Stops and joins the analysis thread. Safe to call if the thread is not running.
+	*/
+
+	bool update();
+	/*
+	* Render thread only. Picks up the newest published output, which the spectrum, channel and tap getters then return.
+	* Returns true if it was not seen before. Call it once per frame when only taps are read.
+	*/
+
+	const FrequencySpectrum * getFrequencySpectrum();
+	/*
+	* Render thread only. Calls update() and returns the output of the filter chain.
+	* Post:
+	*	returns the newest spectrum. It stays valid and unchanged until the next update() or getFrequencySpectrum() call.
+	*	The spectrum is empty when a graph is set and the filter chain is empty, since the taps hold everything then.
+	*/
+
+	bool hasNewSpectrum() { return m_newSpectrum; }
+	/*
+	* Render thread only. True if the last update() picked up a spectrum that was not seen before,
+	* false if the analysis thread published nothing since the call before it.
+	*/
+
+	const FrequencySpectrum * getChannelSpectrum(StereoSpectrumAnalyzer::Channel channel);
+	/*
+	* Render thread only. Returns a stereo channel spectrum, picked up by the last update().
+	* The size is 0 unless stereo is enabled, stereo analysis is on, and the stereo analyzer is the active analyzer.
+	*/
+
+	int getTapIndex(const std::string & name);
+	/*
+	* Returns the index of a tap of the graph, or -1 if there is no graph or no tap with that name.
+	* Look the index up once and pass it to getTapSpectrum() every frame.
+	*/
+
+	const FrequencySpectrum * getTapSpectrum(int tap);
+	/*
+	* Render thread only. Returns a tap of the graph, picked up by the last update().
+	* Returns an empty spectrum (size 0) when tap is -1, or before the first hop with the graph has been published.
+	*/
+
+	const AudioRingBuffer * getRingBuffer() { return &m_ringBuffer; }
+	/*
+	* The captured audio. Other threads may read recent samples from it, for example to draw the waveform.
+	*/
+
+	int getSampleRate() { return m_sampleRate.load(); }
+	int getFrameSize();
+	void setFrameSize(int frameSize);
+	int getFrameGap() { return m_frameGap.load(); }
+	void setFrameGap(int frameGap) { m_frameGap.store(frameGap > 1 ? frameGap : 1); }
+	void setAnalysisMode(SpectrumAnalyzer::AnalysisMode analysisMode);
+	/*
+	* Sets the analysis mode of the built in SpectrumAnalyzer
+	*/
+
+	void setLazyEvaluation(bool lazyEvaluation);
+	bool getLazyEvaluation() { return m_lazyEvaluation.load(); }
+	/*
+	* Off by default. When on, only filters that need every hop (see SpectrumFilter::needsEveryHop()) run at the hop rate,
+	* in chain order, directly on the analyzer output. The rest of each chain runs once for every spectrum the render thread picks up,
+	* on the newest output of those filters, so their cost follows the frame rate instead of the hop rate.
+	* This moves averaging in front of the other filters. An average commutes with the domain shift, but not with amplitude curves
+	* or peaks, so the result is a little different: the spectrum is averaged in the linear domain before it is shaped.
+	* Published spectrums are then at most one hop older than the render thread's request for them.
+	* Applies to the filter chain and the channel chains, not to the graph.
+	*/
+
+	void setBacklogPolicy(BacklogPolicy backlogPolicy, int maxHops);
+	BacklogPolicy getBacklogPolicy() { return m_backlogPolicy.load(); }
+	int getMaxHops() { return m_maxHops.load(); }
+	/*
+	* Decides how many hops the thread processes in one pass after it falls behind, for example after a stall.
+	* The default, BACKLOG_PROCESS_ALL, catches up in one pass, which can take long enough to cause a second stall.
+	* BACKLOG_CAP_HOPS spreads the catching up over several passes, so the spectrum lags behind until the backlog is gone.
+	* BACKLOG_SKIP_TO_NEWEST keeps the latency low by skipping the older hops.
+	*
+	* Skipped hops are not lost to filters that average over time. The oldest processed hop is fed to the filters again
+	* in place of each skipped hop, as far back as the filters remember (SpectrumFilter::getHistoryLength()),
+	* so a moving average still covers the right amount of time. Those hops are counted as coalesced, and the rest as dropped.
+	* Hops whose audio has already been overwritten in the ring buffer are always skipped.
+	* Pre:
+	*	maxHops >= 1
+	*/
+
+	long long getNumProcessedHops() { return m_numProcessedHops.load(); }
+	long long getNumCoalescedHops() { return m_numCoalescedHops.load(); }
+	long long getNumDroppedHops() { return m_numDroppedHops.load(); }
+	int getBacklog() { return m_backlog.load(); }
+	/*
+	* Counters since the object was created. Processed hops were analyzed, coalesced hops were skipped and stood in for by a processed hop,
+	* and dropped hops were skipped entirely. The backlog is the number of hops left waiting after the last pass.
+	*/
+
+	void setAnalyzer(FrequencyAnalyzer * analyzer);
+	/*
+	* Replaces the analyzer at the start of the filter chain, for example with a ConstantQAnalyzer.
+	* getFrameSize() and setFrameSize() then apply to the new analyzer.
+	* Pre:
+	*	analyzer must outlive this object, or be replaced before it is destroyed.
+	*	nullptr goes back to the built in analyzer (the StereoSpectrumAnalyzer if stereo is enabled).
+	*	getFrameSize() of the analyzer is no larger than the maxFrameSize given to the constructor
+	*/
+
+private:
+	void run();
+	/*
+	* The body of the analysis thread. Captures audio, processes every available hop, publishes the result, then sleeps.
+	*/
+
+	// Everything published to the render thread for one hop
+	struct AnalysisOutput
+	{
+		FrequencySpectrum spectrum;
+		FrequencySpectrum channelSpectrums[StereoSpectrumAnalyzer::NUM_CHANNELS];
+		std::vector<FrequencySpectrum> tapSpectrums;
+	};
+
+	enum FilterPass
+	{
+		PASS_ALL,			// every filter
+		PASS_EVERY_HOP,		// only filters that need every hop
+		PASS_DEFERRED		// only filters that do not
+	};
+
+	static const FrequencySpectrum * applyFilters(const std::vector<SpectrumFilter *> & filters, const FrequencySpectrum * frequencySpectrum,
+		FilterPass pass, int numCoalescedHops = 0);
+
+	const FrequencySpectrum * processFrame(long long frameEnd, FilterPass pass, int numCoalescedHops);
+	/*
+	* Runs the analyzer and the filters of the chain in pass on the frame that ends at frameEnd. Returns the output of the last filter.
+	* When the stereo analyzer is active, the channel chains are run too and their outputs are kept in m_channelOutputs.
+	* The graph is evaluated on the analyzer output.
+	* The analyzer runs once. The filters and graph then coalesce numCoalescedHops skipped hops that had the same analyzer output
+	* (see SpectrumFilter::applyCoalesced()), so standing in for skipped hops costs about as much as one hop.
+	*/
+
+	void processBacklog(int frameGap, FilterPass pass);
+	/*
+	* Processes the hops available in the ring buffer as the backlog policy allows, and updates the counters.
+	* Leaves the output of the newest processed hop in m_pendingSpectrum, or leaves it unchanged if no hop was processed.
+	* Locks m_parameterMutex around each hop, not around the whole backlog.
+	*/
+
+	int getHistoryLength();
+	/*
+	* The longest history of any filter in the chains or the graph
+	*/
+
+	const FrequencySpectrum * finishFrame(const FrequencySpectrum * frequencySpectrum);
+	/*
+	* Lazy evaluation only. Runs the deferred filters of the chain on frequencySpectrum and of the channel chains on m_channelOutputs.
+	*/
+
+	void publish(const FrequencySpectrum * frequencySpectrum);
+	/*
+	* Copies a spectrum, the channel outputs and the graph taps into the triple buffer and publishes them to the render thread.
+	*/
+
+	AudioSource * m_audioSource;
+	AudioRingBuffer m_ringBuffer;
+	SpectrumAnalyzer m_analyzer;
+	FrequencyAnalyzer * m_defaultAnalyzer;
+	FrequencyAnalyzer * m_activeAnalyzer;
+	std::vector<SpectrumFilter *> m_filters;
+	SpectrumGraph * m_graph;
+	TripleBuffer<AnalysisOutput> m_spectrumBuffer;
+	FrequencySpectrum m_emptySpectrum;
+	bool m_newSpectrum;	// the last getFrequencySpectrum() call picked up a new spectrum. Render thread only
+
+	// Stereo analysis. Only allocated by enableStereo()
+	AudioRingBuffer * m_leftRingBuffer;
+	AudioRingBuffer * m_rightRingBuffer;
+	StereoSpectrumAnalyzer * m_stereoAnalyzer;
+	std::vector<SpectrumFilter *> m_channelFilters[StereoSpectrumAnalyzer::NUM_CHANNELS];
+	const FrequencySpectrum * m_channelOutputs[StereoSpectrumAnalyzer::NUM_CHANNELS];
+
+	std::thread m_thread;
+	std::mutex m_parameterMutex;
+	std::mutex m_startMutex;
+	std::condition_variable m_startCondition;
+	bool m_started;
+	std::atomic<bool> m_running;
+	std::atomic<int> m_sampleRate;
+	std::atomic<int> m_frameGap;
+	long long m_frameEnd;
+
+	// Backlog policy and counters
+	std::atomic<BacklogPolicy> m_backlogPolicy;
+	std::atomic<int> m_maxHops;
+	std::atomic<long long> m_numProcessedHops;
+	std::atomic<long long> m_numCoalescedHops;
+	std::atomic<long long> m_numDroppedHops;
+	std::atomic<int> m_backlog;
+
+	// Lazy evaluation. The render thread sets m_spectrumRequested when it picks up a spectrum, asking for the next one
+	std::atomic<bool> m_lazyEvaluation;
+	std::atomic<bool> m_spectrumRequested;
+	const FrequencySpectrum * m_pendingSpectrum;
+};
+
+#endif
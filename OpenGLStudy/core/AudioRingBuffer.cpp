@@ -0,0 +1,91 @@
+#include "AudioRingBuffer.h"
+
+#include <cstring>
+
+AudioRingBuffer::AudioRingBuffer(int minCapacity) :
+	m_writeIndex(0)
+{
+	// Round the capacity up to a power of two so indices can be wrapped with a mask
+	m_capacity = 1;
+	while (m_capacity < minCapacity)
+		m_capacity <<= 1;
+	m_mask = m_capacity - 1;
+	m_buffer = new float[m_capacity]();
+}
+
+AudioRingBuffer::~AudioRingBuffer()
+{
+	delete[] m_buffer;
+}
+
+void AudioRingBuffer::write(const float * samples, int numSamples)
+{
+	// Only the producer modifies the write index, so a relaxed load is enough here
+	long long writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+
+	// Only the newest samples survive if there are more than the buffer can hold
+	if (numSamples > m_capacity)
+	{
+		writeIndex += numSamples - m_capacity;
+		samples += numSamples - m_capacity;
+		numSamples = m_capacity;
+	}
+
+	// Copy into the (at most two) spans that follow the write index
+	int start = (int)(writeIndex & m_mask);
+	int size1 = numSamples < m_capacity - start ? numSamples : m_capacity - start;
+	memcpy(m_buffer + start, samples, size1 * sizeof(float));
+	memcpy(m_buffer, samples + size1, (numSamples - size1) * sizeof(float));
+
+	// Release ordering makes the sample data visible before the new write index
+	m_writeIndex.store(writeIndex + numSamples, std::memory_order_release);
+}
+
+int AudioRingBuffer::getWriteSpans(int numSamples, float ** span1, int * size1, float ** span2, int * size2)
+{
+	if (numSamples > m_capacity)
+		numSamples = m_capacity;
+
+	int start = (int)(m_writeIndex.load(std::memory_order_relaxed) & m_mask);
+	*span1 = m_buffer + start;
+	*size1 = numSamples < m_capacity - start ? numSamples : m_capacity - start;
+	*span2 = m_buffer;
+	*size2 = numSamples - *size1;
+	return numSamples;
+}
+
+void AudioRingBuffer::commitWrite(int numSamples)
+{
+	// Release ordering makes the sample data visible before the new write index
+	m_writeIndex.store(m_writeIndex.load(std::memory_order_relaxed) + numSamples, std::memory_order_release);
+}
+
+int AudioRingBuffer::getReadSpans(long long endIndex, int numSamples, const float ** span1, int * size1, const float ** span2, int * size2) const
+{
+	if (numSamples > m_capacity)
+		numSamples = m_capacity;
+
+	// Samples before index 0 were never written, but the buffer is zero filled so they read back as silence
+	int start = (int)((endIndex - numSamples) & m_mask);
+	*span1 = m_buffer + start;
+	*size1 = numSamples < m_capacity - start ? numSamples : m_capacity - start;
+	*span2 = m_buffer;
+	*size2 = numSamples - *size1;
+	return numSamples;
+}
+
+void AudioRingBuffer::read(long long endIndex, int numSamples, float * outBuffer) const
+{
+	const float * span1;
+	const float * span2;
+	int size1, size2;
+	getReadSpans(endIndex, numSamples, &span1, &size1, &span2, &size2);
+	memcpy(outBuffer, span1, size1 * sizeof(float));
+	memcpy(outBuffer + size1, span2, size2 * sizeof(float));
+}
+
+bool AudioRingBuffer::isValidRange(long long endIndex, int numSamples) const
+{
+	long long writeIndex = getWriteIndex();
+	return endIndex <= writeIndex && writeIndex - (endIndex - numSamples) <= m_capacity;
+}
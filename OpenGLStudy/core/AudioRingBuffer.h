@@ -0,0 +1,96 @@
+#ifndef AUDIORINGBUFFER_H
+#define AUDIORINGBUFFER_H
+
+/*
+* A single producer / single consumer lock-free ring buffer of audio samples.
+* The producer (audio capture) appends samples and the consumer (SpectrumAnalyzer) reads frames out of it by sample index.
+* Sample indices count every sample ever written, so a frame is addressed by the index one past its newest sample.
+* Capacity is always a power of two, so a read or write touches at most two contiguous spans and history never moves.
+*/
+
+#include <atomic>
+
+class AudioRingBuffer
+{
+public:
+	AudioRingBuffer(int minCapacity);
+	/*
+	* Constructor
+	* Pre:
+	*	minCapacity is the smallest number of samples the buffer must hold.
+	*	It should be at least twice the largest frame that will be read, so the producer has room to write while a frame is read.
+	* Post:
+	*	A zero filled buffer is allocated with a capacity of the next power of two >= minCapacity
+	*/
+
+	~AudioRingBuffer();
+
+	int getCapacity() const { return m_capacity; }
+
+	long long getWriteIndex() const { return m_writeIndex.load(std::memory_order_acquire); }
+	/*
+	* Returns the total number of samples that have been written. Safe to call from the consumer thread.
+	*/
+
+	void write(const float * samples, int numSamples);
+	/*
+	* Producer only. Copies samples to the back of the buffer and publishes them.
+	* If numSamples is greater than the capacity, only the newest samples are kept.
+	*/
+
+	int getWriteSpans(int numSamples, float ** span1, int * size1, float ** span2, int * size2);
+	/*
+	* Producer only. Gets writable memory for the next numSamples samples without publishing them.
+	* Pre:
+	*	numSamples is the number of samples that will be written
+	* Post:
+	*	span1 and span2 point to the two contiguous regions that follow the write index. size2 is 0 if there is no wrap around.
+	*	returns the number of samples that fit (numSamples clamped to the capacity)
+	*	The samples become visible to the consumer after commitWrite()
+	*/
+
+	void commitWrite(int numSamples);
+	/*
+	* Producer only. Publishes numSamples samples that were written through getWriteSpans()
+	*/
+
+	int getReadSpans(long long endIndex, int numSamples, const float ** span1, int * size1, const float ** span2, int * size2) const;
+	/*
+	* Gets the samples in the range [endIndex - numSamples, endIndex) as two contiguous spans.
+	* Pre:
+	*	endIndex <= getWriteIndex()
+	*	numSamples <= getCapacity()
+	* Post:
+	*	span1 holds the oldest samples of the range, span2 the rest. size2 is 0 if the range does not wrap around.
+	*	Samples before index 0 are never written and read back as zero.
+	*	returns the number of samples in both spans
+	*/
+
+	void read(long long endIndex, int numSamples, float * outBuffer) const;
+	/*
+	* Copies the samples in the range [endIndex - numSamples, endIndex) into outBuffer using at most two memcpy calls.
+	* Same preconditions as getReadSpans(). outBuffer must have room for numSamples samples.
+	*/
+
+	float getSample(long long index) const { return m_buffer[index & m_mask]; }
+	/*
+	* Gets a single sample by index. index must be in the range [getWriteIndex() - getCapacity(), getWriteIndex())
+	*/
+
+	bool isValidRange(long long endIndex, int numSamples) const;
+	/*
+	* Returns true if the range [endIndex - numSamples, endIndex) has been written and not yet overwritten.
+	* Call after reading a range to check that the producer did not lap the consumer during the read.
+	*/
+
+private:
+	float * m_buffer;
+	int m_capacity;
+	int m_mask;
+	std::atomic<long long> m_writeIndex;
+
+	AudioRingBuffer(const AudioRingBuffer &) = delete;
+	AudioRingBuffer & operator=(const AudioRingBuffer &) = delete;
+};
+
+#endif
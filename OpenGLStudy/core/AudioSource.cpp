@@ -0,0 +1,268 @@
+#include "AudioSource.h"
+
+#include <cstring>
+
+#include "loopback.h"
+
+namespace
+{
+	// WAV headers are little endian
+	unsigned int readU16(const unsigned char * bytes) { return bytes[0] | (bytes[1] << 8); }
+	unsigned int readU32(const unsigned char * bytes) { return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24); }
+
+	const unsigned int WAV_FORMAT_PCM = 1;
+	const unsigned int WAV_FORMAT_IEEE_FLOAT = 3;
+	const unsigned int WAV_FORMAT_EXTENSIBLE = 0xFFFE;
+}
+
+void AudioSource::setChannelRingBuffers(AudioRingBuffer * leftRingBuffer, AudioRingBuffer * rightRingBuffer)
+{
+	m_leftRingBuffer = leftRingBuffer;
+	m_rightRingBuffer = rightRingBuffer;
+}
+
+bool LoopbackAudioSource::open()
+{
+	return loopback_init() == 0;
+}
+
+int LoopbackAudioSource::capture(AudioRingBuffer * ringBuffer)
+{
+	return loopback_getSound(ringBuffer, m_leftRingBuffer, m_rightRingBuffer);
+}
+
+int LoopbackAudioSource::getSampleRate()
+{
+	return loopback_samplesPerSec();
+}
+
+int LoopbackAudioSource::getNumChannels()
+{
+	return loopback_numChannels();
+}
+
+FileAudioSource::FileAudioSource(const char * path, bool realTime, int rawSampleRate, int rawNumChannels) :
+	m_path(path),
+	m_samples(nullptr),
+	m_sampleFormat(SAMPLE_FLOAT32),
+	m_bytesPerSample(4),
+	m_sampleRate(rawSampleRate),
+	m_numChannels(rawNumChannels),
+	m_numFrames(0),
+	m_realTime(realTime),
+	m_looping(false),
+	m_blockSize(4096),
+	m_position(0),
+	m_pacedFrames(0),
+	m_started(false)
+{
+}
+
+bool FileAudioSource::open()
+{
+	if (!m_file.open(m_path))
+		return false;
+
+	// Files without a WAV header are raw interleaved floats
+	const unsigned char * data = m_file.data();
+	bool isWav = m_file.size() >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0;
+	if (isWav)
+		return parseWav();
+
+	if (m_sampleRate <= 0 || m_numChannels <= 0)
+		return false;
+	m_samples = data;
+	m_sampleFormat = SAMPLE_FLOAT32;
+	m_bytesPerSample = 4;
+	m_numFrames = (long long)(m_file.size() / (m_bytesPerSample * m_numChannels));
+	return m_numFrames > 0;
+}
+
+bool FileAudioSource::parseWav()
+{
+	const unsigned char * data = m_file.data();
+	size_t size = m_file.size();
+	bool foundFormat = false;
+
+	// Walk the chunks after the RIFF header. Chunks are padded to an even number of bytes
+	size_t offset = 12;
+	while (offset + 8 <= size)
+	{
+		const unsigned char * chunk = data + offset;
+		size_t chunkSize = readU32(chunk + 4);
+		const unsigned char * chunkData = chunk + 8;
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && offset + 8 + 16 <= size)
+		{
+			unsigned int formatTag = readU16(chunkData);
+			m_numChannels = readU16(chunkData + 2);
+			m_sampleRate = readU32(chunkData + 4);
+			int bitsPerSample = readU16(chunkData + 14);
+			if (m_sampleRate <= 0)
+				return false;
+
+			// The extensible format stores the real format tag at the start of the sub format GUID
+			if (formatTag == WAV_FORMAT_EXTENSIBLE && chunkSize >= 40 && offset + 8 + 26 <= size)
+				formatTag = readU16(chunkData + 24);
+
+			if (formatTag == WAV_FORMAT_IEEE_FLOAT && bitsPerSample == 32)
+				m_sampleFormat = SAMPLE_FLOAT32;
+			else if (formatTag == WAV_FORMAT_PCM && bitsPerSample == 16)
+				m_sampleFormat = SAMPLE_INT16;
+			else if (formatTag == WAV_FORMAT_PCM && bitsPerSample == 24)
+				m_sampleFormat = SAMPLE_INT24;
+			else if (formatTag == WAV_FORMAT_PCM && bitsPerSample == 32)
+				m_sampleFormat = SAMPLE_INT32;
+			else
+				return false;
+			m_bytesPerSample = bitsPerSample / 8;
+			foundFormat = true;
+		}
+		else if (memcmp(chunk, "data", 4) == 0 && foundFormat && m_numChannels > 0)
+		{
+			// Clamp the data size in case the file was truncated
+			if (chunkSize > size - (offset + 8))
+				chunkSize = size - (offset + 8);
+			m_samples = chunkData;
+			m_numFrames = (long long)(chunkSize / (m_bytesPerSample * m_numChannels));
+			return m_numFrames > 0;
+		}
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
+
+float FileAudioSource::readSample(const unsigned char * sample) const
+{
+	switch (m_sampleFormat)
+	{
+	case SAMPLE_INT16:
+		return (float)(short)readU16(sample) / 32768.0f;
+	case SAMPLE_INT24:
+		return (float)((int)((sample[0] << 8) | (sample[1] << 16) | ((unsigned int)sample[2] << 24)) >> 8) / 8388608.0f;
+	case SAMPLE_INT32:
+		return (float)(int)readU32(sample) / 2147483648.0f;
+	default:
+		float value;
+		memcpy(&value, sample, sizeof(float));
+		return value;
+	}
+}
+
+void FileAudioSource::readMono(long long firstFrame, int numFrames, float * outBuffer) const
+{
+	int frameBytes = m_bytesPerSample * m_numChannels;
+	const unsigned char * frame = m_samples + firstFrame * frameBytes;
+	float scale = 1.0f / (float)m_numChannels;
+
+	// Interleaved float files are the common case, so they skip the per sample format switch
+	if (m_sampleFormat == SAMPLE_FLOAT32)
+	{
+		for (int i = 0; i < numFrames; i++)
+		{
+			float channels[8];
+			float sample = 0.0f;
+			if (m_numChannels <= 8)
+			{
+				memcpy(channels, frame, frameBytes);
+				for (int ch = 0; ch < m_numChannels; ch++)
+					sample += channels[ch];
+			}
+			else
+			{
+				for (int ch = 0; ch < m_numChannels; ch++)
+					sample += readSample(frame + ch * 4);
+			}
+			outBuffer[i] = sample * scale;
+			frame += frameBytes;
+		}
+		return;
+	}
+
+	for (int i = 0; i < numFrames; i++)
+	{
+		float sample = 0.0f;
+		for (int ch = 0; ch < m_numChannels; ch++)
+			sample += readSample(frame + ch * m_bytesPerSample);
+		outBuffer[i] = sample * scale;
+		frame += frameBytes;
+	}
+}
+
+void FileAudioSource::readChannel(long long firstFrame, int numFrames, int channel, float * outBuffer) const
+{
+	int frameBytes = m_bytesPerSample * m_numChannels;
+	const unsigned char * sample = m_samples + firstFrame * frameBytes + channel * m_bytesPerSample;
+	for (int i = 0; i < numFrames; i++)
+	{
+		outBuffer[i] = readSample(sample);
+		sample += frameBytes;
+	}
+}
+
+int FileAudioSource::capture(AudioRingBuffer * ringBuffer)
+{
+	if (!m_file.isOpen())
+		return 0;
+
+	// Work out how many samples to release on this call
+	long long numToRelease = m_blockSize;
+	if (m_realTime)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (!m_started)
+		{
+			m_started = true;
+			m_startTime = now;
+		}
+		double elapsed = std::chrono::duration<double>(now - m_startTime).count();
+		long long framesDue = (long long)(elapsed * (double)m_sampleRate);
+		numToRelease = framesDue - m_pacedFrames;
+	}
+
+	// Never release more than half the ring buffer at once, so the consumer can still read a full frame behind the new samples
+	if (numToRelease > ringBuffer->getCapacity() / 2)
+		numToRelease = ringBuffer->getCapacity() / 2;
+
+	// Decode the samples straight into the ring buffer, wrapping to the start of the file if looping
+	int totalSamples = 0;
+	while (numToRelease > 0)
+	{
+		if (m_position >= m_numFrames)
+		{
+			if (!m_looping)
+				break;
+			m_position = 0;
+		}
+		long long remaining = m_numFrames - m_position;
+		int numSamples = (int)(numToRelease < remaining ? numToRelease : remaining);
+
+		float * spans[2];
+		int spanSizes[2];
+		numSamples = ringBuffer->getWriteSpans(numSamples, &spans[0], &spanSizes[0], &spans[1], &spanSizes[1]);
+		readMono(m_position, spanSizes[0], spans[0]);
+		readMono(m_position + spanSizes[0], spanSizes[1], spans[1]);
+		ringBuffer->commitWrite(numSamples);
+
+		// The channel ring buffers are the same size as the mono one, so they take the same number of samples
+		AudioRingBuffer * channelRingBuffers[2] = { m_leftRingBuffer, m_rightRingBuffer };
+		for (int ch = 0; ch < 2; ch++)
+		{
+			if (!channelRingBuffers[ch])
+				continue;
+			int channel = ch < m_numChannels ? ch : 0;
+			channelRingBuffers[ch]->getWriteSpans(numSamples, &spans[0], &spanSizes[0], &spans[1], &spanSizes[1]);
+			readChannel(m_position, spanSizes[0], channel, spans[0]);
+			readChannel(m_position + spanSizes[0], spanSizes[1], channel, spans[1]);
+			channelRingBuffers[ch]->commitWrite(numSamples);
+		}
+
+		m_position += numSamples;
+		numToRelease -= numSamples;
+		totalSamples += numSamples;
+	}
+
+	// Only the frames that were released count as paced, so frames held back by the limit above go out on the next call
+	if (m_realTime)
+		m_pacedFrames += totalSamples;
+	return totalSamples;
+}
@@ -0,0 +1,150 @@
+#ifndef AUDIOSOURCE_H
+#define AUDIOSOURCE_H
+
+/*
+* Sources of audio samples for the analysis pipeline.
+* A source appends mono samples to an AudioRingBuffer every time capture() is called.
+* Sources can also keep the left and right channels in their own ring buffers for stereo analysis.
+* LoopbackAudioSource captures whatever the system is playing (Windows only).
+* FileAudioSource streams a memory mapped WAV or raw float PCM file, either paced in real time or as fast as possible.
+*/
+
+#include <chrono>
+
+#include "AudioRingBuffer.h"
+#include "MappedFile.h"
+
+class AudioSource
+{
+public:
+	AudioSource() : m_leftRingBuffer(nullptr), m_rightRingBuffer(nullptr) {}
+	virtual ~AudioSource() {}
+
+	virtual bool open() = 0;
+	/*
+	* Prepares the source for capture. Call this on the thread that will call capture().
+	* Returns false if the source can not be used.
+	*/
+
+	virtual int capture(AudioRingBuffer * ringBuffer) = 0;
+	/*
+	* Appends all currently available samples, mixed down to mono, to ringBuffer.
+	* Returns the number of new samples.
+	*/
+
+	virtual int getSampleRate() = 0;
+	virtual int getNumChannels() = 0;
+
+	virtual bool isRealTime() { return true; }
+	/*
+	* Returns true if samples become available at the sample rate, so the caller should sleep between captures.
+	* Returns false if the caller should capture again as soon as it has processed the last batch.
+	*/
+
+	virtual bool isFinished() { return false; }
+	/*
+	* Returns true once the source has no more samples to give.
+	*/
+
+	void setChannelRingBuffers(AudioRingBuffer * leftRingBuffer, AudioRingBuffer * rightRingBuffer);
+	/*
+	* From now on capture() also appends the first and second channel to these ring buffers, alongside the mono mix.
+	* Pre:
+	*	Both ring buffers have the same capacity as the mono ring buffer passed to capture(), so all three stay at the same write index.
+	*	They may be nullptr to stop capturing channels.
+	* Post:
+	*	Mono sources write the same samples to both. Channels after the second are only part of the mono mix.
+	*/
+
+protected:
+	AudioRingBuffer * m_leftRingBuffer;
+	AudioRingBuffer * m_rightRingBuffer;
+};
+
+class LoopbackAudioSource : public AudioSource
+{
+public:
+	bool open();
+	int capture(AudioRingBuffer * ringBuffer);
+	int getSampleRate();
+	int getNumChannels();
+};
+
+class FileAudioSource : public AudioSource
+{
+public:
+	FileAudioSource(const char * path, bool realTime, int rawSampleRate = 48000, int rawNumChannels = 2);
+	/*
+	* Constructor
+	* Pre:
+	*	path is a WAV file (16, 24 or 32 bit integer PCM or 32 bit float) or a raw file of interleaved 32 bit floats.
+	*	Files that do not start with a RIFF/WAVE header are treated as raw float PCM with rawSampleRate and rawNumChannels.
+	*	If realTime is true, samples are released at the sample rate. Otherwise every capture() releases the next block of samples.
+	* Post:
+	*	The source is created. The file is not mapped until open() is called.
+	*/
+
+	bool open();
+	int capture(AudioRingBuffer * ringBuffer);
+	int getSampleRate() { return m_sampleRate; }
+	int getNumChannels() { return m_numChannels; }
+	bool isRealTime() { return m_realTime; }
+	bool isFinished() { return !m_looping && m_position >= m_numFrames; }
+
+	void setLooping(bool looping) { m_looping = looping; }
+	void setBlockSize(int blockSize) { m_blockSize = blockSize; }
+	/*
+	* The number of samples released per capture() call when not in real time mode. Defaults to 4096.
+	*/
+
+	long long getNumFrames() { return m_numFrames; }
+	/*
+	* Returns the length of the file in samples per channel.
+	*/
+
+	void readMono(long long firstFrame, int numFrames, float * outBuffer) const;
+	/*
+	* Random access to the file.
+	* Pre:
+	*	open() returned true. [firstFrame, firstFrame + numFrames) is within [0, getNumFrames())
+	* Post:
+	*	outBuffer contains numFrames samples mixed down to mono
+	*	This only reads the mapped file, so it is safe to call from several threads at once.
+	*/
+
+	void readChannel(long long firstFrame, int numFrames, int channel, float * outBuffer) const;
+	/*
+	* Same as readMono(), but reads a single channel. channel must be in the range [0, getNumChannels())
+	*/
+
+	void seek(long long frame) { m_position = frame; }
+
+private:
+	enum SampleFormat { SAMPLE_INT16, SAMPLE_INT24, SAMPLE_INT32, SAMPLE_FLOAT32 };
+
+	bool parseWav();
+	/*
+	* Reads the format and data chunks of a WAV file. Returns false if the header is not a supported WAV file.
+	*/
+
+	float readSample(const unsigned char * sample) const;
+
+	const char * m_path;
+	MappedFile m_file;
+	const unsigned char * m_samples;
+	SampleFormat m_sampleFormat;
+	int m_bytesPerSample;
+	int m_sampleRate;
+	int m_numChannels;
+	long long m_numFrames;
+
+	bool m_realTime;
+	bool m_looping;
+	int m_blockSize;
+	long long m_position;
+	long long m_pacedFrames;
+	bool m_started;
+	std::chrono::steady_clock::time_point m_startTime;
+};
+
+#endif
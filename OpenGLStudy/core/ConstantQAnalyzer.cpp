@@ -0,0 +1,156 @@
+#include "ConstantQAnalyzer.h"
+
+#include <cmath>
+
+namespace
+{
+	// Kernel spectrum values below this fraction of the largest value in their row are dropped
+	const float KERNEL_THRESHOLD = 0.005f;
+}
+
+ConstantQAnalyzer::ConstantQAnalyzer(int frameSize, int sampleRate, float minFrequency, float maxFrequency, int numBins) :
+	m_fftInSize(frameSize),
+	m_fftOutSize(frameSize / 2 + 1),
+	m_sampleRate(sampleRate),
+	m_minFrequency(minFrequency),
+	m_maxFrequency(maxFrequency),
+	m_numBins(numBins)
+{
+	m_fftIn = new float[m_fftInSize]();
+	m_fftPlan = FFTPlanCache::getInstance().getRealPlan(m_fftInSize);
+	m_frequencySpectrum = new FrequencySpectrum(m_numBins);
+	buildKernel();
+}
+
+ConstantQAnalyzer::~ConstantQAnalyzer()
+{
+	delete[] m_fftIn;
+	delete m_frequencySpectrum;
+}
+
+void ConstantQAnalyzer::readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd)
+{
+	ringBuffer->read(frameEnd, m_fftInSize, m_fftIn);
+}
+
+void ConstantQAnalyzer::processFrame()
+{
+	// One real fft, then every bin is the sparse dot product of its kernel row with the spectrum
+	float * fftOut = FFTPlanCache::getThreadScratch(m_fftOutSize * 2);
+	FFTPlanCache::realForward(m_fftPlan, m_fftIn, (kiss_fft_cpx *)fftOut);
+
+	const int * starts = m_kernelStarts.data();
+	const int * indices = m_kernelIndices.data();
+	const float * kernelReal = m_kernelReal.data();
+	const float * kernelImag = m_kernelImag.data();
+	float * outputData = m_frequencySpectrum->data;
+	for (int i = 0; i < m_numBins; i++)
+	{
+		float rl = 0.0f;
+		float im = 0.0f;
+		for (int j = starts[i]; j < starts[i + 1]; j++)
+		{
+			float xr = fftOut[indices[j] * 2];
+			float xi = fftOut[indices[j] * 2 + 1];
+			rl += xr * kernelReal[j] - xi * kernelImag[j];
+			im += xr * kernelImag[j] + xi * kernelReal[j];
+		}
+		outputData[i] = sqrtf(rl * rl + im * im);
+	}
+}
+
+void ConstantQAnalyzer::setFrameSize(int frameSize)
+{
+	m_fftInSize = frameSize;
+	m_fftOutSize = frameSize / 2 + 1;
+
+	delete[] m_fftIn;
+	m_fftIn = new float[m_fftInSize]();
+	m_fftPlan = FFTPlanCache::getInstance().getRealPlan(m_fftInSize);
+
+	buildKernel();
+}
+
+void ConstantQAnalyzer::setFrequencyRange(int sampleRate, float minFrequency, float maxFrequency, int numBins)
+{
+	m_sampleRate = sampleRate;
+	m_minFrequency = minFrequency;
+	m_maxFrequency = maxFrequency;
+	if (m_numBins != numBins)
+	{
+		m_numBins = numBins;
+		m_frequencySpectrum->resize(m_numBins);
+	}
+	buildKernel();
+}
+
+float ConstantQAnalyzer::getBinFrequency(int bin)
+{
+	float maxFrequency = fminf(m_maxFrequency, (float)m_sampleRate * 0.5f);
+	if (m_numBins < 2)
+		return m_minFrequency;
+	return m_minFrequency * powf(maxFrequency / m_minFrequency, (float)bin / (float)(m_numBins - 1));
+}
+
+void ConstantQAnalyzer::buildKernel()
+{
+	m_kernelStarts.assign(1, 0);
+	m_kernelIndices.clear();
+	m_kernelReal.clear();
+	m_kernelImag.clear();
+
+	// Bins per octave decides Q, the ratio of a bin's frequency to its bandwidth
+	float maxFrequency = fminf(m_maxFrequency, (float)m_sampleRate * 0.5f);
+	double octaves = log2((double)maxFrequency / (double)m_minFrequency);
+	double binsPerOctave = octaves > 0.0 ? (double)(m_numBins - 1) / octaves : 1.0;
+	double q = 1.0 / (pow(2.0, 1.0 / binsPerOctave) - 1.0);
+
+	const double pi = 3.14159265358979323846;
+	const FFTPlan * kernelPlan = FFTPlanCache::getInstance().getComplexPlan(m_fftInSize);
+	kiss_fft_cpx * temporalKernel = new kiss_fft_cpx[m_fftInSize];
+	kiss_fft_cpx * spectralKernel = new kiss_fft_cpx[m_fftInSize];
+	for (int bin = 0; bin < m_numBins; bin++)
+	{
+		// Hann windowed complex sinusoid at the bin frequency, aligned to the end of the frame
+		double frequency = (double)getBinFrequency(bin);
+		int windowSize = (int)ceil(q * (double)m_sampleRate / frequency);
+		if (windowSize > m_fftInSize)
+			windowSize = m_fftInSize;
+		if (windowSize < 2)
+			windowSize = 2;
+		int windowStart = m_fftInSize - windowSize;
+
+		double windowSum = 0.0;
+		for (int n = 0; n < m_fftInSize; n++)
+			temporalKernel[n].r = temporalKernel[n].i = 0.0f;
+		for (int n = 0; n < windowSize; n++)
+		{
+			double window = 0.5 - 0.5 * cos(2.0 * pi * ((double)n + 0.5) / (double)windowSize);
+			double phase = 2.0 * pi * frequency * (double)(windowStart + n) / (double)m_sampleRate;
+			temporalKernel[windowStart + n].r = (float)(window * cos(phase));
+			temporalKernel[windowStart + n].i = (float)(window * sin(phase));
+			windowSum += window;
+		}
+		FFTPlanCache::complexTransform(kernelPlan, temporalKernel, spectralKernel);
+
+		// By Parseval, sum(x[n] * conj(k[n])) = sum(X[m] * conj(K[m])) / N.
+		// The kernel sits at a positive frequency, so only the bins the real fft returns are needed.
+		// Scaling by 2 / windowSum makes a sine of amplitude A come out as A
+		double scale = 2.0 / (windowSum * (double)m_fftInSize);
+		float maxMagnitude = 0.0f;
+		for (int m = 0; m < m_fftOutSize; m++)
+			maxMagnitude = fmaxf(maxMagnitude, sqrtf(spectralKernel[m].r * spectralKernel[m].r + spectralKernel[m].i * spectralKernel[m].i));
+		for (int m = 0; m < m_fftOutSize; m++)
+		{
+			float magnitude = sqrtf(spectralKernel[m].r * spectralKernel[m].r + spectralKernel[m].i * spectralKernel[m].i);
+			if (magnitude < maxMagnitude * KERNEL_THRESHOLD)
+				continue;
+			m_kernelIndices.push_back(m);
+			m_kernelReal.push_back((float)(spectralKernel[m].r * scale));
+			m_kernelImag.push_back((float)(-spectralKernel[m].i * scale));
+		}
+		m_kernelStarts.push_back((int)m_kernelIndices.size());
+	}
+	delete[] temporalKernel;
+	delete[] spectralKernel;
+}
@@ -0,0 +1,86 @@
+#ifndef CONSTANTQANALYZER_H
+#define CONSTANTQANALYZER_H
+
+/*
+* Constant Q analysis with a precomputed sparse spectral kernel (Brown and Puckette).
+* Every output bin is a windowed complex sinusoid at a log spaced frequency, with a window length that gives every bin the same Q,
+* so low bins get long windows and fine resolution while high bins get short windows instead of thousands of wasted linear bins.
+* Each kernel is transformed once into the frequency domain, where it is concentrated around its own frequency.
+* Only the significant values are kept, so one frame costs a single real fft and a sparse dot product per bin.
+*
+* The windows are aligned to the end of the frame, so every bin sees the newest audio.
+* Bins whose constant Q window would be longer than the frame are given the whole frame, which limits their resolution.
+*/
+
+#include <vector>
+
+#include "FrequencyAnalyzer.h"
+#include "FFTPlanCache.h"
+
+class ConstantQAnalyzer : public FrequencyAnalyzer
+{
+public:
+	ConstantQAnalyzer(int frameSize, int sampleRate, float minFrequency, float maxFrequency, int numBins);
+	/*
+	* Constructor
+	* Pre:
+	*	frameSize is the number of samples in each frame, and the longest window any bin can have
+	*	sampleRate is the sample rate of the audio
+	*	[minFrequency, maxFrequency] is the range of the bins in Hz. maxFrequency is clamped to the nyquist frequency.
+	*	numBins is the number of log spaced output bins
+	* Post:
+	*	The spectral kernel is built. The magnitude of a bin for a sine at its frequency with amplitude A is A.
+	*/
+
+	~ConstantQAnalyzer();
+
+	float * getFrameInputBuffer() { return m_fftIn; }
+	void readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd);
+	void processFrame();
+	FrequencySpectrum * getFrequencySpectrum() { return m_frequencySpectrum; }
+
+	int getFrameSize() { return m_fftInSize; }
+	void setFrameSize(int frameSize);
+	/*
+	* Rebuilds the spectral kernel for the new frame size
+	*/
+
+	void setFrequencyRange(int sampleRate, float minFrequency, float maxFrequency, int numBins);
+	/*
+	* Rebuilds the spectral kernel for a new sample rate, frequency range and number of bins
+	*/
+
+	float getBinFrequency(int bin);
+	/*
+	* Returns the center frequency of a bin in Hz
+	*/
+
+	int getNumKernelValues() { return (int)m_kernelIndices.size(); }
+	/*
+	* Total number of non zero values in the sparse kernel, which is the number of complex multiplies per frame
+	*/
+
+private:
+	void buildKernel();
+
+	int m_fftInSize;
+	int m_fftOutSize;
+	float * m_fftIn;
+	const FFTPlan * m_fftPlan;
+
+	int m_sampleRate;
+	float m_minFrequency;
+	float m_maxFrequency;
+	int m_numBins;
+
+	// Sparse kernel, one row per bin. Row i is [m_kernelStarts[i], m_kernelStarts[i + 1]).
+	// The values are the complex conjugate of the kernel spectrum, already scaled, so a bin is a plain sum of products
+	std::vector<int> m_kernelStarts;
+	std::vector<int> m_kernelIndices;
+	std::vector<float> m_kernelReal;
+	std::vector<float> m_kernelImag;
+
+	FrequencySpectrum * m_frequencySpectrum;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "CpuFeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPUFEATURES_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef CPUFEATURES_X86
+	void cpuid(int leaf, int subleaf, unsigned int registers[4])
+	{
+#ifdef _MSC_VER
+		__cpuidex((int *)registers, leaf, subleaf);
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	}
+
+	unsigned long long readXcr0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int low, high;
+		__asm__ volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((unsigned long long)high << 32) | low;
+#endif
+	}
+#endif
+
+	CpuFeatures detectFeatures()
+	{
+		CpuFeatures features = {};
+#ifdef CPUFEATURES_X86
+		unsigned int registers[4];
+		cpuid(0, 0, registers);
+		unsigned int maxLeaf = registers[0];
+
+		cpuid(1, 0, registers);
+		features.sse2 = (registers[3] & (1u << 26)) != 0;
+		features.sse41 = (registers[2] & (1u << 19)) != 0;
+
+		// The avx registers are only usable when the os saves them on context switches, which xgetbv reports
+		bool osxsave = (registers[2] & (1u << 27)) != 0;
+		unsigned long long xcr0 = osxsave ? readXcr0() : 0;
+		bool osSavesAvx = (xcr0 & 0x6) == 0x6;
+		bool osSavesAvx512 = (xcr0 & 0xe6) == 0xe6;
+
+		features.avx = osSavesAvx && (registers[2] & (1u << 28)) != 0;
+		features.fma = features.avx && (registers[2] & (1u << 12)) != 0;
+		features.f16c = features.avx && (registers[2] & (1u << 29)) != 0;
+		if (maxLeaf >= 7)
+		{
+			cpuid(7, 0, registers);
+			features.avx2 = features.avx && (registers[1] & (1u << 5)) != 0;
+			features.avx512f = osSavesAvx512 && (registers[1] & (1u << 16)) != 0;
+		}
+#endif
+		return features;
+	}
+}
+
+const CpuFeatures & CpuFeatures::get()
+{
+	static const CpuFeatures features = detectFeatures();
+	return features;
+}
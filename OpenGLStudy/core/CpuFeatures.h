@@ -0,0 +1,26 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+/*
+* The instruction sets the cpu and the operating system support, read once with cpuid.
+* Kernels that have SIMD versions check these flags to pick the widest version that can run.
+* Every flag is false on cpus that are not x86.
+*/
+
+struct CpuFeatures
+{
+	bool sse2;
+	bool sse41;
+	bool avx;
+	bool avx2;
+	bool fma;
+	bool f16c;
+	bool avx512f;	// also requires the os to save the avx-512 registers
+
+	static const CpuFeatures & get();
+	/*
+	* Returns the features of the cpu this program runs on. Thread safe.
+	*/
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "DomainShiftTable.h"
+#include "SpectrumKernels.h"
+
+#include <cmath>
+
+DomainShiftTable::DomainShiftTable() :
+	m_exponent(0.0f),
+	m_inSize(0),
+	m_outSize(0),
+	m_areaAverage(false),
+	m_numLerpRows(0),
+	m_suffixStart(0)
+{
+}
+
+bool DomainShiftTable::update(float exponent, int inSize, int outSize, bool areaAverage)
+{
+	if (exponent == m_exponent && inSize == m_inSize && outSize == m_outSize && areaAverage == m_areaAverage)
+		return false;
+	m_exponent = exponent;
+	m_inSize = inSize;
+	m_outSize = outSize;
+	m_areaAverage = areaAverage;
+
+	m_lerpIndices.clear();
+	m_lerpFractions.clear();
+	m_rowStarts.assign(1, 0);
+	m_indices.clear();
+	m_weights.clear();
+
+	// Position of an output bin on the input, in input bins. Fractional bins give the edges of an output bin
+	float width = (float)(inSize - 1);
+	auto position = [&](double outputBin)
+	{
+		double t = outputBin / (double)(outSize - 1);
+		t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+		return (double)width * (1.0 - pow(1.0 - t, (double)exponent));
+	};
+
+	// The width of an output bin on the input changes monotonically with i, so the rows that span several input bins
+	// are one range. Interpolated rows before and after it both go through the gather: a lerp prefix and a lerp suffix
+	int firstWideRow = outSize;
+	int lastWideRow = -1;
+	if (areaAverage)
+	{
+		for (int i = 0; i < outSize; i++)
+		{
+			if (position(i + 0.5) - position(i - 0.5) > 1.0)
+			{
+				firstWideRow = i < firstWideRow ? i : firstWideRow;
+				lastWideRow = i;
+			}
+		}
+	}
+	m_numLerpRows = firstWideRow;
+	m_suffixStart = lastWideRow + 1 > firstWideRow ? lastWideRow + 1 : firstWideRow;
+
+	for (int i = 0; i < outSize; i++)
+	{
+		double low = position(i - 0.5);
+		double high = position(i + 0.5);
+		bool spansSeveralBins = areaAverage && high - low > 1.0;
+		bool lerpRow = i < m_numLerpRows || i >= m_suffixStart;
+
+		if (!spansSeveralBins)
+		{
+			// Same interpolation as utl::getValueLerp(). The last output lands exactly on the last input,
+			// which is written as the pair before it with a fraction of 1 so the gather never reads past the end
+			float t = (float)i / (float)(outSize - 1);
+			t = 1.0f - pow(1.0f - t, exponent);
+			int j = (int)(width * t);
+			float pct = width * t - (float)j;
+			if (j > inSize - 2)
+			{
+				pct += (float)(j - (inSize - 2));
+				j = inSize - 2;
+			}
+			if (lerpRow)
+			{
+				m_lerpIndices.push_back(j);
+				m_lerpFractions.push_back(pct);
+				continue;
+			}
+			m_indices.push_back(j);
+			m_weights.push_back(1.0f - pct);
+			m_indices.push_back(j + 1);
+			m_weights.push_back(pct);
+			m_rowStarts.push_back((int)m_indices.size());
+			continue;
+		}
+
+		// Input bin k covers [k - 0.5, k + 0.5], and gets the share of [low, high] that overlaps it
+		int first = (int)floor(low + 0.5);
+		int last = (int)floor(high + 0.5);
+		first = first < 0 ? 0 : first;
+		last = last > inSize - 1 ? inSize - 1 : last;
+		for (int k = first; k <= last; k++)
+		{
+			double overlap = fmin(high, k + 0.5) - fmax(low, k - 0.5);
+			if (overlap <= 0.0)
+				continue;
+			m_indices.push_back(k);
+			m_weights.push_back((float)(overlap / (high - low)));
+		}
+		m_rowStarts.push_back((int)m_indices.size());
+	}
+	return true;
+}
+
+void DomainShiftTable::apply(const float * inputData, float * outputData) const
+{
+	simd::lerpGather(inputData, m_lerpIndices.data(), m_lerpFractions.data(), outputData, m_numLerpRows);
+	simd::lerpGather(inputData, m_lerpIndices.data() + m_numLerpRows, m_lerpFractions.data() + m_numLerpRows,
+		outputData + m_suffixStart, m_outSize - m_suffixStart);
+
+	const int * rowStarts = m_rowStarts.data();
+	const int * indices = m_indices.data();
+	const float * weights = m_weights.data();
+	for (int i = m_numLerpRows; i < m_suffixStart; i++)
+	{
+		int row = i - m_numLerpRows;
+		float sum = 0.0f;
+		for (int k = rowStarts[row]; k < rowStarts[row + 1]; k++)
+			sum += inputData[indices[k]] * weights[k];
+		outputData[i] = sum;
+	}
+}
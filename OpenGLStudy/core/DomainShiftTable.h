@@ -0,0 +1,102 @@
+#ifndef DOMAINSHIFTTABLE_H
+#define DOMAINSHIFTTABLE_H
+
+/*
+* The exponential domain shift from utl::expDomainShift() and DomainShiftFilter, compiled into a table of input indices and weights.
+* Output bin i sits at t = 1 - (1 - i / (outSize - 1))^exponent on the input, so the mapping only depends on
+* the exponent and the two sizes, and the table is only rebuilt when one of them changes.
+*
+* Without area averaging every output bin is a linear interpolation of the two input bins around it, like before.
+* With area averaging, an output bin that spans more than one input bin is instead the mean of every input bin it covers,
+* weighted by how much of each one falls inside it, so narrow peaks between sample points are not skipped.
+*
+* Rows that are plain interpolations are kept as (index, fraction) pairs and run through the SIMD gather in SpectrumKernels.h.
+* Rows with more inputs are kept in compressed sparse row form. Output bins get wider toward one end of the spectrum
+* (the bass end for exponents above 1, the treble end below 1), so those rows are one range between a lerp prefix and a lerp suffix.
+*/
+
+#include <vector>
+
+class DomainShiftTable
+{
+public:
+	DomainShiftTable();
+
+	bool update(float exponent, int inSize, int outSize, bool areaAverage = false);
+	/*
+	* Rebuilds the table if any parameter changed since the last call.
+	* Pre:
+	*	inSize >= 2 and outSize >= 2
+	* Post:
+	*	returns true if the table was rebuilt
+	*/
+
+	void apply(const float * inputData, float * outputData) const;
+	/*
+	* outputData[i] = the domain shifted value of output bin i.
+	* Pre:
+	*	inputData has inSize values and outputData has room for outSize values
+	*/
+
+	template <class T>
+	void applyGeneric(const T * inputData, T * outputData) const;
+	/*
+	* Same as apply() for any type that can be scaled by a float and added, for example glm vectors
+	*/
+
+	int getInSize() const { return m_inSize; }
+	int getOutSize() const { return m_outSize; }
+
+	int getNumLerpRows() const { return m_numLerpRows; }
+	int getSuffixStart() const { return m_suffixStart; }
+	const int * getLerpIndices() const { return m_lerpIndices.data(); }
+	const float * getLerpFractions() const { return m_lerpFractions.data(); }
+	/*
+	* Rows [0, getNumLerpRows()) and [getSuffixStart(), getOutSize()) are (1 - fraction) * input[index] + fraction * input[index + 1].
+	* The pairs of the prefix come first, then the pairs of the suffix.
+	*/
+
+	const int * getRowStarts() const { return m_rowStarts.data(); }
+	const int * getIndices() const { return m_indices.data(); }
+	const float * getWeights() const { return m_weights.data(); }
+	/*
+	* Row getNumLerpRows() + r, up to getSuffixStart(), is the sum of input[indices[k]] * weights[k] for k in [rowStarts[r], rowStarts[r + 1])
+	*/
+
+private:
+	float m_exponent;
+	int m_inSize;
+	int m_outSize;
+	bool m_areaAverage;
+
+	int m_numLerpRows;
+	int m_suffixStart;
+	std::vector<int> m_lerpIndices;
+	std::vector<float> m_lerpFractions;
+	std::vector<int> m_rowStarts;
+	std::vector<int> m_indices;
+	std::vector<float> m_weights;
+};
+
+template <class T>
+void DomainShiftTable::applyGeneric(const T * inputData, T * outputData) const
+{
+	// The pairs of the lerp suffix follow the pairs of the prefix
+	for (int pair = 0; pair < (int)m_lerpIndices.size(); pair++)
+	{
+		int i = pair < m_numLerpRows ? pair : m_suffixStart + (pair - m_numLerpRows);
+		int j = m_lerpIndices[pair];
+		float pct = m_lerpFractions[pair];
+		outputData[i] = (1.0f - pct) * inputData[j] + pct * inputData[j + 1];
+	}
+	for (int i = m_numLerpRows; i < m_suffixStart; i++)
+	{
+		int row = i - m_numLerpRows;
+		T sum = inputData[m_indices[m_rowStarts[row]]] * m_weights[m_rowStarts[row]];
+		for (int k = m_rowStarts[row] + 1; k < m_rowStarts[row + 1]; k++)
+			sum = sum + inputData[m_indices[k]] * m_weights[k];
+		outputData[i] = sum;
+	}
+}
+
+#endif
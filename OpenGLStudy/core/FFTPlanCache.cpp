@@ -0,0 +1,169 @@
+#include "FFTPlanCache.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+
+namespace
+{
+	// A grow only, 64 byte aligned buffer that is freed when its thread exits
+	struct ScratchBuffer
+	{
+		void * memory;
+		char * aligned;
+		size_t capacity;
+
+		ScratchBuffer() : memory(nullptr), aligned(nullptr), capacity(0) {}
+		~ScratchBuffer() { free(memory); }
+
+		void * get(size_t numBytes)
+		{
+			if (numBytes > capacity)
+			{
+				free(memory);
+				memory = malloc(numBytes + 64);
+				aligned = (char *)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+				capacity = numBytes;
+			}
+			return aligned;
+		}
+	};
+
+	// The work buffer of the real transforms is separate from the scratch buffer handed out to callers,
+	// so a caller can transform straight into its scratch buffer
+	thread_local ScratchBuffer threadScratch;
+	thread_local ScratchBuffer threadWorkBuffer;
+
+	long long planKey(int size, bool inverse, bool real)
+	{
+		return ((long long)size << 2) | (inverse ? 2 : 0) | (real ? 1 : 0);
+	}
+}
+
+FFTPlanCache & FFTPlanCache::getInstance()
+{
+	static FFTPlanCache instance;
+	return instance;
+}
+
+FFTPlanCache::FFTPlanCache() :
+	m_lookups(0),
+	m_hits(0),
+	m_numPlans(0)
+{
+}
+
+FFTPlanCache::~FFTPlanCache()
+{
+	for (auto & entry : m_plans)
+	{
+		free(entry.second->complexPlan);
+		delete[] entry.second->superTwiddles;
+		delete entry.second;
+	}
+}
+
+const FFTPlan * FFTPlanCache::getPlan(int size, bool inverse, bool real)
+{
+	m_lookups++;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	long long key = planKey(size, inverse, real);
+	std::map<long long, FFTPlan *>::iterator found = m_plans.find(key);
+	if (found != m_plans.end())
+	{
+		m_hits++;
+		return found->second;
+	}
+
+	// A real fft of size N is a complex fft of size N / 2 on the even and odd samples, split apart with the super twiddles
+	FFTPlan * plan = new FFTPlan;
+	plan->size = size;
+	plan->inverse = inverse;
+	plan->real = real;
+	plan->superTwiddles = nullptr;
+	if (real)
+	{
+		int halfSize = size / 2;
+		plan->complexPlan = kiss_fft_alloc(halfSize, inverse ? 1 : 0, NULL, NULL);
+		plan->superTwiddles = new kiss_fft_cpx[halfSize / 2 > 0 ? halfSize / 2 : 1];
+		for (int i = 0; i < halfSize / 2; i++)
+		{
+			double phase = -3.14159265358979323846 * ((double)(i + 1) / (double)halfSize + 0.5);
+			if (inverse)
+				phase = -phase;
+			plan->superTwiddles[i].r = (float)cos(phase);
+			plan->superTwiddles[i].i = (float)sin(phase);
+		}
+	}
+	else
+		plan->complexPlan = kiss_fft_alloc(size, inverse ? 1 : 0, NULL, NULL);
+
+	m_plans[key] = plan;
+	m_numPlans++;
+	return plan;
+}
+
+void FFTPlanCache::realForward(const FFTPlan * plan, const float * timeData, kiss_fft_cpx * frequencyData)
+{
+	// Same steps as kiss_fftr, with the work buffer taken from this thread instead of the plan
+	int halfSize = plan->size / 2;
+	kiss_fft_cpx * work = (kiss_fft_cpx *)threadWorkBuffer.get(halfSize * sizeof(kiss_fft_cpx));
+	kiss_fft(plan->complexPlan, (const kiss_fft_cpx *)timeData, work);
+
+	// The DC bin holds the sums of the even and odd samples, which give the DC and nyquist bins
+	float dcEven = work[0].r;
+	float dcOdd = work[0].i;
+	frequencyData[0].r = dcEven + dcOdd;
+	frequencyData[halfSize].r = dcEven - dcOdd;
+	frequencyData[0].i = frequencyData[halfSize].i = 0.0f;
+
+	for (int k = 1; k <= halfSize / 2; k++)
+	{
+		kiss_fft_cpx fpk = work[k];
+		kiss_fft_cpx fpnk = { work[halfSize - k].r, -work[halfSize - k].i };
+		kiss_fft_cpx f1k = { fpk.r + fpnk.r, fpk.i + fpnk.i };
+		kiss_fft_cpx f2k = { fpk.r - fpnk.r, fpk.i - fpnk.i };
+		kiss_fft_cpx twiddle = plan->superTwiddles[k - 1];
+		kiss_fft_cpx tw = { f2k.r * twiddle.r - f2k.i * twiddle.i, f2k.r * twiddle.i + f2k.i * twiddle.r };
+
+		frequencyData[k].r = (f1k.r + tw.r) * 0.5f;
+		frequencyData[k].i = (f1k.i + tw.i) * 0.5f;
+		frequencyData[halfSize - k].r = (f1k.r - tw.r) * 0.5f;
+		frequencyData[halfSize - k].i = (tw.i - f1k.i) * 0.5f;
+	}
+}
+
+void FFTPlanCache::realInverse(const FFTPlan * plan, const kiss_fft_cpx * frequencyData, float * timeData)
+{
+	// Same steps as kiss_fftri, with the work buffer taken from this thread instead of the plan
+	int halfSize = plan->size / 2;
+	kiss_fft_cpx * work = (kiss_fft_cpx *)threadWorkBuffer.get(halfSize * sizeof(kiss_fft_cpx));
+
+	work[0].r = frequencyData[0].r + frequencyData[halfSize].r;
+	work[0].i = frequencyData[0].r - frequencyData[halfSize].r;
+	for (int k = 1; k <= halfSize / 2; k++)
+	{
+		kiss_fft_cpx fk = frequencyData[k];
+		kiss_fft_cpx fnkc = { frequencyData[halfSize - k].r, -frequencyData[halfSize - k].i };
+		kiss_fft_cpx fek = { fk.r + fnkc.r, fk.i + fnkc.i };
+		kiss_fft_cpx difference = { fk.r - fnkc.r, fk.i - fnkc.i };
+		kiss_fft_cpx twiddle = plan->superTwiddles[k - 1];
+		kiss_fft_cpx fok = { difference.r * twiddle.r - difference.i * twiddle.i, difference.r * twiddle.i + difference.i * twiddle.r };
+
+		work[k].r = fek.r + fok.r;
+		work[k].i = fek.i + fok.i;
+		work[halfSize - k].r = fek.r - fok.r;
+		work[halfSize - k].i = fok.i - fek.i;
+	}
+	kiss_fft(plan->complexPlan, work, (kiss_fft_cpx *)timeData);
+}
+
+void FFTPlanCache::complexTransform(const FFTPlan * plan, const kiss_fft_cpx * input, kiss_fft_cpx * output)
+{
+	kiss_fft(plan->complexPlan, input, output);
+}
+
+float * FFTPlanCache::getThreadScratch(int numFloats)
+{
+	return (float *)threadScratch.get(numFloats * sizeof(float));
+}
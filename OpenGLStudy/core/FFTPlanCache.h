@@ -0,0 +1,90 @@
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+
+/*
+* A process wide cache of kissfft plans, keyed by size, direction and real/complex.
+* Plans are created the first time they are asked for and live until the program exits,
+* so switching between frame sizes only costs a lookup after the first time each size is used.
+*
+* Plans are read only after they are created, so one plan can be used by several threads at once.
+* kiss_fftr keeps a work buffer inside its config, which would make shared real plans unsafe,
+* so real transforms go through realForward() and realInverse() instead, which use a work buffer owned by the calling thread.
+*/
+
+#include <map>
+#include <mutex>
+#include <atomic>
+
+#include "kissfft/kiss_fft.h"
+
+struct FFTPlan
+{
+	int size;						// number of time domain samples
+	bool inverse;
+	bool real;
+	kiss_fft_cfg complexPlan;		// size points for complex plans, size / 2 points for real plans
+	kiss_fft_cpx * superTwiddles;	// real plans only. Rotations used to split the half size complex fft into the real fft
+};
+
+class FFTPlanCache
+{
+public:
+	static FFTPlanCache & getInstance();
+
+	const FFTPlan * getPlan(int size, bool inverse, bool real);
+	/*
+	* Thread safe. Returns the plan for the given size, direction and type, creating it if this is the first request.
+	* Pre:
+	*	size is even for real plans
+	* Post:
+	*	The plan stays valid until the program exits
+	*/
+
+	const FFTPlan * getRealPlan(int size) { return getPlan(size, false, true); }
+	const FFTPlan * getComplexPlan(int size, bool inverse = false) { return getPlan(size, inverse, false); }
+
+	static void realForward(const FFTPlan * plan, const float * timeData, kiss_fft_cpx * frequencyData);
+	/*
+	* Same as kiss_fftr. timeData has plan->size samples, frequencyData has room for plan->size / 2 + 1 bins.
+	* Safe to call from several threads with the same plan. Does not allocate once the calling thread has seen this size.
+	*/
+
+	static void realInverse(const FFTPlan * plan, const kiss_fft_cpx * frequencyData, float * timeData);
+	/*
+	* Same as kiss_fftri. plan must be an inverse real plan.
+	*/
+
+	static void complexTransform(const FFTPlan * plan, const kiss_fft_cpx * input, kiss_fft_cpx * output);
+	/*
+	* Same as kiss_fft. input and output must not be the same buffer (in place transforms allocate inside kissfft).
+	*/
+
+	static float * getThreadScratch(int numFloats);
+	/*
+	* Returns a 64 byte aligned buffer of at least numFloats floats, owned by the calling thread.
+	* The buffer only grows, so a thread that keeps asking for the same size never allocates again.
+	* The contents are undefined, and the pointer is only valid until the next call on the same thread.
+	*/
+
+	long long getNumLookups() { return m_lookups.load(); }
+	long long getNumHits() { return m_hits.load(); }
+	int getNumPlans() { return m_numPlans.load(); }
+	/*
+	* Counters for every getPlan() call, the ones that found an existing plan, and the number of plans created
+	*/
+
+private:
+	FFTPlanCache();
+	~FFTPlanCache();
+
+	std::mutex m_mutex;
+	std::map<long long, FFTPlan *> m_plans;
+	std::atomic<long long> m_lookups;
+	std::atomic<long long> m_hits;
+	std::atomic<int> m_numPlans;
+
+	FFTPlanCache(const FFTPlanCache &) = delete;
+	FFTPlanCache & operator=(const FFTPlanCache &) = delete;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef FREQUENCYANALYZER_H
+#define FREQUENCYANALYZER_H
+
+/*
+* Interface for anything that turns a frame of audio into a FrequencySpectrum.
+* The output of getFrequencySpectrum() is the input of the first SpectrumFilter in a chain.
+*/
+
+#include "FrequencySpectrum.h"
+#include "AudioRingBuffer.h"
+
+class FrequencyAnalyzer
+{
+public:
+	virtual ~FrequencyAnalyzer() {}
+
+	virtual float * getFrameInputBuffer() = 0;
+	/*
+	* The frame of samples to analyze. Fill getFrameSize() samples then call processFrame().
+	*/
+
+	virtual void readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd) = 0;
+	/*
+	* Fills the frame with the getFrameSize() samples that end at sample index frameEnd.
+	*/
+
+	virtual void processFrame() = 0;
+	virtual FrequencySpectrum * getFrequencySpectrum() = 0;
+
+	virtual int getFrameSize() = 0;
+	virtual void setFrameSize(int frameSize) = 0;
+};
+
+#endif
@@ -1 +1,78 @@
-#include "FrequencySpectrum.h"
\ No newline at end of file
+#include "FrequencySpectrum.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+	// malloc with room to move the start up to the next 64 bytes. The unaligned pointer is kept for free()
+	void * alignedBlock(size_t numBytes, void ** memory)
+	{
+		*memory = malloc(numBytes + 64);
+		memset(*memory, 0, numBytes + 64);
+		return (void *)(((uintptr_t)*memory + 63) & ~(uintptr_t)63);
+	}
+}
+
+FrequencySpectrum::FrequencySpectrum(int size) :
+	data(nullptr),
+	size(size),
+	m_capacity(0),
+	m_memory(nullptr)
+{
+	allocate(size);
+}
+
+FrequencySpectrum::FrequencySpectrum(FrequencySpectrum && other) :
+	data(nullptr),
+	size(0),
+	m_capacity(0),
+	m_memory(nullptr)
+{
+	*this = std::move(other);
+}
+
+FrequencySpectrum & FrequencySpectrum::operator=(FrequencySpectrum && other)
+{
+	std::swap(data, other.data);
+	std::swap(size, other.size);
+	std::swap(m_capacity, other.m_capacity);
+	std::swap(m_memory, other.m_memory);
+	return *this;
+}
+
+FrequencySpectrum::~FrequencySpectrum()
+{
+	free(m_memory);
+}
+
+void FrequencySpectrum::allocate(int capacity)
+{
+	free(m_memory);
+	m_capacity = capacity;
+	data = (float *)alignedBlock((size_t)capacity * sizeof(float), &m_memory);
+}
+
+void FrequencySpectrum::resize(int newSize)
+{
+	size = newSize;
+	if (newSize > m_capacity)
+		allocate(newSize);
+	else
+		memset(data, 0, size * sizeof(float));
+}
+
+void FrequencySpectrum::reserve(int newCapacity)
+{
+	if (newCapacity <= m_capacity)
+		return;
+	float * oldData = data;
+	void * oldMemory = m_memory;
+	m_memory = nullptr;
+
+	allocate(newCapacity);
+	memcpy(data, oldData, size * sizeof(float));
+	free(oldMemory);
+}
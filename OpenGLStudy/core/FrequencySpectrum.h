@@ -1,14 +1,47 @@
 #ifndef FREQUENCYSPECTRUM_H
 #define FREQUENCYSPECTRUM_H
 
+/*
+* The bins of one spectrum.
+* Storage is 64 byte aligned and only grows, so resizing to a size that fit before never allocates,
+* and the SIMD kernels can run over it with aligned loads.
+*/
+
 class FrequencySpectrum
 {
 public:
-	FrequencySpectrum(int size) : size(size), data(new float[size]()) {}
-	~FrequencySpectrum() {delete[] data;}
-	void resize(int newSize) { size = newSize; delete[] data; data = new float[size](); }
+	FrequencySpectrum(int size = 0);
+	FrequencySpectrum(FrequencySpectrum && other);
+	FrequencySpectrum & operator=(FrequencySpectrum && other);
+	~FrequencySpectrum();
+
+	void resize(int newSize);
+	/*
+	* Post:
+	*	There are newSize bins, all zero. Only allocates when newSize is more than getCapacity().
+	*/
+
+	void reserve(int newCapacity);
+	/*
+	* Grows the capacity to at least newCapacity bins. Keeps the data.
+	*/
+
+	int getCapacity() const { return m_capacity; }
+
 	float * data;
 	int size;
+
+private:
+	void allocate(int capacity);
+	/*
+	* Replaces the storage with a zeroed block of capacity bins
+	*/
+
+	int m_capacity;
+	void * m_memory;
+
+	FrequencySpectrum(const FrequencySpectrum &) = delete;
+	FrequencySpectrum & operator=(const FrequencySpectrum &) = delete;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,121 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :
+	m_data(nullptr),
+	m_size(0),
+	m_fileHandle(INVALID_HANDLE_VALUE),
+	m_mappingHandle(NULL)
+{
+}
+
+bool MappedFile::open(const char * path)
+{
+	close();
+
+	// Open the file and get its size
+	m_fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	// Map a read only view of the whole file
+	m_mappingHandle = CreateFileMappingA(m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mappingHandle == NULL)
+	{
+		close();
+		return false;
+	}
+	m_data = (const unsigned char *)MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	m_size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mappingHandle != NULL)
+		CloseHandle(m_mappingHandle);
+	if (m_fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(m_fileHandle);
+	m_data = nullptr;
+	m_size = 0;
+	m_mappingHandle = NULL;
+	m_fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() :
+	m_data(nullptr),
+	m_size(0),
+	m_fileDescriptor(-1)
+{
+}
+
+bool MappedFile::open(const char * path)
+{
+	close();
+
+	// Open the file and get its size
+	m_fileDescriptor = ::open(path, O_RDONLY);
+	if (m_fileDescriptor < 0)
+		return false;
+	struct stat fileStat;
+	if (fstat(m_fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	// Map a read only view of the whole file, and tell the kernel it will be read front to back
+	void * data = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, m_fileDescriptor, 0);
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	madvise(data, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+	m_data = (const unsigned char *)data;
+	m_size = (size_t)fileStat.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+		munmap((void *)m_data, m_size);
+	if (m_fileDescriptor >= 0)
+		::close(m_fileDescriptor);
+	m_data = nullptr;
+	m_size = 0;
+	m_fileDescriptor = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
@@ -0,0 +1,47 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+/*
+* A read-only memory mapped file.
+* The operating system pages the file in on demand, so large audio files can be streamed without copying them into memory.
+*/
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char * path);
+	/*
+	* Pre:
+	*	path is the path to an existing file
+	* Post:
+	*	returns true if the file was mapped. data() and size() then describe the whole file.
+	*	Any previously opened file is closed first.
+	*/
+
+	void close();
+
+	const unsigned char * data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool isOpen() const { return m_data != nullptr; }
+
+private:
+	const unsigned char * m_data;
+	size_t m_size;
+
+#ifdef _WIN32
+	void * m_fileHandle;
+	void * m_mappingHandle;
+#else
+	int m_fileDescriptor;
+#endif
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "MultiResolutionAnalyzer.h"
+
+#include <cmath>
+#include <cstring>
+
+MultiResolutionAnalyzer::MultiResolutionAnalyzer(int sampleRate, ThreadPool * threadPool) :
+	m_sampleRate(sampleRate),
+	m_threadPool(threadPool),
+	m_parallelFrameSize(16384),
+	m_crossfadeOctaves(0.5f),
+	m_frameSize(0),
+	m_frameIn(nullptr),
+	m_frameEnd(0),
+	m_frameFromRing(false),
+	m_frequencySpectrum(new FrequencySpectrum(0))
+{
+}
+
+MultiResolutionAnalyzer::~MultiResolutionAnalyzer()
+{
+	for (Band & band : m_bands)
+		delete band.analyzer;
+	delete[] m_frameIn;
+	delete m_frequencySpectrum;
+}
+
+void MultiResolutionAnalyzer::addBand(int frameSize, int frameGap, float maxFrequency)
+{
+	Band band;
+	band.analyzer = new SpectrumAnalyzer(frameSize);
+	band.frameGap = frameGap > 1 ? frameGap : 1;
+	band.maxFrequency = maxFrequency;
+	band.lastFrameEnd = 0;
+	band.hasFrame = false;
+	band.framesProcessed = 0;
+	m_bands.push_back(band);
+	rebuild();
+}
+
+void MultiResolutionAnalyzer::setCrossfadeWidth(float octaves)
+{
+	m_crossfadeOctaves = octaves > 0.0f ? octaves : 0.0f;
+	rebuild();
+}
+
+void MultiResolutionAnalyzer::readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd)
+{
+	// The longest band's frame contains every shorter band's frame at its end
+	ringBuffer->read(frameEnd, m_frameSize, m_frameIn);
+	m_frameEnd = frameEnd;
+	m_frameFromRing = true;
+}
+
+void MultiResolutionAnalyzer::processFrame()
+{
+	// Find the bands whose hop has passed. Bands that are not due keep their last spectrum
+	m_dueBands.clear();
+	int numLargeBands = 0;
+	for (int i = 0; i < (int)m_bands.size(); i++)
+	{
+		Band & band = m_bands[i];
+		long long samplesSinceFrame = m_frameEnd - band.lastFrameEnd;
+		if (!m_frameFromRing || !band.hasFrame || samplesSinceFrame >= band.frameGap || samplesSinceFrame < 0)
+		{
+			band.lastFrameEnd = m_frameEnd;
+			band.hasFrame = true;
+			m_dueBands.push_back(i);
+			if (band.analyzer->getFrameSize() >= m_parallelFrameSize)
+				numLargeBands++;
+		}
+	}
+	m_frameFromRing = false;
+
+	// Waking the workers costs more than small ffts, so only go parallel when there are several large bands to run
+	if (m_threadPool && m_dueBands.size() > 1 && numLargeBands > 1)
+		m_threadPool->parallelFor((int)m_dueBands.size(), [this](int i) { analyzeBand(m_dueBands[i]); });
+	else
+		for (int band : m_dueBands)
+			analyzeBand(band);
+
+	// Stitch the bands together, lerping each band's spectrum at the output bin frequencies
+	float * outputData = m_frequencySpectrum->data;
+	int outputSize = m_frequencySpectrum->size;
+	for (int i = 0; i < outputSize; i++)
+	{
+		const StitchPoint & point = m_stitchTable[i];
+		const FrequencySpectrum * lowSpectrum = m_bands[point.lowBand].analyzer->getFrequencySpectrum();
+		int lowIndex = (int)point.lowPosition;
+		float lowT = point.lowPosition - (float)lowIndex;
+		float value = lowSpectrum->data[lowIndex];
+		if (lowIndex + 1 < lowSpectrum->size)
+			value += (lowSpectrum->data[lowIndex + 1] - value) * lowT;
+
+		if (point.highBand >= 0)
+		{
+			const FrequencySpectrum * highSpectrum = m_bands[point.highBand].analyzer->getFrequencySpectrum();
+			int highIndex = (int)point.highPosition;
+			float highT = point.highPosition - (float)highIndex;
+			float highValue = highSpectrum->data[highIndex];
+			if (highIndex + 1 < highSpectrum->size)
+				highValue += (highSpectrum->data[highIndex + 1] - highValue) * highT;
+			value += (highValue - value) * point.highWeight;
+		}
+		outputData[i] = value;
+	}
+}
+
+void MultiResolutionAnalyzer::analyzeBand(int bandIndex)
+{
+	// Each band analyzes the newest samples of the shared frame
+	SpectrumAnalyzer * analyzer = m_bands[bandIndex].analyzer;
+	int frameSize = analyzer->getFrameSize();
+	memcpy(analyzer->getFrameInputBuffer(), m_frameIn + (m_frameSize - frameSize), frameSize * sizeof(float));
+	analyzer->processFrame();
+	m_bands[bandIndex].framesProcessed++;
+}
+
+void MultiResolutionAnalyzer::setFrameSize(int frameSize)
+{
+	if (m_frameSize <= 0 || frameSize == m_frameSize)
+		return;
+
+	// Keep the frame size ratios between bands. Frames never go below 32 samples
+	for (Band & band : m_bands)
+	{
+		long long bandSize = (long long)band.analyzer->getFrameSize() * frameSize / m_frameSize;
+		band.analyzer->setFrameSize(bandSize > 32 ? (int)bandSize : 32);
+		band.hasFrame = false;
+	}
+	rebuild();
+}
+
+void MultiResolutionAnalyzer::rebuild()
+{
+	// The longest frame sets the input size and the output bin spacing
+	int frameSize = 0;
+	for (Band & band : m_bands)
+		if (band.analyzer->getFrameSize() > frameSize)
+			frameSize = band.analyzer->getFrameSize();
+	if (frameSize != m_frameSize)
+	{
+		m_frameSize = frameSize;
+		delete[] m_frameIn;
+		m_frameIn = new float[m_frameSize]();
+		m_frequencySpectrum->resize(m_frameSize / 2 + 1);
+	}
+
+	// For every output bin, find the band it belongs to and, near a crossover, the band it fades into
+	int numBands = (int)m_bands.size();
+	int outputSize = m_frequencySpectrum->size;
+	float crossfadeRatio = powf(2.0f, m_crossfadeOctaves * 0.5f);
+	m_stitchTable.resize(outputSize);
+	for (int i = 0; i < outputSize; i++)
+	{
+		float frequency = (float)i * (float)m_sampleRate / (float)m_frameSize;
+		int band = 0;
+		while (band < numBands - 1 && frequency > m_bands[band].maxFrequency)
+			band++;
+
+		// Crossfade with smoothstep over log frequency, centered on the crossover
+		StitchPoint & point = m_stitchTable[i];
+		point.lowBand = band;
+		point.highBand = -1;
+		point.highWeight = 0.0f;
+		if (band > 0 && frequency < m_bands[band - 1].maxFrequency * crossfadeRatio)
+		{
+			point.lowBand = band - 1;
+			point.highBand = band;
+		}
+		else if (band < numBands - 1 && frequency > m_bands[band].maxFrequency / crossfadeRatio)
+			point.highBand = band + 1;
+		if (point.highBand >= 0 && m_crossfadeOctaves > 0.0f && frequency > 0.0f)
+		{
+			float crossover = m_bands[point.lowBand].maxFrequency;
+			float t = log2f(frequency / crossover) / m_crossfadeOctaves + 0.5f;
+			t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+			point.highWeight = t * t * (3.0f - 2.0f * t);
+		}
+
+		// Output bin i sits at fractional bin (i * bandFrameSize / frameSize) of a band
+		point.lowPosition = (float)i * (float)m_bands[point.lowBand].analyzer->getFrameSize() / (float)m_frameSize;
+		point.highPosition = point.highBand >= 0 ? (float)i * (float)m_bands[point.highBand].analyzer->getFrameSize() / (float)m_frameSize : 0.0f;
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef MULTIRESOLUTIONANALYZER_H
+#define MULTIRESOLUTIONANALYZER_H
+
+/*
+* A bank of ffts with different frame sizes, each responsible for one frequency band.
+* Bass bands use long frames for frequency resolution, treble bands use short frames for time resolution,
+* and each band has its own hop, so the long frames can be recomputed less often than the short ones.
+* Due bands are analyzed, then stitched into one linear spectrum
+* with the bin spacing of the longest frame, crossfading between neighbouring bands at each crossover.
+*
+* Due bands only run in parallel on a ThreadPool when at least two of them have large ffts.
+* Waking the workers and waiting for them costs a few microseconds, which is more than a bank of small ffts saves:
+* spectrumBenchmark measures an 8192/2048/512 bank at about 13 us per hop serially and 14-16 us on 3 threads.
+*/
+
+#include <vector>
+
+#include "FrequencyAnalyzer.h"
+#include "SpectrumAnalyzer.h"
+#include "ThreadPool.h"
+
+class MultiResolutionAnalyzer : public FrequencyAnalyzer
+{
+public:
+	MultiResolutionAnalyzer(int sampleRate, ThreadPool * threadPool);
+	/*
+	* Constructor
+	* Pre:
+	*	sampleRate is the sample rate of the audio
+	*	threadPool runs the bands with large ffts in parallel, see setParallelFrameSize().
+	*	It may be nullptr, in which case the bands always run one after another.
+	*	Only this analyzer may call parallelFor() on it while processFrame() runs.
+	* Post:
+	*	The analyzer has no bands. Add them with addBand() before processing frames.
+	*/
+
+	~MultiResolutionAnalyzer();
+
+	void addBand(int frameSize, int frameGap, float maxFrequency);
+	/*
+	* Adds a band above the last one added. Add bands from the bass up.
+	* Pre:
+	*	frameSize is the fft size of the band, frameGap is the number of samples between its frames
+	*	The band covers the frequencies from the previous band's maxFrequency up to maxFrequency in Hz.
+	*	The last band always extends to the nyquist frequency.
+	*/
+
+	void setCrossfadeWidth(float octaves);
+	/*
+	* Width of the crossfade centered on each crossover frequency. Defaults to half an octave.
+	*/
+
+	void setParallelFrameSize(int frameSize) { m_parallelFrameSize = frameSize; }
+	/*
+	* The bands of a frame go to the thread pool only when at least two of the due bands have a frame size of at least frameSize.
+	* Otherwise they run one after another on the calling thread. Defaults to 16384. 0 always uses the pool.
+	*/
+
+	float * getFrameInputBuffer() { m_frameFromRing = false; return m_frameIn; }
+	void readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd);
+	/*
+	* Reads the frame for the longest band. Bands whose hop has not passed since their last frame keep their last spectrum.
+	* Frames filled through getFrameInputBuffer() instead always run every band.
+	*/
+
+	void processFrame();
+	FrequencySpectrum * getFrequencySpectrum() { return m_frequencySpectrum; }
+
+	int getFrameSize() { return m_frameSize; }
+	void setFrameSize(int frameSize);
+	/*
+	* Scales every band so the longest frame is frameSize samples. Frame size ratios and hops are kept.
+	*/
+
+	int getNumBands() { return (int)m_bands.size(); }
+	int getBandFramesProcessed(int band) { return m_bands[band].framesProcessed; }
+	/*
+	* Number of ffts a band has run, to compare the work done by each band
+	*/
+
+private:
+	struct Band
+	{
+		SpectrumAnalyzer * analyzer;
+		int frameGap;
+		float maxFrequency;
+		long long lastFrameEnd;
+		bool hasFrame;
+		int framesProcessed;
+	};
+
+	struct StitchPoint
+	{
+		int lowBand;		// band that covers this output bin
+		int highBand;		// band it crossfades into, or -1
+		float highWeight;	// weight of highBand
+		float lowPosition;	// fractional bin of this frequency in each band's spectrum
+		float highPosition;
+	};
+
+	void rebuild();
+	/*
+	* Resizes the input frame and output spectrum, and recomputes the stitch table
+	*/
+
+	void analyzeBand(int band);
+
+	int m_sampleRate;
+	ThreadPool * m_threadPool;
+	int m_parallelFrameSize;
+	std::vector<Band> m_bands;
+	float m_crossfadeOctaves;
+
+	int m_frameSize;
+	float * m_frameIn;
+	long long m_frameEnd;
+	bool m_frameFromRing;
+	std::vector<int> m_dueBands;
+
+	std::vector<StitchPoint> m_stitchTable;
+	FrequencySpectrum * m_frequencySpectrum;
+};
+
+#endif
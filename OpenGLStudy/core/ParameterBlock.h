@@ -0,0 +1,130 @@
+#ifndef PARAMETERBLOCK_H
+#define PARAMETERBLOCK_H
+
+/*
+* Two copies of a set of parameters, for handing parameter changes from one writer thread (the UI) to one reader thread (analysis).
+* The writer edits the inactive copy and publishes it, the reader swaps it in with update() at a point where it is safe,
+* for example at the start of a hop. Neither side blocks, and the reader never sees a half written copy.
+*
+* beginWrite() brings the inactive copy up to date with a plain assignment, so if T holds vectors with reserved capacity,
+* changing parameters of the same size never allocates.
+*/
+
+#include <atomic>
+
+template <class T>
+class ParameterBlock
+{
+public:
+	ParameterBlock();
+
+	template <class Function>
+	void initialize(Function function);
+	/*
+	* Calls function on both copies, for setting initial values and reserving capacity.
+	* Pre:
+	*	Neither thread is using the block yet
+	*/
+
+	T & beginWrite();
+	/*
+	* Writer only. Returns the inactive copy, holding the newest parameters. The reader will not swap it in until endWrite().
+	*/
+
+	void endWrite();
+	/*
+	* Writer only. Publishes the copy returned by beginWrite().
+	*/
+
+	const T & getLatest() const;
+	/*
+	* Writer only. The newest parameters, whether or not the reader has picked them up yet.
+	*/
+
+	bool update();
+	/*
+	* Reader only. Swaps in the newest published copy if there is one and the writer is not in the middle of a write.
+	* Returns true if the active copy changed.
+	*/
+
+	const T & getActive() const { return m_copies[m_activeIndex]; }
+	/*
+	* Reader only. The copy picked up by the last update() call.
+	*/
+
+private:
+	// ACTIVE_BIT is the index of the reader's copy. DIRTY_BIT is set when the other copy holds parameters the reader has not seen.
+	// WRITING_BIT is set between beginWrite() and endWrite(), and keeps the reader from swapping while it is set
+	static const int ACTIVE_BIT = 1;
+	static const int DIRTY_BIT = 2;
+	static const int WRITING_BIT = 4;
+
+	T m_copies[2];
+	std::atomic<int> m_state;
+	int m_writeState;
+	int m_activeIndex;
+
+	ParameterBlock(const ParameterBlock &) = delete;
+	ParameterBlock & operator=(const ParameterBlock &) = delete;
+};
+
+// TEMPLATE DEFINTIONS
+
+template <class T>
+ParameterBlock<T>::ParameterBlock() :
+	m_state(0),
+	m_writeState(0),
+	m_activeIndex(0)
+{
+}
+
+template <class T>
+template <class Function>
+void ParameterBlock<T>::initialize(Function function)
+{
+	function(m_copies[0]);
+	function(m_copies[1]);
+}
+
+template <class T>
+T & ParameterBlock<T>::beginWrite()
+{
+	// Once the writing bit is set the reader can not change the state, so it stays as read here until endWrite()
+	m_writeState = m_state.fetch_or(WRITING_BIT, std::memory_order_acquire);
+	int inactiveIndex = (m_writeState & ACTIVE_BIT) ^ 1;
+
+	// A copy that the reader already swapped out holds old parameters
+	if (!(m_writeState & DIRTY_BIT))
+		m_copies[inactiveIndex] = m_copies[inactiveIndex ^ 1];
+	return m_copies[inactiveIndex];
+}
+
+template <class T>
+void ParameterBlock<T>::endWrite()
+{
+	m_state.store((m_writeState | DIRTY_BIT) & ~WRITING_BIT, std::memory_order_release);
+}
+
+template <class T>
+const T & ParameterBlock<T>::getLatest() const
+{
+	int state = m_state.load(std::memory_order_acquire);
+	int activeIndex = state & ACTIVE_BIT;
+	return m_copies[(state & DIRTY_BIT) ? activeIndex ^ 1 : activeIndex];
+}
+
+template <class T>
+bool ParameterBlock<T>::update()
+{
+	int state = m_state.load(std::memory_order_relaxed);
+	if (!(state & DIRTY_BIT) || (state & WRITING_BIT))
+		return false;
+
+	// Fails if the writer started a new write since the load, in which case the swap waits for the next update()
+	if (!m_state.compare_exchange_strong(state, (state ^ ACTIVE_BIT) & ~DIRTY_BIT, std::memory_order_acq_rel))
+		return false;
+	m_activeIndex = (state ^ ACTIVE_BIT) & ACTIVE_BIT;
+	return true;
+}
+
+#endif
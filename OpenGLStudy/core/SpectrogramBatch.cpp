@@ -0,0 +1,131 @@
+#include "SpectrogramBatch.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "utilities.h"
+
+namespace
+{
+	// fseek only takes a long, which is 32 bits on Windows
+	int seek64(FILE * file, long long offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(file, offset, SEEK_SET);
+#else
+		return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+	}
+}
+
+SpectrogramBatch::SpectrogramBatch(int frameSize, int frameGap, FilterChainFactory filterChainFactory) :
+	m_frameSize(frameSize),
+	m_frameGap(frameGap < 1 ? 1 : frameGap),
+	m_filterChainFactory(filterChainFactory),
+	m_warmupFrames(0),
+	m_framesPerChunk(256),
+	m_halfPrecision(false),
+	m_numFrames(0),
+	m_numBins(0)
+{
+}
+
+bool SpectrogramBatch::process(FileAudioSource * source, const char * outputPath, ThreadPool * threadPool)
+{
+	// Frame i covers the samples [i * frameGap, i * frameGap + frameSize)
+	long long numSamples = source->getNumFrames();
+	m_numFrames = numSamples < m_frameSize ? 0 : (numSamples - m_frameSize) / m_frameGap + 1;
+
+	// The filters decide the number of output bins (the domain shift filter resamples the spectrum), so run the chain once on silence to find it
+	{
+		SpectrumAnalyzer analyzer(m_frameSize);
+		analyzer.processFrame();
+		const FrequencySpectrum * spectrum = analyzer.getFrequencySpectrum();
+		std::vector<SpectrumFilter *> filters = m_filterChainFactory ? m_filterChainFactory() : std::vector<SpectrumFilter *>();
+		for (SpectrumFilter * filter : filters)
+			spectrum = filter->applyFilter(spectrum);
+		m_numBins = spectrum->size;
+		for (SpectrumFilter * filter : filters)
+			delete filter;
+	}
+
+	FILE * file = fopen(outputPath, "wb");
+	if (file == nullptr)
+		return false;
+
+	int bytesPerValue = m_halfPrecision ? 2 : 4;
+	SpectrogramFileHeader header = {};
+	memcpy(header.magic, "SPGM", 4);
+	header.version = 1;
+	header.frameSize = m_frameSize;
+	header.frameGap = m_frameGap;
+	header.sampleRate = source->getSampleRate();
+	header.numBins = m_numBins;
+	header.bytesPerValue = bytesPerValue;
+	header.numFrames = m_numFrames;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	// Chunks finish out of order, so each one seeks to its own place in the file.
+	// Only the write is serialized, the analysis of each chunk runs in parallel
+	int framesPerChunk = m_framesPerChunk < 1 ? 1 : m_framesPerChunk;
+	int numChunks = (int)((m_numFrames + framesPerChunk - 1) / framesPerChunk);
+	long long frameBytes = (long long)m_numBins * bytesPerValue;
+	std::mutex fileMutex;
+	threadPool->parallelFor(numChunks, [&](int chunk)
+	{
+		long long firstFrame = (long long)chunk * framesPerChunk;
+		int numFrames = (int)(m_numFrames - firstFrame < framesPerChunk ? m_numFrames - firstFrame : framesPerChunk);
+		unsigned char * chunkBuffer = new unsigned char[numFrames * frameBytes];
+		processChunk(source, firstFrame, numFrames, chunkBuffer);
+
+		{
+			std::lock_guard<std::mutex> lock(fileMutex);
+			if (seek64(file, (long long)sizeof(header) + firstFrame * frameBytes) != 0 ||
+				fwrite(chunkBuffer, (size_t)frameBytes, numFrames, file) != (size_t)numFrames)
+				ok = false;
+		}
+		delete[] chunkBuffer;
+	});
+
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
+
+void SpectrogramBatch::processChunk(FileAudioSource * source, long long firstFrame, int numFrames, unsigned char * outBuffer)
+{
+	SpectrumAnalyzer analyzer(m_frameSize);
+	std::vector<SpectrumFilter *> filters = m_filterChainFactory ? m_filterChainFactory() : std::vector<SpectrumFilter *>();
+
+	// Frames before the start of the file do not exist, so the first chunk just has a shorter warm up.
+	// A sequential pass would start from the same empty filter state there, so the output still matches
+	long long warmupStart = firstFrame - m_warmupFrames;
+	if (warmupStart < 0)
+		warmupStart = 0;
+
+	for (long long frame = warmupStart; frame < firstFrame + numFrames; frame++)
+	{
+		source->readMono(frame * m_frameGap, m_frameSize, analyzer.getFrameInputBuffer());
+		analyzer.processFrame();
+		const FrequencySpectrum * spectrum = analyzer.getFrequencySpectrum();
+		for (SpectrumFilter * filter : filters)
+			spectrum = filter->applyFilter(spectrum);
+
+		if (frame < firstFrame)
+			continue;
+
+		unsigned char * out = outBuffer + (frame - firstFrame) * m_numBins * (m_halfPrecision ? 2 : 4);
+		if (m_halfPrecision)
+		{
+			unsigned short * values = (unsigned short *)out;
+			for (int i = 0; i < m_numBins; i++)
+				values[i] = utl::floatToHalf(spectrum->data[i]);
+		}
+		else
+			memcpy(out, spectrum->data, m_numBins * sizeof(float));
+	}
+
+	for (SpectrumFilter * filter : filters)
+		delete filter;
+}
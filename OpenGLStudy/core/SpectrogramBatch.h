@@ -0,0 +1,103 @@
+#ifndef SPECTROGRAMBATCH_H
+#define SPECTROGRAMBATCH_H
+
+/*
+* Headless analysis of a whole audio file into a spectrogram file.
+* The file is split into chunks of hop aligned frames that are processed in parallel on a ThreadPool,
+* each with its own SpectrumAnalyzer and filter chain.
+* Stateful filters like AverageFilter are handled by running each chunk over a few warm up frames
+* before its first frame, and throwing the warm up output away.
+*
+* Output file layout: a SpectrogramFileHeader, followed by numFrames frames of numBins values each.
+* Values are float32 or float16 (IEEE half) depending on bytesPerValue. All fields are little endian.
+*/
+
+#include <vector>
+#include <functional>
+
+#include "AudioSource.h"
+#include "SpectrumAnalyzer.h"
+#include "SpectrumFilter.h"
+#include "ThreadPool.h"
+
+struct SpectrogramFileHeader
+{
+	char magic[4];					// "SPGM"
+	unsigned int version;			// 1
+	unsigned int frameSize;			// samples per fourier transform
+	unsigned int frameGap;			// samples between the start of each frame
+	unsigned int sampleRate;		// samples per second of the source audio
+	unsigned int numBins;			// values per frame
+	unsigned int bytesPerValue;		// 2 for float16, 4 for float32
+	unsigned int reserved;
+	unsigned long long numFrames;	// number of frames in the file
+};
+
+class SpectrogramBatch
+{
+public:
+	typedef std::function<std::vector<SpectrumFilter *>()> FilterChainFactory;
+	/*
+	* Returns a newly allocated filter chain in the order the filters are applied.
+	* It is called once per chunk, possibly from several threads at once. The batch deletes the filters when the chunk is done.
+	*/
+
+	SpectrogramBatch(int frameSize, int frameGap, FilterChainFactory filterChainFactory);
+	/*
+	* Constructor
+	* Pre:
+	*	frameSize is the number of samples in each fourier transform
+	*	frameGap is the number of samples between the start of each frame (the hop size)
+	*	filterChainFactory creates the filter chain. It may be empty, in which case the raw analyzer output is written.
+	*/
+
+	void setWarmupFrames(int warmupFrames) { m_warmupFrames = warmupFrames; }
+	/*
+	* Number of frames processed and discarded before the first frame of every chunk.
+	* Set this to the history length of the filter chain, for example (numSpectrumsInAverage - 1) for an AverageFilter,
+	* so every chunk produces the same output as one sequential pass would (up to float rounding). Defaults to 0.
+	*/
+
+	void setFramesPerChunk(int framesPerChunk) { m_framesPerChunk = framesPerChunk; }
+	/*
+	* Number of output frames per chunk. Defaults to 256.
+	* Larger chunks spend less time on warm up frames, smaller chunks balance better across threads.
+	*/
+
+	void setHalfPrecision(bool halfPrecision) { m_halfPrecision = halfPrecision; }
+	/*
+	* Write float16 values instead of float32. Defaults to false.
+	*/
+
+	bool process(FileAudioSource * source, const char * outputPath, ThreadPool * threadPool);
+	/*
+	* Analyzes the whole file and writes the spectrogram.
+	* Pre:
+	*	source has been opened
+	* Post:
+	*	outputPath contains the spectrogram. Frame i covers the samples [i * frameGap, i * frameGap + frameSize).
+	*	returns false if the output file could not be written
+	*/
+
+	long long getNumFrames() { return m_numFrames; }
+	int getNumBins() { return m_numBins; }
+
+private:
+	void processChunk(FileAudioSource * source, long long firstFrame, int numFrames, unsigned char * outBuffer);
+	/*
+	* Runs the analyzer and a fresh filter chain over frames [firstFrame - warmup, firstFrame + numFrames),
+	* writing the output of the last numFrames frames to outBuffer
+	*/
+
+	int m_frameSize;
+	int m_frameGap;
+	FilterChainFactory m_filterChainFactory;
+	int m_warmupFrames;
+	int m_framesPerChunk;
+	bool m_halfPrecision;
+
+	long long m_numFrames;
+	int m_numBins;
+};
+
+#endif
@@ -1,36 +1,152 @@
 #include "SpectrumAnalyzer.h"
+#include "SpectrumKernels.h"
 
-SpectrumAnalyzer::SpectrumAnalyzer(int frameSize) 
+#include <algorithm>
+#include <cmath>
+
+SpectrumAnalyzer::SpectrumAnalyzer(int frameSize) :
+	m_outputMode(OUTPUT_MAGNITUDE),
+	m_decibelFloor(-120.0f),
+	m_analysisMode(FULL_FFT),
+	m_requestedFirstBin(0),
+	m_requestedNumBins(-1),
+	m_firstBin(0),
+	m_numBins(0),
+	m_binReal(nullptr),
+	m_binImag(nullptr),
+	m_rotationReal(nullptr),
+	m_rotationImag(nullptr),
+	m_binCapacity(0),
+	m_resyncInterval(64),
+	m_framesSinceResync(0),
+	m_slidingFrameEnd(0),
+	m_slidingValid(false),
+	m_frameFromRing(false),
+	m_frameSlid(false)
 {
 	m_fftInSize = frameSize;
 	m_fftOutSize = frameSize / 2 + 1;
 
 	// Initialize fft buffers
 	m_fftIn = new float[m_fftInSize]();
-	m_fftOut = new float[m_fftOutSize * 2]();
-	m_fftConfig = kiss_fftr_alloc(m_fftInSize, 0, NULL, NULL);
+	m_fftInCapacity = m_fftInSize;
+	m_fftPlan = FFTPlanCache::getInstance().getRealPlan(m_fftInSize);
 
 	// Iniitalize frequency spectrum
 	m_frequencySpectrum = new FrequencySpectrum(m_fftOutSize);
+
+	updateTrackedBins();
 }
 
 SpectrumAnalyzer::~SpectrumAnalyzer()
 {
 	delete[] m_fftIn;
-	delete[] m_fftOut;
-	free(m_fftConfig);
 	delete m_frequencySpectrum;
+	delete[] m_binReal;
+	delete[] m_binImag;
+	delete[] m_rotationReal;
+	delete[] m_rotationImag;
+}
+
+void SpectrumAnalyzer::readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd)
+{
+	// In sliding mode, step the tracked bins forward if the last frame is close enough behind and its samples are still in the ring
+	if (m_analysisMode == SLIDING_DFT)
+	{
+		long long hop = frameEnd - m_slidingFrameEnd;
+		bool canSlide = m_slidingValid && hop > 0 && hop <= m_fftInSize &&
+			m_framesSinceResync < m_resyncInterval && ringBuffer->isValidRange(frameEnd, m_fftInSize + (int)hop);
+		m_slidingFrameEnd = frameEnd;
+		if (canSlide)
+		{
+			slideFrame(ringBuffer, frameEnd, (int)hop);
+			m_framesSinceResync++;
+			m_frameSlid = true;
+			return;
+		}
+	}
+	m_frameSlid = false;
+	m_frameFromRing = true;
+
+	// Copy the frame that ends at sample index frameEnd into the fft input.
+	// This is at most two contiguous spans of the ring buffer
+	ringBuffer->read(frameEnd, m_fftInSize, m_fftIn);
 }
 
 void SpectrumAnalyzer::processFrame()
 {
-	// Do the fft (real in, complex out) then get the magnitude of the complex output.
-	kiss_fftr(m_fftConfig, (kiss_fft_scalar *)m_fftIn, (kiss_fft_cpx *)m_fftOut);
-	for (int i = 0; i < m_fftOutSize; i++)
+	// Frames that were slid only need the magnitude of the tracked bins
+	if (m_frameSlid)
 	{
-		float rl = m_fftOut[i * 2];
-		float im = m_fftOut[i * 2 + 1];
-		m_frequencySpectrum->data[i] = sqrt(rl * rl + im * im) / (float)m_fftOutSize;
+		m_frameSlid = false;
+		float * data = m_frequencySpectrum->data;
+		for (int i = 0; i < m_numBins; i++)
+		{
+			double rl = m_binReal[i];
+			double im = m_binImag[i];
+			double magnitude = sqrt(rl * rl + im * im) / (double)m_fftOutSize;
+			if (m_outputMode == OUTPUT_POWER)
+				data[m_firstBin + i] = (float)(magnitude * magnitude);
+			else if (m_outputMode == OUTPUT_DECIBELS)
+				data[m_firstBin + i] = fmaxf((float)(20.0 * log10(magnitude)), m_decibelFloor);
+			else
+				data[m_firstBin + i] = (float)magnitude;
+		}
+		return;
+	}
+
+	// Do the fft (real in, complex out) then get the magnitude, power or decibels of the complex output.
+	// The complex output only lives until the end of this call, so it goes in this thread's scratch buffer
+	float * fftOut = FFTPlanCache::getThreadScratch(m_fftOutSize * 2);
+	FFTPlanCache::realForward(m_fftPlan, m_fftIn, (kiss_fft_cpx *)fftOut);
+	float scale = 1.0f / (float)m_fftOutSize;
+	if (m_outputMode == OUTPUT_POWER)
+		simd::complexPower(fftOut, m_frequencySpectrum->data, m_fftOutSize, scale);
+	else if (m_outputMode == OUTPUT_DECIBELS)
+		simd::complexDecibels(fftOut, m_frequencySpectrum->data, m_fftOutSize, scale, m_decibelFloor);
+	else
+		simd::complexMagnitude(fftOut, m_frequencySpectrum->data, m_fftOutSize, scale);
+
+	// A full fft of a frame from the ring buffer resynchronizes the sliding bins.
+	// Untracked bins are cleared so slid frames and resync frames look the same
+	if (m_analysisMode == SLIDING_DFT)
+	{
+		m_slidingValid = m_frameFromRing;
+		m_framesSinceResync = 0;
+		for (int i = 0; i < m_numBins; i++)
+		{
+			m_binReal[i] = fftOut[(m_firstBin + i) * 2];
+			m_binImag[i] = fftOut[(m_firstBin + i) * 2 + 1];
+		}
+		float silence = m_outputMode == OUTPUT_DECIBELS ? m_decibelFloor : 0.0f;
+		for (int i = 0; i < m_firstBin; i++)
+			m_frequencySpectrum->data[i] = silence;
+		for (int i = m_firstBin + m_numBins; i < m_fftOutSize; i++)
+			m_frequencySpectrum->data[i] = silence;
+	}
+	m_frameFromRing = false;
+}
+
+void SpectrumAnalyzer::slideFrame(const AudioRingBuffer * ringBuffer, long long frameEnd, int hop)
+{
+	// Moving the window one sample forward removes the oldest sample and adds the newest:
+	//	X[k] = (X[k] - oldest + newest) * e^(2 pi i k / N)
+	// The inner loop runs over bins with the same sample difference, so it vectorizes
+	double * binReal = m_binReal;
+	double * binImag = m_binImag;
+	const double * rotationReal = m_rotationReal;
+	const double * rotationImag = m_rotationImag;
+	int numBins = m_numBins;
+	for (long long n = frameEnd - hop; n < frameEnd; n++)
+	{
+		double delta = (double)ringBuffer->getSample(n) - (double)ringBuffer->getSample(n - m_fftInSize);
+		for (int i = 0; i < numBins; i++)
+		{
+			double rl = binReal[i] + delta;
+			double im = binImag[i];
+			binReal[i] = rl * rotationReal[i] - im * rotationImag[i];
+			binImag[i] = rl * rotationImag[i] + im * rotationReal[i];
+		}
 	}
 }
 
@@ -39,17 +155,71 @@ void SpectrumAnalyzer::setFrameSize(int frameSize)
 	// Calculate new sizes
 	m_fftInSize = frameSize;
 	m_fftOutSize = frameSize / 2 + 1;
-	
-	// Delete old buffers
-	delete[] m_fftIn;
-	delete[] m_fftOut;
-	free(m_fftConfig);
-	delete m_frequencySpectrum;
 
-	// initialize new buffers
-	m_fftIn = new float[m_fftInSize]();
-	m_fftOut = new float[m_fftOutSize * 2]();
-	m_fftConfig = kiss_fftr_alloc(m_fftInSize, 0, NULL, NULL);
-	m_frequencySpectrum = new FrequencySpectrum(m_fftOutSize);
+	// Grow the input buffer only past the largest size so far
+	if (m_fftInSize > m_fftInCapacity)
+	{
+		delete[] m_fftIn;
+		m_fftIn = new float[m_fftInSize];
+		m_fftInCapacity = m_fftInSize;
+	}
+	std::fill(m_fftIn, m_fftIn + m_fftInSize, 0.0f);
+
+	// Going back to a size that was used before finds its plan in the cache.
+	// The spectrum keeps its storage, so the filters see the same object, and shrinking never allocates
+	m_fftPlan = FFTPlanCache::getInstance().getRealPlan(m_fftInSize);
+	m_frequencySpectrum->resize(m_fftOutSize);
+
+	updateTrackedBins();
 }
 
+void SpectrumAnalyzer::setAnalysisMode(AnalysisMode analysisMode)
+{
+	m_analysisMode = analysisMode;
+	m_slidingValid = false;
+}
+
+void SpectrumAnalyzer::setTrackedBins(int firstBin, int numBins)
+{
+	m_requestedFirstBin = firstBin;
+	m_requestedNumBins = numBins;
+	updateTrackedBins();
+}
+
+void SpectrumAnalyzer::setResyncInterval(int resyncInterval)
+{
+	m_resyncInterval = resyncInterval > 0 ? resyncInterval : 1;
+}
+
+void SpectrumAnalyzer::updateTrackedBins()
+{
+	// Clamp the requested range to the bins that exist at this frame size
+	m_firstBin = m_requestedFirstBin < 0 ? 0 : (m_requestedFirstBin < m_fftOutSize ? m_requestedFirstBin : m_fftOutSize);
+	int maxBins = m_fftOutSize - m_firstBin;
+	m_numBins = (m_requestedNumBins < 0 || m_requestedNumBins > maxBins) ? maxBins : m_requestedNumBins;
+
+	// Like the input buffer, the bin arrays only grow
+	if (m_numBins > m_binCapacity)
+	{
+		delete[] m_binReal;
+		delete[] m_binImag;
+		delete[] m_rotationReal;
+		delete[] m_rotationImag;
+		m_binReal = new double[m_numBins];
+		m_binImag = new double[m_numBins];
+		m_rotationReal = new double[m_numBins];
+		m_rotationImag = new double[m_numBins];
+		m_binCapacity = m_numBins;
+	}
+	std::fill(m_binReal, m_binReal + m_numBins, 0.0);
+	std::fill(m_binImag, m_binImag + m_numBins, 0.0);
+
+	const double pi = 3.14159265358979323846;
+	for (int i = 0; i < m_numBins; i++)
+	{
+		double angle = 2.0 * pi * (double)(m_firstBin + i) / (double)m_fftInSize;
+		m_rotationReal[i] = cos(angle);
+		m_rotationImag[i] = sin(angle);
+	}
+	m_slidingValid = false;
+}
@@ -1,32 +1,106 @@
 #ifndef SPECTRUMANALYZER_H
 #define SPECTRUMANALYZER_H
 
-#include "FrequencySpectrum.h"
-#include "kissfft/kiss_fft.h"
-#include "kissfft/kiss_fftr.h"
+#include "FrequencyAnalyzer.h"
+#include "FFTPlanCache.h"
 
-class SpectrumAnalyzer
+class SpectrumAnalyzer : public FrequencyAnalyzer
 {
 public:
+	enum AnalysisMode
+	{
+		FULL_FFT,		// Every frame is a full real fft
+		SLIDING_DFT		// Frames read with readFrame() update the tracked bins sample by sample, with a full fft every few frames to bound drift
+	};
+
+	enum OutputMode
+	{
+		OUTPUT_MAGNITUDE,	// |X[k]| / (N / 2 + 1), the default
+		OUTPUT_POWER,		// the square of the magnitude output, for filters that work on power
+		OUTPUT_DECIBELS		// 20 * log10 of the magnitude output, clamped to the decibel floor
+	};
+
 	SpectrumAnalyzer(int frameSize);
 	~SpectrumAnalyzer();
 
-	float * getFrameInputBuffer() { return m_fftIn; };
+	float * getFrameInputBuffer() { m_frameFromRing = false; return m_fftIn; };
+	void readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd);
+	/*
+	* Reads the frame that ends at sample index frameEnd.
+	* In SLIDING_DFT mode, when the previous frame was also read from ringBuffer and is less than a frame behind,
+	* only the samples that entered and left the window are read, and the tracked bins are updated from them.
+	*/
+
 	void processFrame();
 	FrequencySpectrum * getFrequencySpectrum() { return m_frequencySpectrum; }
 
 	int getFrameSize() { return m_fftInSize; }
 	void setFrameSize(int frameSize);
 
+	AnalysisMode getAnalysisMode() { return m_analysisMode; }
+	void setAnalysisMode(AnalysisMode analysisMode);
+
+	void setTrackedBins(int firstBin, int numBins);
+	/*
+	* SLIDING_DFT mode only. Limits the incremental update to the bins [firstBin, firstBin + numBins).
+	* Bins outside the range are zero in frames that were updated incrementally. numBins < 0 tracks every bin (the default).
+	* An incremental frame costs (hop size * tracked bins) rotations, against roughly (frame size * log2(frame size)) for a full fft,
+	* so larger hops only pay off when few bins are tracked.
+	*/
+
+	void setResyncInterval(int resyncInterval);
+	/*
+	* SLIDING_DFT mode only. The number of incremental frames between full ffts. Defaults to 64.
+	*/
+
+	OutputMode getOutputMode() { return m_outputMode; }
+	void setOutputMode(OutputMode outputMode) { m_outputMode = outputMode; }
+	void setDecibelFloor(float decibelFloor) { m_decibelFloor = decibelFloor; }
+	/*
+	* What processFrame() writes to the frequency spectrum. The conversion is fused with the normalization
+	* in the SIMD kernels of SpectrumKernels.h. The decibel floor defaults to -120 dB.
+	*/
+
 private:
+	void slideFrame(const AudioRingBuffer * ringBuffer, long long frameEnd, int hop);
+	/*
+	* Advances the tracked bins by hop samples, so they hold the dft of the frame that ends at frameEnd
+	*/
+
+	void updateTrackedBins();
+	/*
+	* Clamps the tracked bin range to the frame size and recomputes the per bin rotations. Invalidates the sliding state.
+	*/
+
 	int m_fftInSize;
 	int m_fftOutSize;
 
+	// The buffers only grow, to the largest frame size used so far, so switching back and forth between sizes never allocates
 	float * m_fftIn;
-	float * m_fftOut;
-	kiss_fftr_cfg m_fftConfig;
+	int m_fftInCapacity;
+	const FFTPlan * m_fftPlan;	// shared with every other analyzer of the same frame size
 
 	FrequencySpectrum * m_frequencySpectrum;
+	OutputMode m_outputMode;
+	float m_decibelFloor;
+
+	// Sliding dft state. The bins are kept in double precision so thousands of rotations between resyncs drift very little
+	AnalysisMode m_analysisMode;
+	int m_requestedFirstBin;
+	int m_requestedNumBins;
+	int m_firstBin;
+	int m_numBins;
+	double * m_binReal;
+	double * m_binImag;
+	double * m_rotationReal;
+	double * m_rotationImag;
+	int m_binCapacity;
+	int m_resyncInterval;
+	int m_framesSinceResync;
+	long long m_slidingFrameEnd;
+	bool m_slidingValid;
+	bool m_frameFromRing;
+	bool m_frameSlid;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,127 @@
+#include "SpectrumBandIndex.h"
+#include "SpectrumKernels.h"
+#include "utilities.h"
+
+#include <cstring>
+
+namespace
+{
+	int floorLog2(int value)
+	{
+		int level = 0;
+		while ((2 << level) <= value)
+			level++;
+		return level;
+	}
+}
+
+SpectrumBandIndex::SpectrumBandIndex(bool extremes) :
+	m_extremes(extremes),
+	m_size(0),
+	m_numLevels(0),
+	m_stride(0)
+{
+	m_prefixSum.push_back(0.0);
+}
+
+void SpectrumBandIndex::setExtremes(bool extremes)
+{
+	m_extremes = extremes;
+}
+
+void SpectrumBandIndex::build(const FrequencySpectrum * frequencySpectrum)
+{
+	m_size = frequencySpectrum->size;
+	const float * data = frequencySpectrum->data;
+
+	// resize() keeps the capacity, so a spectrum no larger than an earlier one reuses the storage
+	m_prefixSum.resize(m_size + 1);
+	double sum = 0.0;
+	for (int i = 0; i < m_size; i++)
+	{
+		sum += data[i];
+		m_prefixSum[i + 1] = sum;
+	}
+
+	m_numLevels = 0;
+	if (!m_extremes || m_size == 0)
+		return;
+
+	// Row k is built from two overlapping spans of row k - 1, and only has entries where a whole span of 2^k bins fits
+	m_numLevels = floorLog2(m_size) + 1;
+	m_stride = m_size;
+	m_maxTable.resize((size_t)m_numLevels * m_stride);
+	m_minTable.resize((size_t)m_numLevels * m_stride);
+	memcpy(m_maxTable.data(), data, m_size * sizeof(float));
+	memcpy(m_minTable.data(), data, m_size * sizeof(float));
+	for (int level = 1; level < m_numLevels; level++)
+	{
+		int halfSpan = 1 << (level - 1);
+		int count = m_size - (1 << level) + 1;
+		const float * lastMax = m_maxTable.data() + (size_t)(level - 1) * m_stride;
+		const float * lastMin = m_minTable.data() + (size_t)(level - 1) * m_stride;
+		simd::maximum(lastMax, lastMax + halfSpan, m_maxTable.data() + (size_t)level * m_stride, count);
+		simd::minimum(lastMin, lastMin + halfSpan, m_minTable.data() + (size_t)level * m_stride, count);
+	}
+}
+
+void SpectrumBandIndex::clampRange(int * begin, int * end) const
+{
+	*begin = utl::clamp(*begin, 0, m_size - 1);
+	*end = utl::clamp(*end, *begin + 1, m_size);
+}
+
+float SpectrumBandIndex::getSum(int begin, int end) const
+{
+	clampRange(&begin, &end);
+	return (float)(m_prefixSum[end] - m_prefixSum[begin]);
+}
+
+float SpectrumBandIndex::getMean(int begin, int end) const
+{
+	clampRange(&begin, &end);
+	return (float)((m_prefixSum[end] - m_prefixSum[begin]) / (double)(end - begin));
+}
+
+float SpectrumBandIndex::getMax(int begin, int end) const
+{
+	clampRange(&begin, &end);
+	int level = floorLog2(end - begin);
+	const float * row = m_maxTable.data() + (size_t)level * m_stride;
+	return utl::max(row[begin], row[end - (1 << level)]);
+}
+
+float SpectrumBandIndex::getMin(int begin, int end) const
+{
+	clampRange(&begin, &end);
+	int level = floorLog2(end - begin);
+	const float * row = m_minTable.data() + (size_t)level * m_stride;
+	return utl::min(row[begin], row[end - (1 << level)]);
+}
+
+void SpectrumBandIndex::getBinRange(float start, float end, int * beginBin, int * endBin) const
+{
+	*beginBin = (int)(utl::clamp(start, 0.0f, 1.0f) * (float)m_size);
+	*endBin = (int)ceilf(utl::clamp(end, 0.0f, 1.0f) * (float)m_size);
+	clampRange(beginBin, endBin);
+}
+
+void SpectrumBandIndex::getSums(const int * begins, const int * ends, float * outData, int count) const
+{
+	simd::rangeSums(m_prefixSum.data(), begins, ends, outData, count, false);
+}
+
+void SpectrumBandIndex::getMeans(const int * begins, const int * ends, float * outData, int count) const
+{
+	simd::rangeSums(m_prefixSum.data(), begins, ends, outData, count, true);
+}
+
+void SpectrumBandIndex::getMaxes(const int * begins, const int * ends, float * outData, int count) const
+{
+	simd::rangeExtremes(m_maxTable.data(), m_stride, begins, ends, outData, count, true);
+}
+
+void SpectrumBandIndex::getMins(const int * begins, const int * ends, float * outData, int count) const
+{
+	simd::rangeExtremes(m_minTable.data(), m_stride, begins, ends, outData, count, false);
+}
@@ -0,0 +1,79 @@
+#ifndef SPECTRUMBANDINDEX_H
+#define SPECTRUMBANDINDEX_H
+
+/*
+* Answers sum, mean, maximum and minimum queries over any range of bins of one spectrum in constant time.
+* Build it once per published spectrum, then query as many bands as needed, for example one per object in a scene.
+*
+* Sums come from a prefix sum kept in doubles, so the difference of two large prefixes does not lose the small range between them.
+* Maximum and minimum come from optional sparse tables: row k holds the extreme of the 2^k bins starting at each bin,
+* and any range is covered by two overlapping spans of one row. The tables take log2(size) + 1 rows each to build.
+*/
+
+#include <vector>
+
+#include "FrequencySpectrum.h"
+
+class SpectrumBandIndex
+{
+public:
+	SpectrumBandIndex(bool extremes = false);
+
+	void setExtremes(bool extremes);
+	bool getExtremes() const { return m_extremes; }
+	/*
+	* Whether build() also builds the maximum and minimum tables. Takes effect at the next build().
+	*/
+
+	void build(const FrequencySpectrum * frequencySpectrum);
+	/*
+	* Indexes the bins of frequencySpectrum (its first channel) as they are now. Later changes to the spectrum are not seen.
+	* Only allocates when the spectrum is larger than any spectrum indexed before.
+	*/
+
+	int getSize() const { return m_size; }
+
+	float getSum(int begin, int end) const;
+	float getMean(int begin, int end) const;
+	float getMax(int begin, int end) const;
+	float getMin(int begin, int end) const;
+	/*
+	* Queries bins [begin, end). The range is clamped to the spectrum and widened to at least one bin,
+	* so a band narrower than a bin reads the bin it falls in.
+	* Pre:
+	*	getSize() > 0. getMax() and getMin() need the extreme tables.
+	*/
+
+	void getBinRange(float start, float end, int * beginBin, int * endBin) const;
+	/*
+	* Converts a band given as positions on [0, 1] across the spectrum to a range of bins for the queries.
+	* For a spectrum straight from the fft, a position is a frequency divided by the nyquist frequency.
+	*/
+
+	void getSums(const int * begins, const int * ends, float * outData, int count) const;
+	void getMeans(const int * begins, const int * ends, float * outData, int count) const;
+	void getMaxes(const int * begins, const int * ends, float * outData, int count) const;
+	void getMins(const int * begins, const int * ends, float * outData, int count) const;
+	/*
+	* Batch queries for many bands at once, run by the SIMD kernels. The ranges are not clamped.
+	* Pre:
+	*	0 <= begins[i] < ends[i] <= getSize() for every i < count. getMaxes() and getMins() need the extreme tables.
+	*/
+
+private:
+	void clampRange(int * begin, int * end) const;
+
+	bool m_extremes;
+	int m_size;
+
+	// m_prefixSum[i] is the sum of the first i bins, so it has m_size + 1 entries
+	std::vector<double> m_prefixSum;
+
+	// Sparse tables, one row of m_stride floats per power of two up to m_size
+	int m_numLevels;
+	int m_stride;
+	std::vector<float> m_maxTable;
+	std::vector<float> m_minTable;
+};
+
+#endif
@@ -1,4 +1,39 @@
 #include "SpectrumFilter.h"
+#include "SpectrumKernels.h"
+
+#include <cmath>
+
+namespace
+{
+	// Frames between full re-sums of the AverageFilter running sum
+	const int RESUM_INTERVAL = 1024;
+
+	// The coefficient that moves as far in one step as coefficient does in numHops steps
+	float coalescedCoefficient(float coefficient, int numHops)
+	{
+		if (numHops == 1)
+			return coefficient;
+		return 1.0f - powf(1.0f - coefficient, (float)numHops);
+	}
+
+	// Copies a curve into a parameter block curve, which only allocates when it is longer than the capacity reserved so far
+	void assignCurve(std::vector<float> & curve, const float * values, int size)
+	{
+		if (values)
+			curve.assign(values, values + size);
+		else
+			curve.assign(size, 0.0f);
+	}
+
+	void assignPeakCurve(PeakFilter::Parameters & parameters, const float * values, int size)
+	{
+		assignCurve(parameters.curve, values, size);
+		parameters.falloff.resize(size + 1);
+		for (int i = 0; i < size; i++)
+			parameters.falloff[i] = utl::clamp(parameters.curve[size - 1 - i], 0.0f, 1.0f);
+		parameters.falloff[size] = 0.0f;
+	}
+}
 
 SpectrumFilter::SpectrumFilter() :
 	m_outputSpectrum(new FrequencySpectrum(0))
@@ -10,142 +45,173 @@ const FrequencySpectrum * SpectrumFilter::getFrequencySpectrum()
 	return m_outputSpectrum;
 }
 
-SpectrumFilter::~SpectrumFilter()
+const FrequencySpectrum * SpectrumFilter::applyCoalesced(const FrequencySpectrum * inputSpectrum, int numCoalescedHops)
 {
-	delete m_outputSpectrum;
+	const FrequencySpectrum * outputSpectrum = applyFilter(inputSpectrum);
+	if (needsEveryHop())
+	{
+		for (int hop = 0; hop < numCoalescedHops; hop++)
+			outputSpectrum = applyFilter(inputSpectrum);
+	}
+	return outputSpectrum;
 }
 
-AmplitudeFilter::AmplitudeFilter(int amplitudeCurveSize) :
-	SpectrumFilter(),
-	m_amplitudeCurve(new float[amplitudeCurveSize]),
-	m_amplitudeCurveSize(amplitudeCurveSize)
+SpectrumFilter::~SpectrumFilter()
 {
+	delete m_outputSpectrum;
 }
 
-AmplitudeFilter::AmplitudeFilter(float * amplitudeCurve, int amplitudeCurveSize) :
-	SpectrumFilter(),
-	m_amplitudeCurve(new float[amplitudeCurveSize]()),
-	m_amplitudeCurveSize(amplitudeCurveSize)
+AmplitudeFilter::AmplitudeFilter(int amplitudeCurveSize) :
+	AmplitudeFilter(nullptr, amplitudeCurveSize)
 {
-	memcpy(m_amplitudeCurve, amplitudeCurve, amplitudeCurveSize * sizeof(float));
 }
 
-AmplitudeFilter::~AmplitudeFilter()
+AmplitudeFilter::AmplitudeFilter(const float * amplitudeCurve, int amplitudeCurveSize, int amplitudeCurveCapacity) :
+	SpectrumFilter()
 {
-	delete[] m_amplitudeCurve;
-	//delete m_outputSpectrum;
+	m_parameters.initialize([&](Parameters & parameters)
+	{
+		parameters.curve.reserve(utl::max(amplitudeCurveSize, amplitudeCurveCapacity));
+		assignCurve(parameters.curve, amplitudeCurve, amplitudeCurveSize);
+	});
 }
 
 const FrequencySpectrum * AmplitudeFilter::applyFilter(const FrequencySpectrum * inputSpectrum)
 {
+	updateParameters();
 	if (m_outputSpectrum->size != inputSpectrum->size)
 		m_outputSpectrum->resize(inputSpectrum->size);
 
-	float * inputData = inputSpectrum->data;
-	float * outputData = m_outputSpectrum->data;
-	for (int i = 0; i < inputSpectrum->size; i++)
-		outputData[i] = utl::getValue(m_amplitudeCurve, m_amplitudeCurveSize, utl::min(inputData[i], 1.0f));
+	const std::vector<float> & curve = m_parameters.getActive().curve;
+	simd::curveLookup(curve.data(), (int)curve.size(), inputSpectrum->data, m_outputSpectrum->data, inputSpectrum->size);
 
 	return m_outputSpectrum;
 }
 
 void AmplitudeFilter::setAmplitudeCurveSize(int amplitudeCurveSize)
 {
-	m_amplitudeCurveSize = amplitudeCurveSize;
-	delete[] m_amplitudeCurve;
-	m_amplitudeCurve = new float[m_amplitudeCurveSize]();
+	assignCurve(m_parameters.beginWrite().curve, nullptr, amplitudeCurveSize);
+	m_parameters.endWrite();
 }
 
-void AmplitudeFilter::setAmplitudeCurve(float * amplitudeCurve, int amplitudeCurveSize)
+void AmplitudeFilter::setAmplitudeCurve(const float * amplitudeCurve, int amplitudeCurveSize)
 {
-	m_amplitudeCurveSize = amplitudeCurveSize;
-	m_amplitudeCurve = new float[m_amplitudeCurveSize]();
-	memcpy(m_amplitudeCurve, amplitudeCurve, m_amplitudeCurveSize * sizeof(float));
-	
+	assignCurve(m_parameters.beginWrite().curve, amplitudeCurve, amplitudeCurveSize);
+	m_parameters.endWrite();
 }
 
 int AmplitudeFilter::getAmplitudeCurveSize()
 {
-	return m_amplitudeCurveSize;
+	return (int)m_parameters.getLatest().curve.size();
 }
 
-float * AmplitudeFilter::getAmplitudeCurve()
+const float * AmplitudeFilter::getAmplitudeCurve()
 {
-	return m_amplitudeCurve;
+	return m_parameters.getLatest().curve.data();
 }
 
 DomainShiftFilter::DomainShiftFilter(float domainShiftFactor, int numFrequencyBins) :
-	SpectrumFilter(),
-	m_domainShiftFactor(domainShiftFactor)
+	SpectrumFilter()
 {
+	m_parameters.initialize([&](Parameters & parameters)
+	{
+		parameters.domainShiftFactor = domainShiftFactor;
+		parameters.numFrequencyBins = numFrequencyBins;
+		parameters.areaAveraging = false;
+	});
 	m_outputSpectrum->resize(numFrequencyBins);
 }
 
-DomainShiftFilter::~DomainShiftFilter()
+void DomainShiftFilter::updateParameters()
 {
-	//delete m_outputSpectrum;
+	// The output spectrum is resized rather than replaced, so pointers to it stay valid
+	if (m_parameters.update() && m_outputSpectrum->size != m_parameters.getActive().numFrequencyBins)
+		m_outputSpectrum->resize(m_parameters.getActive().numFrequencyBins);
 }
 
 const FrequencySpectrum * DomainShiftFilter::applyFilter(const FrequencySpectrum * inputSpectrum)
 {
-	// Resize and domain shift the frequency data
-	float * inputData = inputSpectrum->data;
-	float * outputData = m_outputSpectrum->data;
-	int numFrequencyBins = m_outputSpectrum->size;
-	for (int i = 0; i < numFrequencyBins; i++)
-	{
-		float t = (float)i / (float)(numFrequencyBins - 1);
-		t = 1.0f - pow(1.0f - t, 1.0f / m_domainShiftFactor);
-		outputData[i] = utl::getValueLerp(inputData, inputSpectrum->size, t);
-	}
+	// Resize and domain shift the frequency data.
+	// The positions only depend on the factor and the sizes, so they come from a table that is rebuilt when those change
+	updateParameters();
+	getTable(inputSpectrum->size)->apply(inputSpectrum->data, m_outputSpectrum->data);
 	return m_outputSpectrum;
 }
 
+const DomainShiftTable * DomainShiftFilter::getTable(int inputSize)
+{
+	const Parameters & parameters = m_parameters.getActive();
+	m_table.update(1.0f / parameters.domainShiftFactor, inputSize, m_outputSpectrum->size, parameters.areaAveraging);
+	return &m_table;
+}
+
 void DomainShiftFilter::setDomainShiftFactor(float domainShiftFactor)
 {
-	m_domainShiftFactor = domainShiftFactor;
+	m_parameters.beginWrite().domainShiftFactor = domainShiftFactor;
+	m_parameters.endWrite();
 }
 
 void DomainShiftFilter::setNumFrequencyBins(int numFrequencyBins)
 {
-	delete m_outputSpectrum;
-	m_outputSpectrum = new FrequencySpectrum(numFrequencyBins);
+	m_parameters.beginWrite().numFrequencyBins = numFrequencyBins;
+	m_parameters.endWrite();
 }
 
 float DomainShiftFilter::getDomainShiftFactor()
 {
-	return m_domainShiftFactor;
+	return m_parameters.getLatest().domainShiftFactor;
 }
 
-PeakFilter::PeakFilter(int peakCurveSize) :
-	SpectrumFilter(),
-	m_peakCurve(new float[peakCurveSize]()),
-	m_peakCurveSize(peakCurveSize)
+int DomainShiftFilter::getNumFrequencyBins()
 {
+	return m_parameters.getLatest().numFrequencyBins;
 }
 
-PeakFilter::PeakFilter(float * peakCurve, int peakCurveSize) :
-	SpectrumFilter(),
-	m_peakCurve(new float[peakCurveSize]()),
-	m_peakCurveSize(peakCurveSize)
+void DomainShiftFilter::setAreaAveraging(bool areaAveraging)
+{
+	m_parameters.beginWrite().areaAveraging = areaAveraging;
+	m_parameters.endWrite();
+}
+
+bool DomainShiftFilter::getAreaAveraging()
 {
-	memcpy(m_peakCurve, peakCurve, peakCurveSize * sizeof(float));
+	return m_parameters.getLatest().areaAveraging;
 }
 
-PeakFilter::~PeakFilter()
+PeakFilter::PeakFilter(int peakCurveSize) :
+	PeakFilter(nullptr, peakCurveSize)
+{
+}
+
+PeakFilter::PeakFilter(const float * peakCurve, int peakCurveSize, int peakCurveCapacity) :
+	SpectrumFilter()
 {
-	delete[] m_peakCurve;
-	//delete m_outputSpectrum;
+	m_parameters.initialize([&](Parameters & parameters)
+	{
+		parameters.curve.reserve(utl::max(peakCurveSize, peakCurveCapacity));
+		parameters.falloff.reserve(utl::max(peakCurveSize, peakCurveCapacity) + 1);
+		assignPeakCurve(parameters, peakCurve, peakCurveSize);
+	});
 }
 
 const FrequencySpectrum * PeakFilter::applyFilter(const FrequencySpectrum * inputSpectrum)
 {
+	updateParameters();
 	if (m_outputSpectrum->size != inputSpectrum->size)
 		m_outputSpectrum->resize(inputSpectrum->size);
 
 	float * inputData = inputSpectrum->data;
 	float * outputData = m_outputSpectrum->data;
 	int numFrequencyBins = m_outputSpectrum->size;
+	const float * falloff = m_parameters.getActive().falloff.data();
+	int peakCurveSize = (int)m_parameters.getActive().curve.size();
+
+	// An empty curve falls off immediately
+	if (peakCurveSize == 0)
+	{
+		memcpy(outputData, inputData, numFrequencyBins * sizeof(float));
+		return m_outputSpectrum;
+	}
 
 	// "Walk" to the right over the data
 	// fall from the peaks in the shape of the peakcurve and stop falling after hitting the ground
@@ -155,14 +221,14 @@ const FrequencySpectrum * PeakFilter::applyFilter(const FrequencySpectrum * inpu
 	int curvePos = 0;
 	for (int i = 0; i < numFrequencyBins; i++)
 	{
-		if (inputData[i] >= position || curvePos >= m_peakCurveSize)
+		if (inputData[i] >= position || curvePos >= peakCurveSize)
 		{
 			peak = inputData[i];
 			curvePos = 0;
 		}
 		else
 			curvePos += 1;
-		position = peak * utl::clamp(m_peakCurve[m_peakCurveSize - 1 - curvePos], 0.0f, 1.0f);
+		position = peak * falloff[curvePos];
 		outputData[i] = utl::max(inputData[i], position);
 	}
 
@@ -174,14 +240,14 @@ const FrequencySpectrum * PeakFilter::applyFilter(const FrequencySpectrum * inpu
 	for (int i = 0; i < m_outputSpectrum->size; i++)
 	{
 		int i_rev = (numFrequencyBins - 1) - i;
-		if (outputData[i_rev] >= position || curvePos >= m_peakCurveSize)
+		if (outputData[i_rev] >= position || curvePos >= peakCurveSize)
 		{
 			peak = inputData[i_rev];
 			curvePos = 0;
 		}
 		else
 			curvePos += 1;
-		position = peak * utl::clamp(m_peakCurve[m_peakCurveSize - 1 - curvePos], 0.0f, 1.0f);
+		position = peak * falloff[curvePos];
 		outputData[i_rev] = utl::max(position, outputData[i_rev]);
 	}
 	return m_outputSpectrum;
@@ -189,97 +255,201 @@ const FrequencySpectrum * PeakFilter::applyFilter(const FrequencySpectrum * inpu
 
 void PeakFilter::setPeakCurveSize(int peakCurveSize)
 {
-	m_peakCurveSize = peakCurveSize;
-	delete[] m_peakCurve;
-	m_peakCurve = new float[m_peakCurveSize]();
+	assignPeakCurve(m_parameters.beginWrite(), nullptr, peakCurveSize);
+	m_parameters.endWrite();
 }
 
-void PeakFilter::setPeakCurve(float * peakCurve, int peakCurveSize)
+void PeakFilter::setPeakCurve(const float * peakCurve, int peakCurveSize)
 {
-	m_peakCurveSize = peakCurveSize;
-	delete[] m_peakCurve;
-	m_peakCurve = new float[m_peakCurveSize]();
-	memcpy(m_peakCurve, peakCurve, m_peakCurveSize * sizeof(float));
+	assignPeakCurve(m_parameters.beginWrite(), peakCurve, peakCurveSize);
+	m_parameters.endWrite();
 }
 
 int PeakFilter::getPeakCurveSize()
 {
-	return m_peakCurveSize;
+	return (int)m_parameters.getLatest().curve.size();
 }
 
-float * PeakFilter::getPeakCurve()
+const float * PeakFilter::getPeakCurve()
 {
-	return m_peakCurve;
+	return m_parameters.getLatest().curve.data();
 }
 
 AverageFilter::AverageFilter(int numSpectrumsInAverage) :
 	SpectrumFilter(),
+	m_averageMode(AVERAGE_MOVING),
 	m_numSpectrums(numSpectrumsInAverage),
+	m_numBins(0),
+	m_history(nullptr),
+	m_historyCapacity(0),
+	m_runningSum(nullptr),
+	m_runningSumCapacity(0),
 	m_spectrumID(0),
-	m_spectrums(new FrequencySpectrum *[m_numSpectrums])
+	m_framesSinceResum(0)
 {
-	for (int i = 0; i < m_numSpectrums; i++)
-		m_spectrums[i] = new FrequencySpectrum(0);
+	m_parameters.initialize([&](Parameters & parameters)
+	{
+		parameters.averageMode = AVERAGE_MOVING;
+		parameters.numSpectrums = numSpectrumsInAverage;
+		parameters.attack = 0.5f;
+		parameters.release = 0.1f;
+	});
 }
 
 AverageFilter::~AverageFilter()
 {
-	for (int i = 0; i < m_numSpectrums; i++)
-		delete m_spectrums[i];
-	delete[] m_spectrums;
+	delete[] m_history;
+	delete[] m_runningSum;
+}
+
+void AverageFilter::updateParameters()
+{
+	if (!m_parameters.update())
+		return;
+
+	// The exponential modes carry on from the current output, the moving average starts over
+	const Parameters & parameters = m_parameters.getActive();
+	bool restart = parameters.averageMode == AVERAGE_MOVING && (m_averageMode != AVERAGE_MOVING || parameters.numSpectrums != m_numSpectrums);
+	m_averageMode = parameters.averageMode;
+	m_numSpectrums = parameters.numSpectrums;
+	if (restart)
+		clearHistory();
 }
 
 const FrequencySpectrum * AverageFilter::applyFilter(const FrequencySpectrum * inputSpectrum)
 {
+	return applyCoalesced(inputSpectrum, 0);
+}
+
+const FrequencySpectrum * AverageFilter::applyCoalesced(const FrequencySpectrum * inputSpectrum, int numCoalescedHops)
+{
+	updateParameters();
 	int numFreqBins = inputSpectrum->size;
 	if (m_outputSpectrum->size != numFreqBins)
 	{
 		m_outputSpectrum->resize(numFreqBins);
-		for (int i = 0; i < m_numSpectrums; i++)
-			m_spectrums[i]->resize(numFreqBins);
+		m_numBins = numFreqBins;
+		clearHistory();
 	}
-	
-	// Store the input spectrum data in the spectrums array
-	float * newData = m_spectrums[m_spectrumID]->data;
-	m_spectrumID = (m_spectrumID + 1) % m_numSpectrums;
-	memcpy(newData, inputSpectrum->data, numFreqBins * sizeof(float));
-
-	// Reset output data
+	const float * inputData = inputSpectrum->data;
 	float * outputData = m_outputSpectrum->data;
-	for (int i = 0; i < numFreqBins; i++)
-		outputData[i] = 0.0f;
 
-	// Sum all the frequency spectrums
-	for (int i = 0; i < m_numSpectrums; i++)
+	// The exponential modes move each bin part of the way to the new value.
+	// 2 / (N + 1) gives the same average age of the data as a moving average of N spectrums.
+	// Moving by c for n hops toward the same value leaves (1 - c)^n of the distance, and a bin never changes direction on the way
+	int numHops = numCoalescedHops + 1;
+	if (m_averageMode == AVERAGE_EXPONENTIAL)
+	{
+		simd::exponentialAverage(outputData, inputData, numFreqBins, coalescedCoefficient(2.0f / (float)(m_numSpectrums + 1), numHops));
+		return m_outputSpectrum;
+	}
+	if (m_averageMode == AVERAGE_ATTACK_RELEASE)
+	{
+		const Parameters & parameters = m_parameters.getActive();
+		simd::attackRelease(outputData, inputData, numFreqBins,
+			coalescedCoefficient(parameters.attack, numHops), coalescedCoefficient(parameters.release, numHops));
+		return m_outputSpectrum;
+	}
+
+	// Replace the oldest spectrums in the history with the new one, and update the running sum with the difference.
+	// More than N copies would only replace copies
+	int numCopies = utl::min(numHops, m_numSpectrums);
+	float * sumData = m_runningSum;
+	for (int copy = 0; copy < numCopies; copy++)
 	{
-		float * data = m_spectrums[i]->data;
-		for (int j = 0; j < numFreqBins; j++)
-			outputData[j] += data[j];
+		float * oldestData = m_history + (size_t)m_spectrumID * numFreqBins;
+		m_spectrumID = (m_spectrumID + 1) % m_numSpectrums;
+		simd::replaceInSum(sumData, oldestData, inputData, numFreqBins);
+	}
+
+	// Adding and subtracting leaves rounding error in the sum that never cancels, so it is summed again from the history now and then
+	m_framesSinceResum += numCopies;
+	if (m_framesSinceResum >= RESUM_INTERVAL)
+	{
+		m_framesSinceResum = 0;
+		memset(sumData, 0, numFreqBins * sizeof(float));
+		for (int i = 0; i < m_numSpectrums; i++)
+			simd::accumulate(sumData, m_history + (size_t)i * numFreqBins, numFreqBins);
 	}
 
 	// Divide by number of spectrums to get the average
-	for (int i = 0; i < numFreqBins; i++)
-		outputData[i] /= (float)m_numSpectrums;
+	simd::scale(sumData, outputData, numFreqBins, 1.0f / (float)m_numSpectrums);
 
 	return m_outputSpectrum;
 }
 
-void AverageFilter::setNumSpectrumsInAverage(int numSpectrumsInAverage)
+int AverageFilter::getHistoryLength()
 {
-	// Delete old spectrums
-	for (int i = 0; i < m_numSpectrums; i++)
-		delete m_spectrums[i];
-	delete[] m_spectrums;
+	// The attack/release average covers about one time constant, 1 / coefficient hops, of the slower direction
+	if (m_averageMode == AVERAGE_ATTACK_RELEASE)
+	{
+		const Parameters & parameters = m_parameters.getActive();
+		return (int)ceilf(1.0f / utl::min(parameters.attack, parameters.release));
+	}
+	return m_numSpectrums;
+}
 
-	// Create new spectrums
-	m_numSpectrums = numSpectrumsInAverage;
-	m_spectrums = new FrequencySpectrum *[m_numSpectrums];
-	for (int i = 0; i < m_numSpectrums; i++)
-		m_spectrums[i] = new FrequencySpectrum(m_outputSpectrum->size);
+void AverageFilter::clearHistory()
+{
+	// Grow the history and running sum if needed, then zero them, which is the same as averaging over empty spectrums.
+	// The exponential modes have no history, so nothing is allocated until the moving average is used
+	if (m_averageMode != AVERAGE_MOVING)
+		return;
+	int historySize = m_numSpectrums * m_numBins;
+	if (historySize > m_historyCapacity)
+	{
+		delete[] m_history;
+		m_history = new float[historySize];
+		m_historyCapacity = historySize;
+	}
+	if (m_numBins > m_runningSumCapacity)
+	{
+		delete[] m_runningSum;
+		m_runningSum = new float[m_numBins];
+		m_runningSumCapacity = m_numBins;
+	}
+	memset(m_history, 0, historySize * sizeof(float));
+	memset(m_runningSum, 0, m_numBins * sizeof(float));
 	m_spectrumID = 0;
+	m_framesSinceResum = 0;
+}
+
+void AverageFilter::setNumSpectrumsInAverage(int numSpectrumsInAverage)
+{
+	m_parameters.beginWrite().numSpectrums = numSpectrumsInAverage;
+	m_parameters.endWrite();
 }
 
 int AverageFilter::getNumSpectrumsInAverage()
 {
-	return m_numSpectrums;
-}
\ No newline at end of file
+	return m_parameters.getLatest().numSpectrums;
+}
+
+void AverageFilter::setAverageMode(AverageMode averageMode)
+{
+	m_parameters.beginWrite().averageMode = averageMode;
+	m_parameters.endWrite();
+}
+
+AverageFilter::AverageMode AverageFilter::getAverageMode()
+{
+	return m_parameters.getLatest().averageMode;
+}
+
+void AverageFilter::setAttackRelease(float attack, float release)
+{
+	Parameters & parameters = m_parameters.beginWrite();
+	parameters.attack = utl::clamp(attack, 0.0001f, 1.0f);
+	parameters.release = utl::clamp(release, 0.0001f, 1.0f);
+	m_parameters.endWrite();
+}
+
+float AverageFilter::getAttack()
+{
+	return m_parameters.getLatest().attack;
+}
+
+float AverageFilter::getRelease()
+{
+	return m_parameters.getLatest().release;
+}
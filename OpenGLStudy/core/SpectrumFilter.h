@@ -3,88 +3,212 @@
 
 #include "FrequencySpectrum.h"
 #include "utilities.h"
+#include "DomainShiftTable.h"
+#include "ParameterBlock.h"
+
+#include <vector>
 
 class SpectrumFilter
 {
 public:
 	virtual const FrequencySpectrum * applyFilter(const FrequencySpectrum * inputSpectrum) = 0;
-	const FrequencySpectrum * getFrequencySpectrum();
+	virtual const FrequencySpectrum * getFrequencySpectrum();
 	virtual ~SpectrumFilter();
+
+	virtual void updateParameters() {}
+	/*
+	* Picks up parameters set from another thread since the last call. applyFilter() calls this first,
+	* so it only needs to be called directly by code that reads a filter's active parameters without applying it, like SpectrumPipeline.
+	*/
+
+	virtual bool needsEveryHop() { return false; }
+	/*
+	* True for filters that keep state from one spectrum to the next, and so have to see every hop.
+	* Filters that only look at the current spectrum can be run less often, on whichever spectrum is about to be displayed.
+	*/
+
+	virtual int getHistoryLength() { return 0; }
+	/*
+	* Roughly how many of the most recent hops the output depends on, 0 for filters without state.
+	* Used with the active parameters, so only by the thread that applies the filter.
+	*/
+
+	virtual const FrequencySpectrum * applyCoalesced(const FrequencySpectrum * inputSpectrum, int numCoalescedHops);
+	/*
+	* Applies the filter as if inputSpectrum arrived numCoalescedHops + 1 hops in a row, and returns the output after the last one.
+	* A filter that does not need every hop gives the same output for the same input, so it only runs once.
+	* Filters with state run applyFilter() once per hop, unless they override this with a closed form like AverageFilter does.
+	*/
 protected:
 	SpectrumFilter();
 	FrequencySpectrum * m_outputSpectrum;
 };
 
+/*
+* Filter parameters are set through a ParameterBlock. The setters and getters belong to one thread (the UI) and may be used
+* while another thread applies the filter. New parameters take effect at the start of the next applyFilter().
+* Curves keep their capacity, so setting a curve that is no longer than the capacity never allocates.
+*/
+
 class AmplitudeFilter : public SpectrumFilter
 {
 public:
+	struct Parameters
+	{
+		std::vector<float> curve;
+	};
+
 	AmplitudeFilter(int amplitudeCurveSize);
-	AmplitudeFilter(float * amplitudeCurve, int amplitudeCurveSize);
-	~AmplitudeFilter();
+	AmplitudeFilter(const float * amplitudeCurve, int amplitudeCurveSize, int amplitudeCurveCapacity = 0);
 
 	virtual const FrequencySpectrum * applyFilter(const FrequencySpectrum * inputSpectrum);
+	void updateParameters() { m_parameters.update(); }
 
 	void setAmplitudeCurveSize(int amplitudeCurveSize);
-	void setAmplitudeCurve(float * amplitudeCurve, int amplitudeCurveSize);
+	void setAmplitudeCurve(const float * amplitudeCurve, int amplitudeCurveSize);
 	int getAmplitudeCurveSize();
-	float * getAmplitudeCurve();
+	const float * getAmplitudeCurve();
+
+	const Parameters & getActiveParameters() { return m_parameters.getActive(); }
+	/*
+	* Only for the thread that applies the filter. The parameters picked up by the last updateParameters()
+	*/
 
 private:
-	float * m_amplitudeCurve;
-	int m_amplitudeCurveSize;
+	ParameterBlock<Parameters> m_parameters;
 };
 
 class DomainShiftFilter : public SpectrumFilter
 {
 public:
+	struct Parameters
+	{
+		float domainShiftFactor;
+		int numFrequencyBins;
+		bool areaAveraging;
+	};
+
 	DomainShiftFilter(float domainShiftFactor, int numFrequencyBins);
-	~DomainShiftFilter();
 
 	const FrequencySpectrum * applyFilter(const FrequencySpectrum * inputSpectrum);
+	void updateParameters();
 
 	void setDomainShiftFactor(float domainShiftFactor);
 	void setNumFrequencyBins(int numFrequencyBins);
 	float getDomainShiftFactor();
-	
+	int getNumFrequencyBins();
+
+	void setAreaAveraging(bool areaAveraging);
+	bool getAreaAveraging();
+	/*
+	* When enabled, output bins that cover several input bins average all of them instead of interpolating the two nearest.
+	* Off by default.
+	*/
+
+	const DomainShiftTable * getTable(int inputSize);
+	/*
+	* Only for the thread that applies the filter. The gather table for an input spectrum of inputSize bins,
+	* rebuilt if the active parameters changed since it was last used
+	*/
 
 private:
-	float m_domainShiftFactor;
+	ParameterBlock<Parameters> m_parameters;
+	DomainShiftTable m_table;
 };
 
 class PeakFilter : public SpectrumFilter
 {
 public:
+	struct Parameters
+	{
+		std::vector<float> curve;
+		std::vector<float> falloff;	// the curve reversed and clamped to [0, 1], the order the walk reads it in, then a 0 for the step past its end
+	};
+
 	PeakFilter(int peakCurveSize);
-	PeakFilter(float * peakCurve, int peakCurveSize);
-	~PeakFilter();
+	PeakFilter(const float * peakCurve, int peakCurveSize, int peakCurveCapacity = 0);
 
 	const FrequencySpectrum * applyFilter(const FrequencySpectrum * inputSpectrum);
+	void updateParameters() { m_parameters.update(); }
 
 	void setPeakCurveSize(int peakCurveSize);
-	void setPeakCurve(float * peakCurve, int peakCurveSize);
+	void setPeakCurve(const float * peakCurve, int peakCurveSize);
 	int getPeakCurveSize();
-	float * getPeakCurve();
+	const float * getPeakCurve();
 
 private:
-	float * m_peakCurve;
-	int m_peakCurveSize;
+	ParameterBlock<Parameters> m_parameters;
 };
 
 class AverageFilter : public SpectrumFilter
 {
 public:
+	enum AverageMode
+	{
+		AVERAGE_MOVING,			// mean of the last N spectrums, kept as a running sum
+		AVERAGE_EXPONENTIAL,	// exponential moving average with the same center of mass as an N spectrum moving average
+		AVERAGE_ATTACK_RELEASE	// exponential average with separate coefficients for rising and falling bins
+	};
+
+	struct Parameters
+	{
+		AverageMode averageMode;
+		int numSpectrums;
+		float attack;
+		float release;
+	};
+
 	AverageFilter(int numSpectrumsInAverage);
 	~AverageFilter();
 
 	const FrequencySpectrum * applyFilter(const FrequencySpectrum * inputSpectrum);
+	void updateParameters();
+	bool needsEveryHop() { return true; }
+	int getHistoryLength();
+
+	const FrequencySpectrum * applyCoalesced(const FrequencySpectrum * inputSpectrum, int numCoalescedHops);
+	/*
+	* Closed form for n = numCoalescedHops + 1 identical hops, which costs about one hop:
+	* the exponential modes use the coefficient 1 - (1 - c)^n, and the moving average puts min(n, N) copies in its history.
+	*/
 
 	void setNumSpectrumsInAverage(int numSpectrumsInAverage);
 	int getNumSpectrumsInAverage();
+	/*
+	* N for AVERAGE_MOVING and AVERAGE_EXPONENTIAL. Changing it clears the history, but reuses its storage when it is large enough.
+	*/
+
+	void setAverageMode(AverageMode averageMode);
+	AverageMode getAverageMode();
+	/*
+	* The exponential modes only keep the output spectrum, so they need no history at all
+	*/
+
+	void setAttackRelease(float attack, float release);
+	float getAttack();
+	float getRelease();
+	/*
+	* AVERAGE_ATTACK_RELEASE only. The fraction of the distance to the new value a bin moves per frame,
+	* using attack when the bin rises and release when it falls. Both are clamped to (0, 1], where 1 follows the input exactly.
+	*/
 
 private:
+	void clearHistory();
+
+	ParameterBlock<Parameters> m_parameters;
+
+	// The mode and N the history was built for. Only used by the thread that applies the filter
+	AverageMode m_averageMode;
 	int m_numSpectrums;
-	FrequencySpectrum ** m_spectrums;
+	int m_numBins;
+
+	// AVERAGE_MOVING state. The history is one block of m_numSpectrums rows of m_numBins, that only grows
+	float * m_history;
+	int m_historyCapacity;
+	float * m_runningSum;
+	int m_runningSumCapacity;
 	int m_spectrumID;
+	int m_framesSinceResum;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "SpectrumGraph.h"
+
+SpectrumGraph::SpectrumGraph() :
+	m_inputSpectrum(nullptr),
+	m_numEvaluatedNodes(0)
+{
+}
+
+int SpectrumGraph::addNode(SpectrumFilter * filter, int inputNode)
+{
+	Node node = { filter, inputNode, false, nullptr };
+	m_nodes.push_back(node);
+	return (int)m_nodes.size() - 1;
+}
+
+int SpectrumGraph::addChain(const std::vector<SpectrumFilter *> & filters, int inputNode)
+{
+	int node = inputNode;
+	for (SpectrumFilter * filter : filters)
+		node = addNode(filter, node);
+	return node;
+}
+
+void SpectrumGraph::setTap(const std::string & name, int node)
+{
+	int tap = getTapIndex(name);
+	if (tap < 0)
+	{
+		Tap newTap = { name, node };
+		m_taps.push_back(newTap);
+	}
+	else
+		m_taps[tap].node = node;
+	markTappedNodes();
+}
+
+int SpectrumGraph::getTapIndex(const std::string & name) const
+{
+	for (int i = 0; i < (int)m_taps.size(); i++)
+		if (m_taps[i].name == name)
+			return i;
+	return -1;
+}
+
+void SpectrumGraph::markTappedNodes()
+{
+	for (Node & node : m_nodes)
+		node.tapped = false;
+
+	// Walk from each tap back to the input. A walk can stop at the first node that is already marked,
+	// since everything before that node was marked by an earlier walk
+	for (const Tap & tap : m_taps)
+	{
+		int node = tap.node;
+		while (node != INPUT && !m_nodes[node].tapped)
+		{
+			m_nodes[node].tapped = true;
+			node = m_nodes[node].inputNode;
+		}
+	}
+}
+
+void SpectrumGraph::evaluate(const FrequencySpectrum * inputSpectrum, int numCoalescedHops)
+{
+	// Inputs always come before the node that reads them, so one pass in order runs everything after its input
+	m_inputSpectrum = inputSpectrum;
+	m_numEvaluatedNodes = 0;
+	for (Node & node : m_nodes)
+	{
+		if (!node.tapped)
+			continue;
+		node.outputSpectrum = node.filter->applyCoalesced(getNodeSpectrum(node.inputNode), numCoalescedHops);
+		m_numEvaluatedNodes++;
+	}
+}
+
+int SpectrumGraph::getHistoryLength()
+{
+	int historyLength = 0;
+	for (Node & node : m_nodes)
+	{
+		if (node.tapped)
+			historyLength = utl::max(historyLength, node.filter->getHistoryLength());
+	}
+	return historyLength;
+}
+
+const FrequencySpectrum * SpectrumGraph::getNodeSpectrum(int node) const
+{
+	return node == INPUT ? m_inputSpectrum : m_nodes[node].outputSpectrum;
+}
+
+const FrequencySpectrum * SpectrumGraph::getTapSpectrum(int tap) const
+{
+	return getNodeSpectrum(m_taps[tap].node);
+}
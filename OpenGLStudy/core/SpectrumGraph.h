@@ -0,0 +1,109 @@
+#ifndef SPECTRUMGRAPH_H
+#define SPECTRUMGRAPH_H
+
+/*
+* A tree of SpectrumFilters that all start from one input spectrum, usually the output of the analyzer.
+* Every node takes the output of the graph input or of an earlier node, so layers that share the start of their chain
+* share those nodes, and each node runs at most once per evaluate() no matter how many outputs depend on it.
+*
+* Any node's output can be named as a tap, for example the raw spectrum and the smoothed spectrum of the same chain.
+* Nodes that no tap depends on are skipped. A node can be a SpectrumPipeline, so a shared prefix can also be a fused chain.
+*/
+
+#include <string>
+#include <vector>
+
+#include "FrequencySpectrum.h"
+#include "SpectrumFilter.h"
+
+class SpectrumGraph
+{
+public:
+	static const int INPUT = -1;
+	/*
+	* The node index of the graph input
+	*/
+
+	SpectrumGraph();
+
+	int addNode(SpectrumFilter * filter, int inputNode = INPUT);
+	/*
+	* Adds a filter that runs on the output of inputNode. Returns the index of the new node.
+	* Pre:
+	*	inputNode is INPUT or the index of a node added before. The graph does not take ownership of filter.
+	*	A filter is only added once, to one graph.
+	*/
+
+	int addChain(const std::vector<SpectrumFilter *> & filters, int inputNode = INPUT);
+	/*
+	* Adds filters as a chain of nodes starting at inputNode. Returns the index of the last node, or inputNode if filters is empty.
+	*/
+
+	void setTap(const std::string & name, int node);
+	/*
+	* Names the output of node, which can be INPUT. Setting a name that exists moves it to node.
+	*/
+
+	int getTapIndex(const std::string & name) const;
+	/*
+	* Returns the index of a named tap, or -1 if there is no tap with that name.
+	* Tap indices stay the same for as long as the graph exists.
+	*/
+
+	int getNumTaps() const { return (int)m_taps.size(); }
+	const std::string & getTapName(int tap) const { return m_taps[tap].name; }
+
+	void evaluate(const FrequencySpectrum * inputSpectrum, int numCoalescedHops = 0);
+	/*
+	* Runs every node that a tap depends on, in the order the nodes were added.
+	* numCoalescedHops is passed to SpectrumFilter::applyCoalesced() of every node.
+	*/
+
+	const FrequencySpectrum * getTapSpectrum(int tap) const;
+	/*
+	* Pre:
+	*	evaluate() was called, and the input spectrum passed to it still exists
+	* Post:
+	*	returns the output of the tapped node from the last evaluate()
+	*/
+
+	int getHistoryLength();
+	/*
+	* The longest history of any node that a tap depends on. See SpectrumFilter::getHistoryLength().
+	*/
+
+	int getNumNodes() const { return (int)m_nodes.size(); }
+	int getNumEvaluatedNodes() const { return m_numEvaluatedNodes; }
+	/*
+	* The number of nodes the last evaluate() ran, which leaves out nodes that no tap depends on
+	*/
+
+private:
+	struct Node
+	{
+		SpectrumFilter * filter;
+		int inputNode;
+		bool tapped;	// a tap depends on the output of this node
+		const FrequencySpectrum * outputSpectrum;
+	};
+
+	struct Tap
+	{
+		std::string name;
+		int node;
+	};
+
+	void markTappedNodes();
+	/*
+	* Sets tapped on every node that a tap reads, and on the nodes before it
+	*/
+
+	const FrequencySpectrum * getNodeSpectrum(int node) const;
+
+	std::vector<Node> m_nodes;
+	std::vector<Tap> m_taps;
+	const FrequencySpectrum * m_inputSpectrum;
+	int m_numEvaluatedNodes;
+};
+
+#endif
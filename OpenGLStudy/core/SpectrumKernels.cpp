@@ -0,0 +1,1150 @@
+#include "SpectrumKernels.h"
+#include "CpuFeatures.h"
+
+#include <cmath>
+#include <cstring>
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPECTRUMKERNELS_X86
+#include <immintrin.h>
+#endif
+
+// MSVC compiles any intrinsic without flags, gcc and clang need the instruction set enabled per function
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_F16C __attribute__((target("avx,f16c")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_F16C
+#define TARGET_AVX512
+#endif
+
+// The AVX and AVX-512 kernels finish the last few values with a narrower kernel. gcc turns that call into a jump without the vzeroupper
+// it puts before a return, and SSE code that runs while the upper halves of the registers are dirty is several times slower,
+// so every wide kernel clears them with _mm256_zeroupper() before the call
+
+namespace
+{
+	const float DECIBELS_PER_LN = 4.34294481903f;	// 10 / ln(10), converts the natural log of a power to decibels
+	const float LN_2 = 0.69314718056f;
+
+	// Powers are clamped to at least the smallest normal float, so the exponent trick in the vector logs never sees a denormal or zero
+	inline float floorPower(float floorDecibels)
+	{
+		return fmaxf(powf(10.0f, floorDecibels * 0.1f), 1.17549435e-38f);
+	}
+
+	typedef void(*ComplexKernel)(const float *, float *, int, float);
+	typedef void(*DecibelKernel)(const float *, float *, int, float, float);
+	typedef void(*StereoSplitKernel)(const float *, int, float *, float *, float *, float *, int, float);
+	typedef void(*LerpGatherKernel)(const float *, const int *, const float *, float *, int);
+	typedef void(*HalfKernel)(const float *, uint16_t *, int);
+	typedef void(*Unorm8Kernel)(const float *, uint8_t *, int);
+	typedef void(*Unorm16Kernel)(const float *, uint16_t *, int);
+	typedef void(*CurveKernel)(const float *, int, const float *, float *, int);
+	typedef void(*SumKernel)(float *, float *, const float *, int);
+	typedef void(*AccumulateKernel)(float *, const float *, int);
+	typedef void(*ScaleKernel)(const float *, float *, int, float);
+	typedef void(*ExponentialKernel)(float *, const float *, int, float);
+	typedef void(*AttackReleaseKernel)(float *, const float *, int, float, float);
+	typedef void(*ExtremeKernel)(const float *, const float *, float *, int, bool);
+	typedef void(*RangeSumKernel)(const double *, const int *, const int *, float *, int, bool);
+	typedef void(*RangeExtremeKernel)(const float *, int, const int *, const int *, float *, int, bool);
+
+	struct KernelTable
+	{
+		ComplexKernel magnitude;
+		ComplexKernel power;
+		DecibelKernel decibels;
+		StereoSplitKernel stereoSplit;
+		LerpGatherKernel lerpGather;
+		HalfKernel floatToHalf;
+		Unorm8Kernel floatToUnorm8;
+		Unorm16Kernel floatToUnorm16;
+		CurveKernel curveLookup;
+		SumKernel replaceInSum;
+		AccumulateKernel accumulate;
+		ScaleKernel scale;
+		ExponentialKernel exponentialAverage;
+		AttackReleaseKernel attackRelease;
+		ExtremeKernel extremes;
+		RangeSumKernel rangeSums;
+		RangeExtremeKernel rangeExtremes;
+	};
+
+	// Scalar versions. These also finish the last few values the vector versions leave over
+
+	void magnitudeScalar(const float * complexData, float * outData, int count, float scale)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float rl = complexData[i * 2];
+			float im = complexData[i * 2 + 1];
+			outData[i] = sqrtf(rl * rl + im * im) * scale;
+		}
+	}
+
+	void powerScalar(const float * complexData, float * outData, int count, float scale)
+	{
+		float scale2 = scale * scale;
+		for (int i = 0; i < count; i++)
+		{
+			float rl = complexData[i * 2];
+			float im = complexData[i * 2 + 1];
+			outData[i] = (rl * rl + im * im) * scale2;
+		}
+	}
+
+	void decibelsScalar(const float * complexData, float * outData, int count, float scale, float floorDecibels)
+	{
+		float scale2 = scale * scale;
+		float minPower = floorPower(floorDecibels);
+		for (int i = 0; i < count; i++)
+		{
+			float rl = complexData[i * 2];
+			float im = complexData[i * 2 + 1];
+			float power = fmaxf((rl * rl + im * im) * scale2, minPower);
+			outData[i] = 10.0f * log10f(power);
+		}
+	}
+
+	// Bins [begin, end) of the stereo split. Bin 0 is its own mirror
+	void stereoSplitBins(const float * complexData, int fftSize, float * leftData, float * rightData, float * midData, float * sideData,
+		int begin, int end, float scale)
+	{
+		for (int k = begin; k < end; k++)
+		{
+			const float * z = complexData + k * 2;
+			const float * zMirror = complexData + (k == 0 ? 0 : fftSize - k) * 2;
+
+			// L = (Z[k] + conj(Z[N - k])) / 2, R = (Z[k] - conj(Z[N - k])) / 2i
+			float leftReal = (z[0] + zMirror[0]) * 0.5f;
+			float leftImag = (z[1] - zMirror[1]) * 0.5f;
+			float rightReal = (z[1] + zMirror[1]) * 0.5f;
+			float rightImag = (zMirror[0] - z[0]) * 0.5f;
+
+			float midReal = (leftReal + rightReal) * 0.5f;
+			float midImag = (leftImag + rightImag) * 0.5f;
+			float sideReal = (leftReal - rightReal) * 0.5f;
+			float sideImag = (leftImag - rightImag) * 0.5f;
+
+			leftData[k] = sqrtf(leftReal * leftReal + leftImag * leftImag) * scale;
+			rightData[k] = sqrtf(rightReal * rightReal + rightImag * rightImag) * scale;
+			midData[k] = sqrtf(midReal * midReal + midImag * midImag) * scale;
+			sideData[k] = sqrtf(sideReal * sideReal + sideImag * sideImag) * scale;
+		}
+	}
+
+	void stereoSplitScalar(const float * complexData, int fftSize, float * leftData, float * rightData, float * midData, float * sideData,
+		int count, float scale)
+	{
+		stereoSplitBins(complexData, fftSize, leftData, rightData, midData, sideData, 0, count, scale);
+	}
+
+	void lerpGatherScalar(const float * inputData, const int * indices, const float * fractions, float * outData, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int j = indices[i];
+			float pct = fractions[i];
+			outData[i] = (1.0f - pct) * inputData[j] + pct * inputData[j + 1];
+		}
+	}
+
+	uint16_t floatToHalfValue(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t absBits = bits & 0x7fffffff;
+
+		// Infinity and nan, then everything that rounds to 65520 or more, which is past the largest float16
+		if (absBits >= 0x7f800000)
+			return (uint16_t)(sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0));
+		if (absBits >= 0x477ff000)
+			return (uint16_t)(sign | 0x7c00);
+
+		// Below the smallest normal float16 the mantissa, with its implicit bit, is shifted down to a denormal
+		if (absBits < 0x38800000)
+		{
+			if (absBits <= 0x33000000)
+				return (uint16_t)sign;
+			int shift = 126 - (int)(absBits >> 23);
+			uint32_t mantissa = (absBits & 0x7fffff) | 0x800000;
+			uint32_t half = mantissa >> shift;
+			uint32_t remainder = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (remainder > halfway || (remainder == halfway && (half & 1)))
+				half++;
+			return (uint16_t)(sign | half);
+		}
+
+		// Rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits to nearest even.
+		// A carry out of the mantissa moves into the exponent, which is still the correctly rounded value
+		uint32_t rebiased = absBits - 0x38000000;
+		rebiased += 0xfff + ((rebiased >> 13) & 1);
+		return (uint16_t)(sign | (rebiased >> 13));
+	}
+
+	void floatToHalfScalar(const float * inputData, uint16_t * outData, int count)
+	{
+		for (int i = 0; i < count; i++)
+			outData[i] = floatToHalfValue(inputData[i]);
+	}
+
+	// The clamp picks the same operands as the SSE max and min instructions, which turn nan into 0,
+	// and lrintf() rounds in the current rounding mode like the vector conversions
+	inline float clampUnit(float value)
+	{
+		value = value > 0.0f ? value : 0.0f;
+		return value < 1.0f ? value : 1.0f;
+	}
+
+	void floatToUnorm8Scalar(const float * inputData, uint8_t * outData, int count)
+	{
+		for (int i = 0; i < count; i++)
+			outData[i] = (uint8_t)lrintf(clampUnit(inputData[i]) * 255.0f);
+	}
+
+	void floatToUnorm16Scalar(const float * inputData, uint16_t * outData, int count)
+	{
+		for (int i = 0; i < count; i++)
+			outData[i] = (uint16_t)lrintf(clampUnit(inputData[i]) * 65535.0f);
+	}
+
+	void curveLookupScalar(const float * curve, int curveSize, const float * inputData, float * outData, int count)
+	{
+		float width = (float)(curveSize - 1);
+		for (int i = 0; i < count; i++)
+			outData[i] = curve[(int)(width * fminf(fmaxf(inputData[i], 0.0f), 1.0f))];
+	}
+
+	void replaceInSumScalar(float * sumData, float * oldestData, const float * inputData, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			sumData[i] += inputData[i] - oldestData[i];
+			oldestData[i] = inputData[i];
+		}
+	}
+
+	void accumulateScalar(float * sumData, const float * inputData, int count)
+	{
+		for (int i = 0; i < count; i++)
+			sumData[i] += inputData[i];
+	}
+
+	void scaleScalar(const float * inputData, float * outData, int count, float scale)
+	{
+		for (int i = 0; i < count; i++)
+			outData[i] = inputData[i] * scale;
+	}
+
+	void exponentialAverageScalar(float * averageData, const float * inputData, int count, float alpha)
+	{
+		for (int i = 0; i < count; i++)
+			averageData[i] += alpha * (inputData[i] - averageData[i]);
+	}
+
+	void attackReleaseScalar(float * averageData, const float * inputData, int count, float attack, float release)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float difference = inputData[i] - averageData[i];
+			averageData[i] += (difference > 0.0f ? attack : release) * difference;
+		}
+	}
+
+	// Picks the same operand as the SSE max and min instructions, so every level agrees
+	void extremesScalar(const float * aData, const float * bData, float * outData, int count, bool maximum)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float a = aData[i];
+			float b = bData[i];
+			outData[i] = maximum ? (a > b ? a : b) : (a < b ? a : b);
+		}
+	}
+
+	void rangeSumsScalar(const double * prefixSum, const int * begins, const int * ends, float * outData, int count, bool mean)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			double sum = prefixSum[ends[i]] - prefixSum[begins[i]];
+			outData[i] = (float)(mean ? sum / (double)(ends[i] - begins[i]) : sum);
+		}
+	}
+
+	void rangeExtremesScalar(const float * table, int stride, const int * begins, const int * ends, float * outData, int count, bool maximum)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			// The widest row whose spans fit in the range, so one span from each end covers all of it.
+			// floor(log2(length)) is the exponent of the length as a float, which is exact below 2^24
+			float length = (float)(ends[i] - begins[i]);
+			uint32_t lengthBits;
+			memcpy(&lengthBits, &length, sizeof(lengthBits));
+			int level = (int)(lengthBits >> 23) - 127;
+			const float * row = table + (size_t)level * stride;
+			float a = row[begins[i]];
+			float b = row[ends[i] - (1 << level)];
+			outData[i] = maximum ? (a > b ? a : b) : (a < b ? a : b);
+		}
+	}
+
+#ifdef SPECTRUMKERNELS_X86
+	// SSE2 versions, 4 bins per step.
+	// Two loads hold 4 interleaved bins, the shuffles split them into 4 real parts and 4 imaginary parts
+
+	inline __m128 loadPowerSSE2(const float * complexData)
+	{
+		__m128 a = _mm_loadu_ps(complexData);
+		__m128 b = _mm_loadu_ps(complexData + 4);
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+		return _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+
+	inline __m128 lnSSE2(__m128 x)
+	{
+		// x = m * 2^e with m in [1, 2), then ln(m) = 2 * atanh((m - 1) / (m + 1)), a fast converging odd series
+		__m128i bits = _mm_castps_si128(x);
+		__m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+		__m128 mantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 s = _mm_div_ps(_mm_sub_ps(mantissa, one), _mm_add_ps(mantissa, one));
+		__m128 s2 = _mm_mul_ps(s, s);
+		__m128 series = _mm_set1_ps(1.0f / 11.0f);
+		series = _mm_add_ps(_mm_mul_ps(series, s2), _mm_set1_ps(1.0f / 9.0f));
+		series = _mm_add_ps(_mm_mul_ps(series, s2), _mm_set1_ps(1.0f / 7.0f));
+		series = _mm_add_ps(_mm_mul_ps(series, s2), _mm_set1_ps(1.0f / 5.0f));
+		series = _mm_add_ps(_mm_mul_ps(series, s2), _mm_set1_ps(1.0f / 3.0f));
+		series = _mm_add_ps(_mm_mul_ps(series, s2), one);
+		return _mm_add_ps(_mm_mul_ps(exponent, _mm_set1_ps(LN_2)), _mm_mul_ps(_mm_mul_ps(s, series), _mm_set1_ps(2.0f)));
+	}
+
+	void magnitudeSSE2(const float * complexData, float * outData, int count, float scale)
+	{
+		__m128 scaleVector = _mm_set1_ps(scale);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(outData + i, _mm_mul_ps(_mm_sqrt_ps(loadPowerSSE2(complexData + i * 2)), scaleVector));
+		magnitudeScalar(complexData + i * 2, outData + i, count - i, scale);
+	}
+
+	inline __m128 magnitudeSSE2(__m128 rl, __m128 im, __m128 scale)
+	{
+		return _mm_mul_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(rl, rl), _mm_mul_ps(im, im))), scale);
+	}
+
+	void stereoSplitSSE2(const float * complexData, int fftSize, float * leftData, float * rightData, float * midData, float * sideData,
+		int count, float scale)
+	{
+		// Bins k..k+3 pair with mirror bins N-k..N-k-3, which are loaded from N-k-3 up and reversed
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 scaleVector = _mm_set1_ps(scale);
+		stereoSplitBins(complexData, fftSize, leftData, rightData, midData, sideData, 0, count < 1 ? count : 1, scale);
+		int k = 1;
+		for (; k + 4 <= count; k += 4)
+		{
+			__m128 a = _mm_loadu_ps(complexData + k * 2);
+			__m128 b = _mm_loadu_ps(complexData + k * 2 + 4);
+			__m128 zReal = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 zImag = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			a = _mm_loadu_ps(complexData + (fftSize - k - 3) * 2);
+			b = _mm_loadu_ps(complexData + (fftSize - k - 3) * 2 + 4);
+			__m128 mirrorReal = _mm_shuffle_ps(b, a, _MM_SHUFFLE(0, 2, 0, 2));
+			__m128 mirrorImag = _mm_shuffle_ps(b, a, _MM_SHUFFLE(1, 3, 1, 3));
+
+			__m128 leftReal = _mm_mul_ps(_mm_add_ps(zReal, mirrorReal), half);
+			__m128 leftImag = _mm_mul_ps(_mm_sub_ps(zImag, mirrorImag), half);
+			__m128 rightReal = _mm_mul_ps(_mm_add_ps(zImag, mirrorImag), half);
+			__m128 rightImag = _mm_mul_ps(_mm_sub_ps(mirrorReal, zReal), half);
+			__m128 midReal = _mm_mul_ps(_mm_add_ps(leftReal, rightReal), half);
+			__m128 midImag = _mm_mul_ps(_mm_add_ps(leftImag, rightImag), half);
+			__m128 sideReal = _mm_mul_ps(_mm_sub_ps(leftReal, rightReal), half);
+			__m128 sideImag = _mm_mul_ps(_mm_sub_ps(leftImag, rightImag), half);
+
+			_mm_storeu_ps(leftData + k, magnitudeSSE2(leftReal, leftImag, scaleVector));
+			_mm_storeu_ps(rightData + k, magnitudeSSE2(rightReal, rightImag, scaleVector));
+			_mm_storeu_ps(midData + k, magnitudeSSE2(midReal, midImag, scaleVector));
+			_mm_storeu_ps(sideData + k, magnitudeSSE2(sideReal, sideImag, scaleVector));
+		}
+		stereoSplitBins(complexData, fftSize, leftData, rightData, midData, sideData, k, count, scale);
+	}
+
+	void powerSSE2(const float * complexData, float * outData, int count, float scale)
+	{
+		__m128 scaleVector = _mm_set1_ps(scale * scale);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(outData + i, _mm_mul_ps(loadPowerSSE2(complexData + i * 2), scaleVector));
+		powerScalar(complexData + i * 2, outData + i, count - i, scale);
+	}
+
+	void decibelsSSE2(const float * complexData, float * outData, int count, float scale, float floorDecibels)
+	{
+		__m128 scaleVector = _mm_set1_ps(scale * scale);
+		__m128 floorVector = _mm_set1_ps(floorPower(floorDecibels));
+		__m128 decibelsPerLn = _mm_set1_ps(DECIBELS_PER_LN);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 power = _mm_max_ps(_mm_mul_ps(loadPowerSSE2(complexData + i * 2), scaleVector), floorVector);
+			_mm_storeu_ps(outData + i, _mm_mul_ps(lnSSE2(power), decibelsPerLn));
+		}
+		decibelsScalar(complexData + i * 2, outData + i, count - i, scale, floorDecibels);
+	}
+
+	// AVX2 versions, 8 bins per step.
+	// The 256 bit shuffle works inside each 128 bit half, so the results come out as bins 0 1 4 5 2 3 6 7,
+	// and a cross lane permute puts them back in order
+
+	void replaceInSumSSE2(float * sumData, float * oldestData, const float * inputData, int count)
+	{
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 input = _mm_loadu_ps(inputData + i);
+			_mm_storeu_ps(sumData + i, _mm_add_ps(_mm_loadu_ps(sumData + i), _mm_sub_ps(input, _mm_loadu_ps(oldestData + i))));
+			_mm_storeu_ps(oldestData + i, input);
+		}
+		replaceInSumScalar(sumData + i, oldestData + i, inputData + i, count - i);
+	}
+
+	void accumulateSSE2(float * sumData, const float * inputData, int count)
+	{
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(sumData + i, _mm_add_ps(_mm_loadu_ps(sumData + i), _mm_loadu_ps(inputData + i)));
+		accumulateScalar(sumData + i, inputData + i, count - i);
+	}
+
+	void scaleSSE2(const float * inputData, float * outData, int count, float scale)
+	{
+		__m128 scaleVector = _mm_set1_ps(scale);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(outData + i, _mm_mul_ps(_mm_loadu_ps(inputData + i), scaleVector));
+		scaleScalar(inputData + i, outData + i, count - i, scale);
+	}
+
+	void exponentialAverageSSE2(float * averageData, const float * inputData, int count, float alpha)
+	{
+		__m128 alphaVector = _mm_set1_ps(alpha);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 average = _mm_loadu_ps(averageData + i);
+			_mm_storeu_ps(averageData + i, _mm_add_ps(average, _mm_mul_ps(alphaVector, _mm_sub_ps(_mm_loadu_ps(inputData + i), average))));
+		}
+		exponentialAverageScalar(averageData + i, inputData + i, count - i, alpha);
+	}
+
+	void attackReleaseSSE2(float * averageData, const float * inputData, int count, float attack, float release)
+	{
+		__m128 attackVector = _mm_set1_ps(attack);
+		__m128 releaseVector = _mm_set1_ps(release);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 average = _mm_loadu_ps(averageData + i);
+			__m128 difference = _mm_sub_ps(_mm_loadu_ps(inputData + i), average);
+			__m128 rising = _mm_cmpgt_ps(difference, _mm_setzero_ps());
+			__m128 coefficient = _mm_or_ps(_mm_and_ps(rising, attackVector), _mm_andnot_ps(rising, releaseVector));
+			_mm_storeu_ps(averageData + i, _mm_add_ps(average, _mm_mul_ps(coefficient, difference)));
+		}
+		attackReleaseScalar(averageData + i, inputData + i, count - i, attack, release);
+	}
+
+	void extremesSSE2(const float * aData, const float * bData, float * outData, int count, bool maximum)
+	{
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 a = _mm_loadu_ps(aData + i);
+			__m128 b = _mm_loadu_ps(bData + i);
+			_mm_storeu_ps(outData + i, maximum ? _mm_max_ps(a, b) : _mm_min_ps(a, b));
+		}
+		extremesScalar(aData + i, bData + i, outData + i, count - i, maximum);
+	}
+
+	// Normalized integer conversions. The clamped values fit in a signed 16 bit integer after the 8 bit scaling,
+	// so two signed packs narrow them. The 16 bit values do not, so they are shifted down by 32768 for the signed pack and back after it
+	inline __m128i unormSSE2(const float * inputData, __m128 scale)
+	{
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(inputData), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+	}
+
+	void floatToUnorm8SSE2(const float * inputData, uint8_t * outData, int count)
+	{
+		__m128 scale = _mm_set1_ps(255.0f);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i low = _mm_packs_epi32(unormSSE2(inputData + i, scale), unormSSE2(inputData + i + 4, scale));
+			__m128i high = _mm_packs_epi32(unormSSE2(inputData + i + 8, scale), unormSSE2(inputData + i + 12, scale));
+			_mm_storeu_si128((__m128i *)(outData + i), _mm_packus_epi16(low, high));
+		}
+		floatToUnorm8Scalar(inputData + i, outData + i, count - i);
+	}
+
+	void floatToUnorm16SSE2(const float * inputData, uint16_t * outData, int count)
+	{
+		__m128 scale = _mm_set1_ps(65535.0f);
+		__m128i offset32 = _mm_set1_epi32(32768);
+		__m128i offset16 = _mm_set1_epi16(-32768);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i low = _mm_sub_epi32(unormSSE2(inputData + i, scale), offset32);
+			__m128i high = _mm_sub_epi32(unormSSE2(inputData + i + 4, scale), offset32);
+			_mm_storeu_si128((__m128i *)(outData + i), _mm_xor_si128(_mm_packs_epi32(low, high), offset16));
+		}
+		floatToUnorm16Scalar(inputData + i, outData + i, count - i);
+	}
+
+	// SSE4.1 adds blends and lane extracts, which replace the and/or select and let the curve lookup skip a trip through memory
+
+	TARGET_SSE41 void curveLookupSSE41(const float * curve, int curveSize, const float * inputData, float * outData, int count)
+	{
+		__m128 width = _mm_set1_ps((float)(curveSize - 1));
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1.0f);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 t = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(inputData + i), zero), one);
+			__m128i index = _mm_cvttps_epi32(_mm_mul_ps(width, t));
+			_mm_storeu_ps(outData + i, _mm_setr_ps(curve[_mm_cvtsi128_si32(index)], curve[_mm_extract_epi32(index, 1)],
+				curve[_mm_extract_epi32(index, 2)], curve[_mm_extract_epi32(index, 3)]));
+		}
+		curveLookupScalar(curve, curveSize, inputData + i, outData + i, count - i);
+	}
+
+	TARGET_SSE41 void attackReleaseSSE41(float * averageData, const float * inputData, int count, float attack, float release)
+	{
+		__m128 attackVector = _mm_set1_ps(attack);
+		__m128 releaseVector = _mm_set1_ps(release);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 average = _mm_loadu_ps(averageData + i);
+			__m128 difference = _mm_sub_ps(_mm_loadu_ps(inputData + i), average);
+			__m128 coefficient = _mm_blendv_ps(releaseVector, attackVector, _mm_cmpgt_ps(difference, _mm_setzero_ps()));
+			_mm_storeu_ps(averageData + i, _mm_add_ps(average, _mm_mul_ps(coefficient, difference)));
+		}
+		attackReleaseScalar(averageData + i, inputData + i, count - i, attack, release);
+	}
+
+	TARGET_AVX2 inline __m256 loadPowerAVX2(const float * complexData)
+	{
+		__m256 a = _mm256_loadu_ps(complexData);
+		__m256 b = _mm256_loadu_ps(complexData + 8);
+		a = _mm256_mul_ps(a, a);
+		b = _mm256_mul_ps(b, b);
+		__m256 power = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(power), _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+
+	TARGET_AVX2 inline __m256 lnAVX2(__m256 x)
+	{
+		// Same series as lnSSE2()
+		__m256i bits = _mm256_castps_si256(x);
+		__m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+		__m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000)));
+		__m256 one = _mm256_set1_ps(1.0f);
+		__m256 s = _mm256_div_ps(_mm256_sub_ps(mantissa, one), _mm256_add_ps(mantissa, one));
+		__m256 s2 = _mm256_mul_ps(s, s);
+		__m256 series = _mm256_set1_ps(1.0f / 11.0f);
+		series = _mm256_add_ps(_mm256_mul_ps(series, s2), _mm256_set1_ps(1.0f / 9.0f));
+		series = _mm256_add_ps(_mm256_mul_ps(series, s2), _mm256_set1_ps(1.0f / 7.0f));
+		series = _mm256_add_ps(_mm256_mul_ps(series, s2), _mm256_set1_ps(1.0f / 5.0f));
+		series = _mm256_add_ps(_mm256_mul_ps(series, s2), _mm256_set1_ps(1.0f / 3.0f));
+		series = _mm256_add_ps(_mm256_mul_ps(series, s2), one);
+		return _mm256_add_ps(_mm256_mul_ps(exponent, _mm256_set1_ps(LN_2)), _mm256_mul_ps(_mm256_mul_ps(s, series), _mm256_set1_ps(2.0f)));
+	}
+
+	TARGET_AVX2 void magnitudeAVX2(const float * complexData, float * outData, int count, float scale)
+	{
+		__m256 scaleVector = _mm256_set1_ps(scale);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(outData + i, _mm256_mul_ps(_mm256_sqrt_ps(loadPowerAVX2(complexData + i * 2)), scaleVector));
+		_mm256_zeroupper();
+		magnitudeScalar(complexData + i * 2, outData + i, count - i, scale);
+	}
+
+	TARGET_AVX2 void powerAVX2(const float * complexData, float * outData, int count, float scale)
+	{
+		__m256 scaleVector = _mm256_set1_ps(scale * scale);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(outData + i, _mm256_mul_ps(loadPowerAVX2(complexData + i * 2), scaleVector));
+		_mm256_zeroupper();
+		powerScalar(complexData + i * 2, outData + i, count - i, scale);
+	}
+
+	TARGET_AVX2 void decibelsAVX2(const float * complexData, float * outData, int count, float scale, float floorDecibels)
+	{
+		__m256 scaleVector = _mm256_set1_ps(scale * scale);
+		__m256 floorVector = _mm256_set1_ps(floorPower(floorDecibels));
+		__m256 decibelsPerLn = _mm256_set1_ps(DECIBELS_PER_LN);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 power = _mm256_max_ps(_mm256_mul_ps(loadPowerAVX2(complexData + i * 2), scaleVector), floorVector);
+			_mm256_storeu_ps(outData + i, _mm256_mul_ps(lnAVX2(power), decibelsPerLn));
+		}
+		_mm256_zeroupper();
+		decibelsScalar(complexData + i * 2, outData + i, count - i, scale, floorDecibels);
+	}
+
+	TARGET_AVX2 inline __m256 magnitudeAVX2(__m256 rl, __m256 im, __m256 scale)
+	{
+		return _mm256_mul_ps(_mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(rl, rl), _mm256_mul_ps(im, im))), scale);
+	}
+
+	TARGET_AVX2 void stereoSplitAVX2(const float * complexData, int fftSize, float * leftData, float * rightData, float * midData, float * sideData,
+		int count, float scale)
+	{
+		// The shuffles leave the bins of each half in the order 0 1 4 5 2 3 6 7. One permute puts them in order, another reverses the mirror bins
+		__m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+		__m256i reverse = _mm256_setr_epi32(7, 6, 3, 2, 5, 4, 1, 0);
+		__m256 half = _mm256_set1_ps(0.5f);
+		__m256 scaleVector = _mm256_set1_ps(scale);
+		stereoSplitBins(complexData, fftSize, leftData, rightData, midData, sideData, 0, count < 1 ? count : 1, scale);
+		int k = 1;
+		for (; k + 8 <= count; k += 8)
+		{
+			__m256 a = _mm256_loadu_ps(complexData + k * 2);
+			__m256 b = _mm256_loadu_ps(complexData + k * 2 + 8);
+			__m256 zReal = _mm256_permutevar8x32_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), order);
+			__m256 zImag = _mm256_permutevar8x32_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), order);
+			a = _mm256_loadu_ps(complexData + (fftSize - k - 7) * 2);
+			b = _mm256_loadu_ps(complexData + (fftSize - k - 7) * 2 + 8);
+			__m256 mirrorReal = _mm256_permutevar8x32_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), reverse);
+			__m256 mirrorImag = _mm256_permutevar8x32_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), reverse);
+
+			__m256 leftReal = _mm256_mul_ps(_mm256_add_ps(zReal, mirrorReal), half);
+			__m256 leftImag = _mm256_mul_ps(_mm256_sub_ps(zImag, mirrorImag), half);
+			__m256 rightReal = _mm256_mul_ps(_mm256_add_ps(zImag, mirrorImag), half);
+			__m256 rightImag = _mm256_mul_ps(_mm256_sub_ps(mirrorReal, zReal), half);
+			__m256 midReal = _mm256_mul_ps(_mm256_add_ps(leftReal, rightReal), half);
+			__m256 midImag = _mm256_mul_ps(_mm256_add_ps(leftImag, rightImag), half);
+			__m256 sideReal = _mm256_mul_ps(_mm256_sub_ps(leftReal, rightReal), half);
+			__m256 sideImag = _mm256_mul_ps(_mm256_sub_ps(leftImag, rightImag), half);
+
+			_mm256_storeu_ps(leftData + k, magnitudeAVX2(leftReal, leftImag, scaleVector));
+			_mm256_storeu_ps(rightData + k, magnitudeAVX2(rightReal, rightImag, scaleVector));
+			_mm256_storeu_ps(midData + k, magnitudeAVX2(midReal, midImag, scaleVector));
+			_mm256_storeu_ps(sideData + k, magnitudeAVX2(sideReal, sideImag, scaleVector));
+		}
+		stereoSplitBins(complexData, fftSize, leftData, rightData, midData, sideData, k, count, scale);
+	}
+
+	TARGET_F16C void floatToHalfF16C(const float * inputData, uint16_t * outData, int count)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm_storeu_si128((__m128i *)(outData + i), _mm256_cvtps_ph(_mm256_loadu_ps(inputData + i), _MM_FROUND_TO_NEAREST_INT));
+		_mm256_zeroupper();
+		floatToHalfScalar(inputData + i, outData + i, count - i);
+	}
+
+	// The packs work inside each 128 bit half, so a cross lane permute puts the narrowed values back in order
+	TARGET_AVX2 inline __m256i unormAVX2(const float * inputData, __m256 scale)
+	{
+		__m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(inputData), _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+		return _mm256_cvtps_epi32(_mm256_mul_ps(value, scale));
+	}
+
+	TARGET_AVX2 void floatToUnorm8AVX2(const float * inputData, uint8_t * outData, int count)
+	{
+		__m256 scale = _mm256_set1_ps(255.0f);
+		__m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		int i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i low = _mm256_packs_epi32(unormAVX2(inputData + i, scale), unormAVX2(inputData + i + 8, scale));
+			__m256i high = _mm256_packs_epi32(unormAVX2(inputData + i + 16, scale), unormAVX2(inputData + i + 24, scale));
+			_mm256_storeu_si256((__m256i *)(outData + i), _mm256_permutevar8x32_epi32(_mm256_packus_epi16(low, high), order));
+		}
+		_mm256_zeroupper();
+		floatToUnorm8SSE2(inputData + i, outData + i, count - i);
+	}
+
+	TARGET_AVX2 void floatToUnorm16AVX2(const float * inputData, uint16_t * outData, int count)
+	{
+		__m256 scale = _mm256_set1_ps(65535.0f);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i packed = _mm256_packus_epi32(unormAVX2(inputData + i, scale), unormAVX2(inputData + i + 8, scale));
+			_mm256_storeu_si256((__m256i *)(outData + i), _mm256_permute4x64_epi64(packed, 0xd8));
+		}
+		_mm256_zeroupper();
+		floatToUnorm16SSE2(inputData + i, outData + i, count - i);
+	}
+
+	TARGET_AVX2 void curveLookupAVX2(const float * curve, int curveSize, const float * inputData, float * outData, int count)
+	{
+		__m256 width = _mm256_set1_ps((float)(curveSize - 1));
+		__m256 zero = _mm256_setzero_ps();
+		__m256 one = _mm256_set1_ps(1.0f);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 t = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(inputData + i), zero), one);
+			__m256i index = _mm256_cvttps_epi32(_mm256_mul_ps(width, t));
+			_mm256_storeu_ps(outData + i, _mm256_i32gather_ps(curve, index, 4));
+		}
+		_mm256_zeroupper();
+		curveLookupScalar(curve, curveSize, inputData + i, outData + i, count - i);
+	}
+
+	TARGET_AVX2 void replaceInSumAVX2(float * sumData, float * oldestData, const float * inputData, int count)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 input = _mm256_loadu_ps(inputData + i);
+			_mm256_storeu_ps(sumData + i, _mm256_add_ps(_mm256_loadu_ps(sumData + i), _mm256_sub_ps(input, _mm256_loadu_ps(oldestData + i))));
+			_mm256_storeu_ps(oldestData + i, input);
+		}
+		_mm256_zeroupper();
+		replaceInSumScalar(sumData + i, oldestData + i, inputData + i, count - i);
+	}
+
+	TARGET_AVX2 void accumulateAVX2(float * sumData, const float * inputData, int count)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(sumData + i, _mm256_add_ps(_mm256_loadu_ps(sumData + i), _mm256_loadu_ps(inputData + i)));
+		_mm256_zeroupper();
+		accumulateScalar(sumData + i, inputData + i, count - i);
+	}
+
+	TARGET_AVX2 void scaleAVX2(const float * inputData, float * outData, int count, float scale)
+	{
+		__m256 scaleVector = _mm256_set1_ps(scale);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(outData + i, _mm256_mul_ps(_mm256_loadu_ps(inputData + i), scaleVector));
+		_mm256_zeroupper();
+		scaleScalar(inputData + i, outData + i, count - i, scale);
+	}
+
+	TARGET_AVX2 void exponentialAverageAVX2(float * averageData, const float * inputData, int count, float alpha)
+	{
+		__m256 alphaVector = _mm256_set1_ps(alpha);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 average = _mm256_loadu_ps(averageData + i);
+			_mm256_storeu_ps(averageData + i, _mm256_add_ps(average, _mm256_mul_ps(alphaVector, _mm256_sub_ps(_mm256_loadu_ps(inputData + i), average))));
+		}
+		_mm256_zeroupper();
+		exponentialAverageScalar(averageData + i, inputData + i, count - i, alpha);
+	}
+
+	TARGET_AVX2 void attackReleaseAVX2(float * averageData, const float * inputData, int count, float attack, float release)
+	{
+		__m256 attackVector = _mm256_set1_ps(attack);
+		__m256 releaseVector = _mm256_set1_ps(release);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 average = _mm256_loadu_ps(averageData + i);
+			__m256 difference = _mm256_sub_ps(_mm256_loadu_ps(inputData + i), average);
+			__m256 coefficient = _mm256_blendv_ps(releaseVector, attackVector, _mm256_cmp_ps(difference, _mm256_setzero_ps(), _CMP_GT_OQ));
+			_mm256_storeu_ps(averageData + i, _mm256_add_ps(average, _mm256_mul_ps(coefficient, difference)));
+		}
+		_mm256_zeroupper();
+		attackReleaseScalar(averageData + i, inputData + i, count - i, attack, release);
+	}
+
+	TARGET_AVX2 void extremesAVX2(const float * aData, const float * bData, float * outData, int count, bool maximum)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 a = _mm256_loadu_ps(aData + i);
+			__m256 b = _mm256_loadu_ps(bData + i);
+			_mm256_storeu_ps(outData + i, maximum ? _mm256_max_ps(a, b) : _mm256_min_ps(a, b));
+		}
+		_mm256_zeroupper();
+		extremesScalar(aData + i, bData + i, outData + i, count - i, maximum);
+	}
+
+	// The prefix sums are doubles, so 4 of them fill one 256 bit register.
+	// Double gathers are slower than 4 separate loads on some cpus, so the prefixes are loaded one at a time,
+	// and AVX-512 uses this version as well
+	TARGET_AVX2 void rangeSumsAVX2(const double * prefixSum, const int * begins, const int * ends, float * outData, int count, bool mean)
+	{
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i begin = _mm_loadu_si128((const __m128i *)(begins + i));
+			__m128i end = _mm_loadu_si128((const __m128i *)(ends + i));
+			__m256d endSum = _mm256_setr_pd(prefixSum[ends[i]], prefixSum[ends[i + 1]], prefixSum[ends[i + 2]], prefixSum[ends[i + 3]]);
+			__m256d beginSum = _mm256_setr_pd(prefixSum[begins[i]], prefixSum[begins[i + 1]], prefixSum[begins[i + 2]], prefixSum[begins[i + 3]]);
+			__m256d sum = _mm256_sub_pd(endSum, beginSum);
+			if (mean)
+				sum = _mm256_div_pd(sum, _mm256_cvtepi32_pd(_mm_sub_epi32(end, begin)));
+			_mm_storeu_ps(outData + i, _mm256_cvtpd_ps(sum));
+		}
+		_mm256_zeroupper();
+		rangeSumsScalar(prefixSum, begins + i, ends + i, outData + i, count - i, mean);
+	}
+
+	TARGET_AVX2 void rangeExtremesAVX2(const float * table, int stride, const int * begins, const int * ends, float * outData, int count, bool maximum)
+	{
+		__m256i strideVector = _mm256_set1_epi32(stride);
+		__m256i one = _mm256_set1_epi32(1);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i begin = _mm256_loadu_si256((const __m256i *)(begins + i));
+			__m256i end = _mm256_loadu_si256((const __m256i *)(ends + i));
+
+			__m256i length = _mm256_sub_epi32(end, begin);
+			__m256i level = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(length)), 23), _mm256_set1_epi32(127));
+			__m256i rowStart = _mm256_mullo_epi32(level, strideVector);
+			__m256i span = _mm256_sllv_epi32(one, level);
+			__m256 a = _mm256_i32gather_ps(table, _mm256_add_epi32(rowStart, begin), 4);
+			__m256 b = _mm256_i32gather_ps(table, _mm256_add_epi32(rowStart, _mm256_sub_epi32(end, span)), 4);
+			_mm256_storeu_ps(outData + i, maximum ? _mm256_max_ps(a, b) : _mm256_min_ps(a, b));
+		}
+		_mm256_zeroupper();
+		rangeExtremesScalar(table, stride, begins + i, ends + i, outData + i, count - i, maximum);
+	}
+
+	// AVX-512 versions of the filter kernels. The fft output kernels stay at their AVX2 versions, which are limited by the loads.
+	// AVX-512 implies FMA, so gcc and clang would fuse a multiply and add into one rounding, unlike the scalar version.
+	// The multiplies that feed an add use the explicit rounding form, which the compiler leaves alone
+
+	TARGET_AVX512 void curveLookupAVX512(const float * curve, int curveSize, const float * inputData, float * outData, int count)
+	{
+		__m512 width = _mm512_set1_ps((float)(curveSize - 1));
+		__m512 zero = _mm512_setzero_ps();
+		__m512 one = _mm512_set1_ps(1.0f);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512 t = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(inputData + i), zero), one);
+			__m512i index = _mm512_cvttps_epi32(_mm512_mul_ps(width, t));
+			_mm512_storeu_ps(outData + i, _mm512_i32gather_ps(index, curve, 4));
+		}
+		_mm256_zeroupper();
+		curveLookupScalar(curve, curveSize, inputData + i, outData + i, count - i);
+	}
+
+	TARGET_AVX512 void replaceInSumAVX512(float * sumData, float * oldestData, const float * inputData, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512 input = _mm512_loadu_ps(inputData + i);
+			_mm512_storeu_ps(sumData + i, _mm512_add_ps(_mm512_loadu_ps(sumData + i), _mm512_sub_ps(input, _mm512_loadu_ps(oldestData + i))));
+			_mm512_storeu_ps(oldestData + i, input);
+		}
+		_mm256_zeroupper();
+		replaceInSumScalar(sumData + i, oldestData + i, inputData + i, count - i);
+	}
+
+	TARGET_AVX512 void accumulateAVX512(float * sumData, const float * inputData, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm512_storeu_ps(sumData + i, _mm512_add_ps(_mm512_loadu_ps(sumData + i), _mm512_loadu_ps(inputData + i)));
+		_mm256_zeroupper();
+		accumulateScalar(sumData + i, inputData + i, count - i);
+	}
+
+	TARGET_AVX512 void scaleAVX512(const float * inputData, float * outData, int count, float scale)
+	{
+		__m512 scaleVector = _mm512_set1_ps(scale);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm512_storeu_ps(outData + i, _mm512_mul_ps(_mm512_loadu_ps(inputData + i), scaleVector));
+		_mm256_zeroupper();
+		scaleScalar(inputData + i, outData + i, count - i, scale);
+	}
+
+	TARGET_AVX512 void exponentialAverageAVX512(float * averageData, const float * inputData, int count, float alpha)
+	{
+		__m512 alphaVector = _mm512_set1_ps(alpha);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512 average = _mm512_loadu_ps(averageData + i);
+			__m512 step = _mm512_mul_round_ps(alphaVector, _mm512_sub_ps(_mm512_loadu_ps(inputData + i), average), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			_mm512_storeu_ps(averageData + i, _mm512_add_ps(average, step));
+		}
+		_mm256_zeroupper();
+		exponentialAverageScalar(averageData + i, inputData + i, count - i, alpha);
+	}
+
+	TARGET_AVX512 void attackReleaseAVX512(float * averageData, const float * inputData, int count, float attack, float release)
+	{
+		__m512 attackVector = _mm512_set1_ps(attack);
+		__m512 releaseVector = _mm512_set1_ps(release);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512 average = _mm512_loadu_ps(averageData + i);
+			__m512 difference = _mm512_sub_ps(_mm512_loadu_ps(inputData + i), average);
+			__mmask16 rising = _mm512_cmp_ps_mask(difference, _mm512_setzero_ps(), _CMP_GT_OQ);
+			__m512 coefficient = _mm512_mask_blend_ps(rising, releaseVector, attackVector);
+			__m512 step = _mm512_mul_round_ps(coefficient, difference, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			_mm512_storeu_ps(averageData + i, _mm512_add_ps(average, step));
+		}
+		_mm256_zeroupper();
+		attackReleaseScalar(averageData + i, inputData + i, count - i, attack, release);
+	}
+
+	TARGET_AVX512 void extremesAVX512(const float * aData, const float * bData, float * outData, int count, bool maximum)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512 a = _mm512_loadu_ps(aData + i);
+			__m512 b = _mm512_loadu_ps(bData + i);
+			_mm512_storeu_ps(outData + i, maximum ? _mm512_max_ps(a, b) : _mm512_min_ps(a, b));
+		}
+		_mm256_zeroupper();
+		extremesScalar(aData + i, bData + i, outData + i, count - i, maximum);
+	}
+
+	// AVX-512 narrows with one saturating conversion, which keeps the order
+	TARGET_AVX512 inline __m512i unormAVX512(const float * inputData, __m512 scale)
+	{
+		__m512 value = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(inputData), _mm512_setzero_ps()), _mm512_set1_ps(1.0f));
+		return _mm512_cvtps_epi32(_mm512_mul_ps(value, scale));
+	}
+
+	TARGET_AVX512 void floatToUnorm8AVX512(const float * inputData, uint8_t * outData, int count)
+	{
+		__m512 scale = _mm512_set1_ps(255.0f);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm_storeu_si128((__m128i *)(outData + i), _mm512_cvtusepi32_epi8(unormAVX512(inputData + i, scale)));
+		_mm256_zeroupper();
+		floatToUnorm8SSE2(inputData + i, outData + i, count - i);
+	}
+
+	TARGET_AVX512 void floatToUnorm16AVX512(const float * inputData, uint16_t * outData, int count)
+	{
+		__m512 scale = _mm512_set1_ps(65535.0f);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+			_mm256_storeu_si256((__m256i *)(outData + i), _mm512_cvtusepi32_epi16(unormAVX512(inputData + i, scale)));
+		_mm256_zeroupper();
+		floatToUnorm16SSE2(inputData + i, outData + i, count - i);
+	}
+
+	TARGET_AVX512 void rangeExtremesAVX512(const float * table, int stride, const int * begins, const int * ends, float * outData, int count, bool maximum)
+	{
+		__m512i strideVector = _mm512_set1_epi32(stride);
+		__m512i one = _mm512_set1_epi32(1);
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m512i begin = _mm512_loadu_si512((const void *)(begins + i));
+			__m512i end = _mm512_loadu_si512((const void *)(ends + i));
+			__m512i length = _mm512_sub_epi32(end, begin);
+			__m512i level = _mm512_sub_epi32(_mm512_srli_epi32(_mm512_castps_si512(_mm512_cvtepi32_ps(length)), 23), _mm512_set1_epi32(127));
+			__m512i rowStart = _mm512_mullo_epi32(level, strideVector);
+			__m512i span = _mm512_sllv_epi32(one, level);
+			__m512 a = _mm512_i32gather_ps(_mm512_add_epi32(rowStart, begin), table, 4);
+			__m512 b = _mm512_i32gather_ps(_mm512_add_epi32(rowStart, _mm512_sub_epi32(end, span)), table, 4);
+			_mm512_storeu_ps(outData + i, maximum ? _mm512_max_ps(a, b) : _mm512_min_ps(a, b));
+		}
+		_mm256_zeroupper();
+		rangeExtremesScalar(table, stride, begins + i, ends + i, outData + i, count - i, maximum);
+	}
+
+	const KernelTable kernelTables[simd::NUM_LEVELS] =
+	{
+		{ magnitudeScalar, powerScalar, decibelsScalar, stereoSplitScalar, lerpGatherScalar, floatToHalfScalar, floatToUnorm8Scalar, floatToUnorm16Scalar,
+			curveLookupScalar, replaceInSumScalar, accumulateScalar, scaleScalar, exponentialAverageScalar, attackReleaseScalar,
+			extremesScalar, rangeSumsScalar, rangeExtremesScalar },
+		{ magnitudeSSE2, powerSSE2, decibelsSSE2, stereoSplitSSE2, lerpGatherScalar, floatToHalfScalar, floatToUnorm8SSE2, floatToUnorm16SSE2,
+			curveLookupScalar, replaceInSumSSE2, accumulateSSE2, scaleSSE2, exponentialAverageSSE2, attackReleaseSSE2,
+			extremesSSE2, rangeSumsScalar, rangeExtremesScalar },
+		{ magnitudeSSE2, powerSSE2, decibelsSSE2, stereoSplitSSE2, lerpGatherScalar, floatToHalfScalar, floatToUnorm8SSE2, floatToUnorm16SSE2,
+			curveLookupSSE41, replaceInSumSSE2, accumulateSSE2, scaleSSE2, exponentialAverageSSE2, attackReleaseSSE41,
+			extremesSSE2, rangeSumsScalar, rangeExtremesScalar },
+		{ magnitudeAVX2, powerAVX2, decibelsAVX2, stereoSplitAVX2, lerpGatherScalar, floatToHalfF16C, floatToUnorm8AVX2, floatToUnorm16AVX2,
+			curveLookupAVX2, replaceInSumAVX2, accumulateAVX2, scaleAVX2, exponentialAverageAVX2, attackReleaseAVX2,
+			extremesAVX2, rangeSumsAVX2, rangeExtremesAVX2 },
+		{ magnitudeAVX2, powerAVX2, decibelsAVX2, stereoSplitAVX2, lerpGatherScalar, floatToHalfF16C, floatToUnorm8AVX512, floatToUnorm16AVX512,
+			curveLookupAVX512, replaceInSumAVX512, accumulateAVX512, scaleAVX512, exponentialAverageAVX512, attackReleaseAVX512,
+			extremesAVX512, rangeSumsAVX2, rangeExtremesAVX512 }
+	};
+#else
+	const KernelTable kernelTables[simd::NUM_LEVELS] =
+	{
+		{ magnitudeScalar, powerScalar, decibelsScalar, stereoSplitScalar, lerpGatherScalar, floatToHalfScalar, floatToUnorm8Scalar, floatToUnorm16Scalar,
+			curveLookupScalar, replaceInSumScalar, accumulateScalar, scaleScalar, exponentialAverageScalar, attackReleaseScalar,
+			extremesScalar, rangeSumsScalar, rangeExtremesScalar },
+		{ magnitudeScalar, powerScalar, decibelsScalar, stereoSplitScalar, lerpGatherScalar, floatToHalfScalar, floatToUnorm8Scalar, floatToUnorm16Scalar,
+			curveLookupScalar, replaceInSumScalar, accumulateScalar, scaleScalar, exponentialAverageScalar, attackReleaseScalar,
+			extremesScalar, rangeSumsScalar, rangeExtremesScalar },
+		{ magnitudeScalar, powerScalar, decibelsScalar, stereoSplitScalar, lerpGatherScalar, floatToHalfScalar, floatToUnorm8Scalar, floatToUnorm16Scalar,
+			curveLookupScalar, replaceInSumScalar, accumulateScalar, scaleScalar, exponentialAverageScalar, attackReleaseScalar,
+			extremesScalar, rangeSumsScalar, rangeExtremesScalar },
+		{ magnitudeScalar, powerScalar, decibelsScalar, stereoSplitScalar, lerpGatherScalar, floatToHalfScalar, floatToUnorm8Scalar, floatToUnorm16Scalar,
+			curveLookupScalar, replaceInSumScalar, accumulateScalar, scaleScalar, exponentialAverageScalar, attackReleaseScalar,
+			extremesScalar, rangeSumsScalar, rangeExtremesScalar },
+		{ magnitudeScalar, powerScalar, decibelsScalar, stereoSplitScalar, lerpGatherScalar, floatToHalfScalar, floatToUnorm8Scalar, floatToUnorm16Scalar,
+			curveLookupScalar, replaceInSumScalar, accumulateScalar, scaleScalar, exponentialAverageScalar, attackReleaseScalar,
+			extremesScalar, rangeSumsScalar, rangeExtremesScalar }
+	};
+#endif
+
+	std::atomic<int> & activeLevel()
+	{
+		static std::atomic<int> level(simd::getBestLevel());
+		return level;
+	}
+
+	inline const KernelTable & activeTable()
+	{
+		return kernelTables[activeLevel().load(std::memory_order_relaxed)];
+	}
+}
+
+namespace simd
+{
+	Level getBestLevel()
+	{
+		const CpuFeatures & features = CpuFeatures::get();
+		if (features.avx512f)
+			return LEVEL_AVX512;
+		if (features.avx2)
+			return LEVEL_AVX2;
+		if (features.sse41)
+			return LEVEL_SSE41;
+		if (features.sse2)
+			return LEVEL_SSE2;
+		return LEVEL_SCALAR;
+	}
+
+	Level getLevel()
+	{
+		return (Level)activeLevel().load();
+	}
+
+	void setLevel(Level level)
+	{
+		Level bestLevel = getBestLevel();
+		activeLevel().store(level < bestLevel ? level : bestLevel);
+	}
+
+	const char * getLevelName(Level level)
+	{
+		const char * names[NUM_LEVELS] = { "scalar", "sse2", "sse4.1", "avx2", "avx512" };
+		return names[level];
+	}
+
+	void complexMagnitude(const float * complexData, float * outData, int count, float scale)
+	{
+		activeTable().magnitude(complexData, outData, count, scale);
+	}
+
+	void complexPower(const float * complexData, float * outData, int count, float scale)
+	{
+		activeTable().power(complexData, outData, count, scale);
+	}
+
+	void complexDecibels(const float * complexData, float * outData, int count, float scale, float floorDecibels)
+	{
+		activeTable().decibels(complexData, outData, count, scale, floorDecibels);
+	}
+
+	void stereoSplit(const float * complexData, int fftSize, float * leftData, float * rightData, float * midData, float * sideData, int count, float scale)
+	{
+		activeTable().stereoSplit(complexData, fftSize, leftData, rightData, midData, sideData, count, scale);
+	}
+
+	void lerpGather(const float * inputData, const int * indices, const float * fractions, float * outData, int count)
+	{
+		activeTable().lerpGather(inputData, indices, fractions, outData, count);
+	}
+
+	void floatToHalf(const float * inputData, uint16_t * outData, int count)
+	{
+		// Every cpu with avx2 so far has f16c, but the two are separate cpuid flags
+		if (getLevel() >= LEVEL_AVX2 && !CpuFeatures::get().f16c)
+			floatToHalfScalar(inputData, outData, count);
+		else
+			activeTable().floatToHalf(inputData, outData, count);
+	}
+
+	void floatToUnorm8(const float * inputData, uint8_t * outData, int count)
+	{
+		activeTable().floatToUnorm8(inputData, outData, count);
+	}
+
+	void floatToUnorm16(const float * inputData, uint16_t * outData, int count)
+	{
+		activeTable().floatToUnorm16(inputData, outData, count);
+	}
+
+	void curveLookup(const float * curve, int curveSize, const float * inputData, float * outData, int count)
+	{
+		activeTable().curveLookup(curve, curveSize, inputData, outData, count);
+	}
+
+	void replaceInSum(float * sumData, float * oldestData, const float * inputData, int count)
+	{
+		activeTable().replaceInSum(sumData, oldestData, inputData, count);
+	}
+
+	void accumulate(float * sumData, const float * inputData, int count)
+	{
+		activeTable().accumulate(sumData, inputData, count);
+	}
+
+	void scale(const float * inputData, float * outData, int count, float scale)
+	{
+		activeTable().scale(inputData, outData, count, scale);
+	}
+
+	void exponentialAverage(float * averageData, const float * inputData, int count, float alpha)
+	{
+		activeTable().exponentialAverage(averageData, inputData, count, alpha);
+	}
+
+	void attackRelease(float * averageData, const float * inputData, int count, float attack, float release)
+	{
+		activeTable().attackRelease(averageData, inputData, count, attack, release);
+	}
+
+	void maximum(const float * aData, const float * bData, float * outData, int count)
+	{
+		activeTable().extremes(aData, bData, outData, count, true);
+	}
+
+	void minimum(const float * aData, const float * bData, float * outData, int count)
+	{
+		activeTable().extremes(aData, bData, outData, count, false);
+	}
+
+	void rangeSums(const double * prefixSum, const int * begins, const int * ends, float * outData, int count, bool mean)
+	{
+		activeTable().rangeSums(prefixSum, begins, ends, outData, count, mean);
+	}
+
+	void rangeExtremes(const float * table, int stride, const int * begins, const int * ends, float * outData, int count, bool maximum)
+	{
+		activeTable().rangeExtremes(table, stride, begins, ends, outData, count, maximum);
+	}
+}
@@ -0,0 +1,165 @@
+#ifndef SPECTRUMKERNELS_H
+#define SPECTRUMKERNELS_H
+
+/*
+* Vectorized loops over spectrum data, with scalar, SSE2, SSE4.1, AVX2 and AVX-512 versions.
+* A level that has no version of its own for a kernel runs the version of the level below it.
+* The widest version the cpu supports is picked the first time a kernel is called,
+* and every kernel call goes through that choice, so callers never deal with instruction sets.
+*/
+
+#include <cstdint>
+
+namespace simd
+{
+	enum Level
+	{
+		LEVEL_SCALAR,
+		LEVEL_SSE2,
+		LEVEL_SSE41,
+		LEVEL_AVX2,
+		LEVEL_AVX512,
+		NUM_LEVELS
+	};
+
+	Level getBestLevel();
+	/*
+	* The widest level the cpu and the os support
+	*/
+
+	Level getLevel();
+	void setLevel(Level level);
+	/*
+	* The level the kernels currently run at. setLevel() is clamped to getBestLevel(),
+	* and exists so the versions can be compared against each other.
+	*/
+
+	const char * getLevelName(Level level);
+
+	void complexMagnitude(const float * complexData, float * outData, int count, float scale);
+	/*
+	* Pre:
+	*	complexData holds count interleaved (real, imaginary) pairs, outData has room for count values
+	* Post:
+	*	outData[i] = |complexData[i]| * scale
+	*/
+
+	void complexPower(const float * complexData, float * outData, int count, float scale);
+	/*
+	* Post:
+	*	outData[i] = |complexData[i]|^2 * scale^2, which is the squared magnitude without the square root
+	*/
+
+	void complexDecibels(const float * complexData, float * outData, int count, float scale, float floorDecibels);
+	/*
+	* Post:
+	*	outData[i] = 20 * log10(|complexData[i]| * scale), and never less than floorDecibels.
+	*	The SIMD versions use a polynomial log that is within 1e-5 dB of log10f.
+	*/
+
+	void stereoSplit(const float * complexData, int fftSize, float * leftData, float * rightData, float * midData, float * sideData, int count, float scale);
+	/*
+	* Pre:
+	*	complexData is the fftSize point complex fft Z of a frame with the left channel in the real parts and the right channel in the imaginary parts.
+	*	count <= fftSize / 2 + 1
+	* Post:
+	*	leftData[k] = |L[k]| * scale and rightData[k] = |R[k]| * scale, with L[k] = (Z[k] + conj(Z[N - k])) / 2 and R[k] = (Z[k] - conj(Z[N - k])) / 2i.
+	*	midData[k] and sideData[k] are the magnitudes of (L[k] + R[k]) / 2 and (L[k] - R[k]) / 2, times scale.
+	*	Every level gives the same result as the scalar version, bit for bit.
+	*/
+
+	void lerpGather(const float * inputData, const int * indices, const float * fractions, float * outData, int count);
+	/*
+	* Pre:
+	*	inputData[indices[i] + 1] is valid for every i < count
+	* Post:
+	*	outData[i] = (1 - fractions[i]) * inputData[indices[i]] + fractions[i] * inputData[indices[i] + 1]
+	*	Every level runs the scalar version. The AVX2 gather instruction measured no faster than scalar loads (see spectrumBenchmark).
+	*/
+
+	void floatToHalf(const float * inputData, uint16_t * outData, int count);
+	/*
+	* Post:
+	*	outData[i] is inputData[i] as an IEEE float16, rounded to nearest even. Values too large for float16 become infinity.
+	*	Uses the F16C conversion instruction at LEVEL_AVX2 and up when the cpu has it.
+	*/
+
+	void floatToUnorm8(const float * inputData, uint8_t * outData, int count);
+	void floatToUnorm16(const float * inputData, uint16_t * outData, int count);
+	/*
+	* Post:
+	*	outData[i] is inputData[i] clamped to [0, 1] and scaled to [0, 255] ([0, 65535]), rounded to nearest even.
+	*	nan becomes 0. This is how openGL reads a normalized integer, so the values upload to GL_UNSIGNED_BYTE (GL_UNSIGNED_SHORT) textures.
+	*	Every level gives the same result as the scalar version.
+	*/
+
+	// Filter kernels. Every level gives the same result as the scalar version, bit for bit
+
+	void curveLookup(const float * curve, int curveSize, const float * inputData, float * outData, int count);
+	/*
+	* Pre:
+	*	curveSize > 0
+	* Post:
+	*	outData[i] = curve[(int)((curveSize - 1) * t)], where t is inputData[i] clamped to [0, 1].
+	*	The same lookup as utl::getValue(), which is what AmplitudeFilter applies.
+	*/
+
+	void replaceInSum(float * sumData, float * oldestData, const float * inputData, int count);
+	/*
+	* Post:
+	*	sumData[i] += inputData[i] - oldestData[i], then oldestData[i] = inputData[i]
+	*/
+
+	void accumulate(float * sumData, const float * inputData, int count);
+	/*
+	* Post:
+	*	sumData[i] += inputData[i]
+	*/
+
+	void scale(const float * inputData, float * outData, int count, float scale);
+	/*
+	* Post:
+	*	outData[i] = inputData[i] * scale. inputData and outData can be the same buffer.
+	*/
+
+	void exponentialAverage(float * averageData, const float * inputData, int count, float alpha);
+	/*
+	* Post:
+	*	averageData[i] += alpha * (inputData[i] - averageData[i])
+	*/
+
+	void attackRelease(float * averageData, const float * inputData, int count, float attack, float release);
+	/*
+	* Post:
+	*	averageData[i] moves toward inputData[i] by attack times the difference when it rises, and by release times the difference otherwise
+	*/
+
+	// Band query kernels for SpectrumBandIndex. Every level gives the same result as the scalar version, bit for bit.
+	// SSE2 has no gather instruction, so the range queries run the scalar version below AVX2
+
+	void maximum(const float * aData, const float * bData, float * outData, int count);
+	void minimum(const float * aData, const float * bData, float * outData, int count);
+	/*
+	* Post:
+	*	outData[i] is the larger (smaller) of aData[i] and bData[i]
+	*/
+
+	void rangeSums(const double * prefixSum, const int * begins, const int * ends, float * outData, int count, bool mean);
+	/*
+	* Pre:
+	*	prefixSum[j] is the sum of the first j values, and begins[i] < ends[i] are indices into it
+	* Post:
+	*	outData[i] is the sum of values [begins[i], ends[i]), or their mean if mean is true, rounded to float
+	*/
+
+	void rangeExtremes(const float * table, int stride, const int * begins, const int * ends, float * outData, int count, bool maximum);
+	/*
+	* Pre:
+	*	Row k of table starts at table + k * stride, and holds at index j the maximum (or minimum) of the 2^k values starting at j.
+	*	begins[i] < ends[i], and ends[i] is less than 2^24
+	* Post:
+	*	outData[i] is the maximum (or minimum) of values [begins[i], ends[i]), from two overlapping lookups in one row
+	*/
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include "SpectrumPipeline.h"
+
+using namespace pipelineStages;
+
+namespace
+{
+	// Picks the stage type for a list of amplitude filters, so the common chains compile to a loop with the curve lookups inlined
+
+	template <class Before>
+	void gatherAfter(const DomainShiftTable & table, const float * inputData, float * outputData, Before before, const std::vector<AmplitudeFilter *> & after)
+	{
+		if (after.empty())
+			gather(table, inputData, outputData, before, Identity());
+		else if (after.size() == 1)
+			gather(table, inputData, outputData, before, activeCurve(after[0]));
+		else
+			gather(table, inputData, outputData, before, AmplitudeCurveList{ &after });
+	}
+
+	void gatherBeforeAfter(const DomainShiftTable & table, const float * inputData, float * outputData,
+		const std::vector<AmplitudeFilter *> & before, const std::vector<AmplitudeFilter *> & after)
+	{
+		// A domain shift on its own uses the table's SIMD gather
+		if (before.empty() && after.empty())
+			table.apply(inputData, outputData);
+		else if (before.empty())
+			gatherAfter(table, inputData, outputData, Identity(), after);
+		else if (before.size() == 1)
+			gatherAfter(table, inputData, outputData, activeCurve(before[0]), after);
+		else
+			gatherAfter(table, inputData, outputData, AmplitudeCurveList{ &before }, after);
+	}
+}
+
+SpectrumPipeline::SpectrumPipeline() :
+	SpectrumFilter()
+{
+}
+
+SpectrumPipeline::~SpectrumPipeline()
+{
+	for (Pass * pass : m_passes)
+	{
+		delete pass->outputSpectrum;
+		delete pass;
+	}
+}
+
+void SpectrumPipeline::addFilter(SpectrumFilter * filter)
+{
+	m_filters.push_back(filter);
+	compile();
+}
+
+void SpectrumPipeline::compile()
+{
+	for (Pass * pass : m_passes)
+	{
+		delete pass->outputSpectrum;
+		delete pass;
+	}
+	m_passes.clear();
+
+	for (SpectrumFilter * filter : m_filters)
+	{
+		AmplitudeFilter * amplitudeFilter = dynamic_cast<AmplitudeFilter *>(filter);
+		DomainShiftFilter * domainShiftFilter = dynamic_cast<DomainShiftFilter *>(filter);
+
+		// Point wise filters join the fused pass at the end of the chain, if there is one
+		Pass * fusedPass = (!m_passes.empty() && !m_passes.back()->filter) ? m_passes.back() : nullptr;
+		bool startsPass = !(amplitudeFilter && fusedPass) && !(domainShiftFilter && fusedPass && !fusedPass->domainShift);
+		if (startsPass)
+		{
+			Pass * pass = new Pass;
+			pass->domainShift = nullptr;
+			pass->filter = (amplitudeFilter || domainShiftFilter) ? nullptr : filter;
+			pass->outputSpectrum = pass->filter ? nullptr : new FrequencySpectrum(0);
+			m_passes.push_back(pass);
+			fusedPass = pass;
+		}
+
+		if (amplitudeFilter)
+			(fusedPass->domainShift ? fusedPass->after : fusedPass->before).push_back(amplitudeFilter);
+		else if (domainShiftFilter)
+			fusedPass->domainShift = domainShiftFilter;
+	}
+}
+
+void SpectrumPipeline::updateParameters()
+{
+	// Filters that run as their own pass update themselves in applyFilter()
+	for (Pass * pass : m_passes)
+	{
+		for (AmplitudeFilter * filter : pass->before)
+			filter->updateParameters();
+		if (pass->domainShift)
+			pass->domainShift->updateParameters();
+		for (AmplitudeFilter * filter : pass->after)
+			filter->updateParameters();
+	}
+}
+
+bool SpectrumPipeline::needsEveryHop()
+{
+	for (SpectrumFilter * filter : m_filters)
+		if (filter->needsEveryHop())
+			return true;
+	return false;
+}
+
+int SpectrumPipeline::getHistoryLength()
+{
+	int historyLength = 0;
+	for (SpectrumFilter * filter : m_filters)
+		historyLength = utl::max(historyLength, filter->getHistoryLength());
+	return historyLength;
+}
+
+const FrequencySpectrum * SpectrumPipeline::applyFilter(const FrequencySpectrum * inputSpectrum)
+{
+	return applyCoalesced(inputSpectrum, 0);
+}
+
+const FrequencySpectrum * SpectrumPipeline::applyCoalesced(const FrequencySpectrum * inputSpectrum, int numCoalescedHops)
+{
+	// Fused passes have no state, so they run once. Each filter pass coalesces the hops itself
+	updateParameters();
+	const FrequencySpectrum * spectrum = inputSpectrum;
+	for (Pass * pass : m_passes)
+		spectrum = pass->filter ? pass->filter->applyCoalesced(spectrum, numCoalescedHops) : applyFusedPass(*pass, spectrum);
+	return spectrum;
+}
+
+const FrequencySpectrum * SpectrumPipeline::getFrequencySpectrum()
+{
+	// The base output spectrum is never written. The last pass owns the output, or its filter does
+	if (m_passes.empty())
+		return m_outputSpectrum;
+	Pass * lastPass = m_passes.back();
+	return lastPass->filter ? lastPass->filter->getFrequencySpectrum() : lastPass->outputSpectrum;
+}
+
+const FrequencySpectrum * SpectrumPipeline::applyFusedPass(Pass & pass, const FrequencySpectrum * inputSpectrum)
+{
+	int outSize = pass.domainShift ? pass.domainShift->getFrequencySpectrum()->size : inputSpectrum->size;
+	if (pass.outputSpectrum->size != outSize)
+		pass.outputSpectrum->resize(outSize);
+
+	const float * inputData = inputSpectrum->data;
+	float * outputData = pass.outputSpectrum->data;
+	if (pass.domainShift)
+	{
+		const DomainShiftTable * table = pass.domainShift->getTable(inputSpectrum->size);
+		gatherBeforeAfter(*table, inputData, outputData, pass.before, pass.after);
+	}
+	else if (pass.before.size() == 1)
+		map(inputData, outputData, outSize, activeCurve(pass.before[0]));
+	else
+		map(inputData, outputData, outSize, AmplitudeCurveList{ &pass.before });
+
+	return pass.outputSpectrum;
+}
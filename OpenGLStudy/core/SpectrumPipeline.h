@@ -0,0 +1,180 @@
+#ifndef SPECTRUMPIPELINE_H
+#define SPECTRUMPIPELINE_H
+
+/*
+* Runs a chain of SpectrumFilters with fewer passes over the spectrum than calling applyFilter() on each of them.
+* Filters that work on one bin at a time (AmplitudeFilter) and the gather of a DomainShiftFilter are fused into a single loop,
+* so amplitude -> domain shift -> amplitude costs one pass and one output buffer.
+* Filters that look at neighbouring bins or earlier frames (PeakFilter, AverageFilter, and anything else) run as their own pass.
+*
+* The pipeline only reads the parameters of the filters it is given, so changing a filter's curve or factor still works the same way,
+* and picks up new parameters of the fused filters at the start of each applyFilter() like the filters themselves do.
+*
+* The stage templates in pipelineStages compose at compile time, and can be used directly where a chain is fixed.
+*/
+
+#include <vector>
+
+#include "SpectrumFilter.h"
+#include "DomainShiftTable.h"
+
+namespace pipelineStages
+{
+	struct Identity
+	{
+		float operator()(float value) const { return value; }
+	};
+
+	struct AmplitudeCurve
+	{
+		const float * curve;
+		int curveSize;
+
+		float operator()(float value) const
+		{
+			// Same lookup as AmplitudeFilter
+			return curve[(int)((curveSize - 1) * utl::clamp(value, 0.0f, 1.0f))];
+		}
+	};
+
+	inline AmplitudeCurve activeCurve(AmplitudeFilter * filter)
+	{
+		const std::vector<float> & curve = filter->getActiveParameters().curve;
+		return AmplitudeCurve{ curve.data(), (int)curve.size() };
+	}
+	/*
+	* The curve an AmplitudeFilter applies, on the thread that applies it
+	*/
+
+	struct AmplitudeCurveList
+	{
+		const std::vector<AmplitudeFilter *> * filters;
+
+		float operator()(float value) const
+		{
+			for (AmplitudeFilter * filter : *filters)
+				value = activeCurve(filter)(value);
+			return value;
+		}
+	};
+
+	template <class First, class Second>
+	struct Compose
+	{
+		First first;
+		Second second;
+
+		float operator()(float value) const { return second(first(value)); }
+	};
+
+	template <class First, class Second>
+	Compose<First, Second> compose(First first, Second second) { return Compose<First, Second>{ first, second }; }
+
+	template <class Stage>
+	void map(const float * inputData, float * outputData, int size, Stage stage)
+	{
+		for (int i = 0; i < size; i++)
+			outputData[i] = stage(inputData[i]);
+	}
+	/*
+	* outputData[i] = stage(inputData[i]). inputData and outputData can be the same buffer.
+	*/
+
+	template <class Before, class After>
+	void gather(const DomainShiftTable & table, const float * inputData, float * outputData, Before before, After after)
+	{
+		// The lerp prefix and the lerp suffix, whose pairs follow the pairs of the prefix
+		const int * indices = table.getLerpIndices();
+		const float * fractions = table.getLerpFractions();
+		int numLerpRows = table.getNumLerpRows();
+		int suffixStart = table.getSuffixStart();
+		int numPairs = numLerpRows + (table.getOutSize() - suffixStart);
+		for (int pair = 0; pair < numPairs; pair++)
+		{
+			int i = pair < numLerpRows ? pair : suffixStart + (pair - numLerpRows);
+			int j = indices[pair];
+			float pct = fractions[pair];
+			outputData[i] = after((1.0f - pct) * before(inputData[j]) + pct * before(inputData[j + 1]));
+		}
+
+		const int * rowStarts = table.getRowStarts();
+		const int * rowIndices = table.getIndices();
+		const float * weights = table.getWeights();
+		for (int i = numLerpRows; i < suffixStart; i++)
+		{
+			int row = i - numLerpRows;
+			float sum = 0.0f;
+			for (int k = rowStarts[row]; k < rowStarts[row + 1]; k++)
+				sum += before(inputData[rowIndices[k]]) * weights[k];
+			outputData[i] = after(sum);
+		}
+	}
+	/*
+	* The domain shift gather, with before applied to every input value it reads and after applied to every value it writes.
+	* Pre:
+	*	table was updated for the size of inputData. outputData has room for table.getOutSize() values
+	*/
+}
+
+class SpectrumPipeline : public SpectrumFilter
+{
+public:
+	SpectrumPipeline();
+	~SpectrumPipeline();
+
+	void addFilter(SpectrumFilter * filter);
+	/*
+	* Appends a filter to the chain. The pipeline does not take ownership of it.
+	* Pre:
+	*	The pipeline is not being applied on another thread
+	*/
+
+	const FrequencySpectrum * applyFilter(const FrequencySpectrum * inputSpectrum);
+	/*
+	* Same result as calling applyFilter() on every filter in order.
+	* The returned spectrum belongs to the pipeline, or to the last filter when that filter runs as its own pass.
+	*/
+
+	const FrequencySpectrum * applyCoalesced(const FrequencySpectrum * inputSpectrum, int numCoalescedHops);
+	/*
+	* Runs the fused passes once and passes numCoalescedHops on to the filters that run as their own pass.
+	* A filter with state after another filter with state sees the coalesced output of the earlier one every hop,
+	* not the outputs it would have had in between, so the result is close to but not the same as numCoalescedHops + 1 applyFilter() calls.
+	*/
+
+	const FrequencySpectrum * getFrequencySpectrum();
+	/*
+	* The output of the last pass, the same spectrum applyFilter() returns. Empty when the pipeline has no filters.
+	*/
+
+	void updateParameters();
+	bool needsEveryHop();
+	int getHistoryLength();
+	/*
+	* True if any filter in the pipeline needs every hop, and the longest history of any of them
+	*/
+
+	int getNumPasses() { return (int)m_passes.size(); }
+
+private:
+	struct Pass
+	{
+		std::vector<AmplitudeFilter *> before;	// applied to the input values of the pass
+		DomainShiftFilter * domainShift;		// fused gather, or nullptr for a pass of amplitude filters only
+		std::vector<AmplitudeFilter *> after;	// applied to the gathered values
+		SpectrumFilter * filter;				// a filter that runs as its own pass, in which case the fields above are empty
+		FrequencySpectrum * outputSpectrum;
+	};
+
+	void compile();
+	/*
+	* Groups m_filters into passes
+	*/
+
+	const FrequencySpectrum * applyFusedPass(Pass & pass, const FrequencySpectrum * inputSpectrum);
+
+	std::vector<SpectrumFilter *> m_filters;
+	std::vector<Pass *> m_passes;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "StereoSpectrumAnalyzer.h"
+#include "SpectrumKernels.h"
+
+StereoSpectrumAnalyzer::StereoSpectrumAnalyzer(int frameSize) :
+	m_fftSize(frameSize),
+	m_leftRingBuffer(nullptr),
+	m_rightRingBuffer(nullptr)
+{
+	// The channel spectrums live as long as the analyzer and are only resized, so their storage is reused across frame sizes
+	for (int i = 0; i < NUM_CHANNELS; i++)
+		m_channelSpectrums[i] = new FrequencySpectrum(0);
+	allocate();
+}
+
+StereoSpectrumAnalyzer::~StereoSpectrumAnalyzer()
+{
+	release();
+	for (int i = 0; i < NUM_CHANNELS; i++)
+		delete m_channelSpectrums[i];
+}
+
+void StereoSpectrumAnalyzer::setChannelRingBuffers(const AudioRingBuffer * leftRingBuffer, const AudioRingBuffer * rightRingBuffer)
+{
+	m_leftRingBuffer = leftRingBuffer;
+	m_rightRingBuffer = rightRingBuffer;
+}
+
+void StereoSpectrumAnalyzer::readFrame(const AudioRingBuffer * ringBuffer, long long frameEnd)
+{
+	(m_leftRingBuffer ? m_leftRingBuffer : ringBuffer)->read(frameEnd, m_fftSize, m_leftIn);
+	(m_rightRingBuffer ? m_rightRingBuffer : ringBuffer)->read(frameEnd, m_fftSize, m_rightIn);
+}
+
+void StereoSpectrumAnalyzer::processFrame()
+{
+	// Pack left into the real part and right into the imaginary part, then do one complex fft
+	for (int i = 0; i < m_fftSize; i++)
+	{
+		m_fftIn[i].r = m_leftIn[i];
+		m_fftIn[i].i = m_rightIn[i];
+	}
+	kiss_fft_cpx * fftOut = (kiss_fft_cpx *)FFTPlanCache::getThreadScratch(m_fftSize * 2);
+	FFTPlanCache::complexTransform(m_fftPlan, m_fftIn, fftOut);
+
+	// Separate the channels with the conjugate symmetry of real ffts, straight into all four spectrums, and scale like SpectrumAnalyzer does
+	simd::stereoSplit((const float *)fftOut, m_fftSize,
+		m_channelSpectrums[CHANNEL_LEFT]->data, m_channelSpectrums[CHANNEL_RIGHT]->data,
+		m_channelSpectrums[CHANNEL_MID]->data, m_channelSpectrums[CHANNEL_SIDE]->data,
+		m_outSize, 1.0f / (float)m_outSize);
+}
+
+void StereoSpectrumAnalyzer::setFrameSize(int frameSize)
+{
+	release();
+	m_fftSize = frameSize;
+	allocate();
+}
+
+void StereoSpectrumAnalyzer::allocate()
+{
+	m_outSize = m_fftSize / 2 + 1;
+	m_leftIn = new float[m_fftSize]();
+	m_rightIn = new float[m_fftSize]();
+	m_fftIn = new kiss_fft_cpx[m_fftSize];
+	m_fftPlan = FFTPlanCache::getInstance().getComplexPlan(m_fftSize);
+	for (int i = 0; i < NUM_CHANNELS; i++)
+		m_channelSpectrums[i]->resize(m_outSize);
+}
+
+void StereoSpectrumAnalyzer::release()
+{
+	delete[] m_leftIn;
+	delete[] m_rightIn;
+	delete[] m_fftIn;
+}
@@ -0,0 +1,73 @@
+#include "StreamBuffer.h"
+
+StreamBuffer::StreamBuffer(
+	unsigned int internalFormat,
+	unsigned int size,
+	unsigned int numChannels,
+	unsigned int bytesPerChannel) :
+	internalFormat(internalFormat),
+	size(size),
+	numChannels(numChannels),
+	bytesPerChannel(bytesPerChannel),
+	numUploads(0),
+	numUploadedBytes(0)
+{
+	glGenBuffers(1, &bufferID);
+	glGenTextures(1, &textureID);
+	resize(size);
+
+	// The texture refers to the buffer object, not its storage, so it keeps reading the buffer after it is orphaned or resized
+	glBindTexture(GL_TEXTURE_BUFFER, textureID);
+	glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, bufferID);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	glDeleteTextures(1, &textureID);
+	glDeleteBuffers(1, &bufferID);
+}
+
+void StreamBuffer::resize(int newSize)
+{
+	size = newSize;
+	dataSize = size * numChannels * bytesPerChannel;
+
+	// Start from zero instead of undefined contents
+	char * zeros = new char[dataSize]();
+	glBindBuffer(GL_TEXTURE_BUFFER, bufferID);
+	glBufferData(GL_TEXTURE_BUFFER, dataSize, zeros, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	delete[] zeros;
+}
+
+int StreamBuffer::getMaxSize()
+{
+	int maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxSize);
+	return maxSize;
+}
+
+char * StreamBuffer::getBuffer()
+{
+	// Orphan the storage the last draws read from, and map new storage for this frame
+	glBindBuffer(GL_TEXTURE_BUFFER, bufferID);
+	glBufferData(GL_TEXTURE_BUFFER, dataSize, 0, GL_STREAM_DRAW);
+	char * data = (char *)glMapBufferRange(GL_TEXTURE_BUFFER, 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return data;
+}
+
+void StreamBuffer::unmapBuffer()
+{
+	numUploads++;
+	numUploadedBytes += dataSize;
+	glBindBuffer(GL_TEXTURE_BUFFER, bufferID);
+	glUnmapBuffer(GL_TEXTURE_BUFFER);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+int StreamBuffer::bufferLength()
+{
+	return dataSize / bytesPerChannel;
+}
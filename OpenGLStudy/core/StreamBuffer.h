@@ -0,0 +1,92 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+/*
+* Streams data to a buffer texture (GL_TEXTURE_BUFFER, a samplerBuffer in glsl) every frame.
+* A buffer texture reads straight from the storage of a buffer object, so the data written into the mapped buffer
+* is what the shader reads. Unlike a StreamTexture1D, there is no copy from a pixel buffer into a texture, and no format conversion.
+*
+* Buffer textures are not limited by GL_MAX_TEXTURE_SIZE, only by GL_MAX_TEXTURE_BUFFER_SIZE (at least 65536 texels,
+* usually millions), so very large spectrums fit. They have no filtering, so shaders read them with texelFetch()
+* and interpolate between texels themselves.
+*/
+
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
+
+class StreamBuffer
+{
+public:
+	unsigned int bufferID;
+	unsigned int textureID;
+	unsigned int internalFormat;
+	unsigned int size;
+	unsigned int numChannels;
+	unsigned int bytesPerChannel;
+	unsigned int dataSize;
+
+	// Upload statistics
+	unsigned int numUploads;
+	unsigned long long numUploadedBytes;
+
+	StreamBuffer(
+		unsigned int internalFormat,
+		unsigned int size,
+		unsigned int numChannels,
+		unsigned int bytesPerChannel);
+	/*
+	* Constructor
+	* Pre:
+	*	internalFormat is a sized format that buffer textures support, for example GL_R32F or GL_RG32F
+	*	see https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexBuffer.xhtml for the list
+	*	size is the number of texels. It must be no larger than getMaxSize().
+	*	numChannels and bytesPerChannel are the same as for StreamTexture1D
+	* Post:
+	*	A buffer object of dataSize bytes and a buffer texture that reads it are generated with openGL. The buffer starts out zero.
+	*/
+
+	~StreamBuffer();
+
+	void resize(int newSize);
+	/*
+	* Pre:
+	*	The buffer is currently unmapped. newSize is no larger than getMaxSize().
+	* Post:
+	*	size and dataSize are updated, and the buffer is reallocated. The texture keeps reading it.
+	*/
+
+	static int getMaxSize();
+	/*
+	* Pre:
+	*	An openGL context is current and glad is loaded
+	* Post:
+	*	returns GL_MAX_TEXTURE_BUFFER_SIZE, the most texels a buffer texture can have
+	*/
+
+	char * getBuffer();
+	/*
+	* Maps the buffer into client memory. Buffer will have a size of dataSize.
+	* The storage is orphaned first, so this does not wait for draws that still read the last data.
+	* The contents are undefined, so the whole buffer must be written.
+	* Pre:
+	*	unmapBuffer() must be called once after the last getBuffer() call
+	* Post:
+	*	returns a pointer to the buffer.
+	*/
+
+	void unmapBuffer();
+	/*
+	* Release the pointer to the buffer.
+	* Pre:
+	*	Call this once after getBuffer() and filling the buffer with data.
+	* Post:
+	*	The data is what the buffer texture reads from the next draw on.
+	*/
+
+	int bufferLength();
+	/*
+	* Get the number of elements in the buffer (dataSize / bytesPerChannel)
+	*/
+};
+
+#endif
@@ -1,4 +1,24 @@
 #include "StreamTexture.h"
+#include "SpectrumKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Converts count float channels to the pixel type of a pixel buffer
+	void convertChannels(const float * sourceData, char * outData, int count, unsigned int type)
+	{
+		if (type == GL_HALF_FLOAT)
+			simd::floatToHalf(sourceData, (uint16_t *)outData, count);
+		else if (type == GL_UNSIGNED_BYTE)
+			simd::floatToUnorm8(sourceData, (uint8_t *)outData, count);
+		else if (type == GL_UNSIGNED_SHORT)
+			simd::floatToUnorm16(sourceData, (uint16_t *)outData, count);
+		else
+			memcpy(outData, sourceData, count * sizeof(float));
+	}
+}
 
 StreamTexture1D::StreamTexture1D(
 	unsigned int internalFormat,
@@ -13,7 +33,20 @@ StreamTexture1D::StreamTexture1D(
 	format(format),
 	type(type),
 	numChannels(numChannels),
-	bytesPerChannel(bytesPerChannel)
+	bytesPerChannel(bytesPerChannel),
+	mappedData(nullptr),
+	persistentRing(false),
+	ringBuffer(0),
+	numSlices(0),
+	sliceSize(0),
+	currentSlice(0),
+	ringData(nullptr),
+	sliceFences(nullptr),
+	numDirtyRanges(0),
+	numPendingRanges(0),
+	numUploads(0),
+	numStalls(0),
+	numUploadedBytes(0)
 {
 	// Calculate the size of the pixel buffer
 	dataSize = width * numChannels * bytesPerChannel;
@@ -51,11 +84,71 @@ StreamTexture1D::StreamTexture1D(
 
 StreamTexture1D::~StreamTexture1D()
 {
+	releaseRing();
 	glDeleteBuffersARB(1, &pbo1);
 	glDeleteBuffersARB(1, &pbo2);
 	glDeleteTextures(1, &textureID);
 }
 
+bool StreamTexture1D::persistentRingSupported()
+{
+	return GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+}
+
+bool StreamTexture1D::enablePersistentRing(unsigned int numSlices)
+{
+	if (!persistentRingSupported())
+		return false;
+	releaseRing();
+	this->numSlices = numSlices < 2 ? 2 : numSlices;
+	persistentRing = true;
+	createRing();
+
+	// A failed map leaves the orphaning pbos in use
+	if (!ringData)
+		releaseRing();
+	return persistentRing;
+}
+
+void StreamTexture1D::createRing()
+{
+	// Slices start on a 64 byte boundary, which keeps every offset aligned for any pixel type
+	sliceSize = (dataSize + 63) / 64 * 64;
+	currentSlice = 0;
+	sliceFences = new GLsync[numSlices]();
+
+	// Immutable storage, mapped once. Coherent writes are seen by the gpu without flushing,
+	// and persistent lets the buffer stay mapped while the gpu reads from it
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &ringBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)sliceSize * numSlices, 0, flags);
+	ringData = (char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)sliceSize * numSlices, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StreamTexture1D::releaseRing()
+{
+	if (!persistentRing)
+		return;
+
+	// Deleting a buffer the gpu still reads from is safe, the driver keeps the storage until the gpu is done
+	for (unsigned int i = 0; i < numSlices; i++)
+	{
+		if (sliceFences[i])
+			glDeleteSync(sliceFences[i]);
+	}
+	delete[] sliceFences;
+	sliceFences = nullptr;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &ringBuffer);
+	ringBuffer = 0;
+	ringData = nullptr;
+	persistentRing = false;
+}
+
 void StreamTexture1D::resize(int newWidth)
 {
 	// Calculate the size of the pixel buffer
@@ -65,6 +158,15 @@ void StreamTexture1D::resize(int newWidth)
 	// Bind and resize the texture
 	glBindTexture(GL_TEXTURE_1D, textureID);
 	glTexImage1D(GL_TEXTURE_1D, 0, internalFormat, width, 0, format, type, 0);
+	numPendingRanges = 0;
+
+	// Immutable storage cannot be resized, so the ring is created again
+	if (persistentRing)
+	{
+		releaseRing();
+		persistentRing = true;
+		createRing();
+	}
 
 	// Bind and resize the pbos
 	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo1);
@@ -82,7 +184,31 @@ void StreamTexture1D::resize(int newWidth)
 
 char * StreamTexture1D::getPixelBuffer()
 {
-	// Every frame data is transfered from pbo1 to the texture object,
+	numDirtyRanges = 0;
+	if (persistentRing)
+	{
+		// Move to the next slice. Its fence was placed after the last upload that read from it
+		currentSlice = (currentSlice + 1) % numSlices;
+		GLsync fence = sliceFences[currentSlice];
+		if (fence)
+		{
+			// Check without waiting first, so a wait is only counted when the gpu really is behind
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			{
+				numStalls++;
+				GLenum result;
+				do
+					result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				while (result == GL_TIMEOUT_EXPIRED);
+			}
+			glDeleteSync(fence);
+			sliceFences[currentSlice] = 0;
+		}
+		mappedData = ringData + (size_t)currentSlice * sliceSize;
+		return mappedData;
+	}
+
+	// In double buffer mode, data written to pbo2 last time is transfered from pbo1 to the texture object,
 	// while new pixel data is tranfered from the char * data pointer to pbo2
 
 	// Swap the pbos
@@ -91,14 +217,13 @@ char * StreamTexture1D::getPixelBuffer()
 	pbo1 = pbo2;
 	pbo2 = temp;
 
-	// Bind the texture and pbo1
-	glBindTexture(GL_TEXTURE_1D, textureID);
-	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo1);
-
-	// Since there is a texture and a buffer object bound, 
-	// the "data" param of glTexSubImage is an offset into the pbo, instead of a pointer to CPU memory
-	// 0 is used as an offset so that the entire buffer is copied into the texture
-	glTexSubImage1D(GL_TEXTURE_1D, 0, 0, width, format, type, 0);
+	// Copy the ranges written to pbo1. There are none with a single pbo, or when nothing was written since the last copy
+	if (numPendingRanges > 0)
+	{
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo1);
+		uploadRanges(pendingBegin, pendingEnd, numPendingRanges, 0);
+		numPendingRanges = 0;
+	}
 
 	// Bind pbo2
 	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo2);
@@ -107,23 +232,109 @@ char * StreamTexture1D::getPixelBuffer()
 	// If we just call glMapBufferARB() the CPU will stall and wait if the GPU is still working with the buffer
 	// If we call glBufferDataARB() first with a 0 pointer then this will allocate new memory for the buffer that we can use immediately
 	// Then glMapBufferARB() does not stall, and the old buffer data gets discarded once the GPU is done with it.
+	// Explicit flushing lets unmapPixelBuffer() hand only the dirty ranges back to the driver
 	glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, dataSize, 0, GL_STREAM_DRAW_ARB);
-	char * pbo2Data = (char *)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+	mappedData = (char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
 
 	// Unbind the pbo
 	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 	
-	return pbo2Data;
+	return mappedData;
+}
+
+void StreamTexture1D::writePixels(const float * sourceData, unsigned int begin, unsigned int end)
+{
+	size_t offset = (size_t)begin * numChannels * bytesPerChannel;
+	convertChannels(sourceData, mappedData + offset, (end - begin) * numChannels, type);
+	markDirty(begin, end);
+}
+
+void StreamTexture1D::markDirty(unsigned int begin, unsigned int end)
+{
+	end = std::min(end, width);
+	if (begin >= end)
+		return;
+
+	// Grow a range this one touches
+	for (int i = 0; i < numDirtyRanges; i++)
+	{
+		if (begin <= dirtyEnd[i] && end >= dirtyBegin[i])
+		{
+			dirtyBegin[i] = std::min(dirtyBegin[i], begin);
+			dirtyEnd[i] = std::max(dirtyEnd[i], end);
+			return;
+		}
+	}
+
+	// Out of ranges, so one range covers everything marked so far
+	if (numDirtyRanges == MAX_DIRTY_RANGES)
+	{
+		for (int i = 0; i < numDirtyRanges; i++)
+		{
+			begin = std::min(begin, dirtyBegin[i]);
+			end = std::max(end, dirtyEnd[i]);
+		}
+		numDirtyRanges = 0;
+	}
+	dirtyBegin[numDirtyRanges] = begin;
+	dirtyEnd[numDirtyRanges] = end;
+	numDirtyRanges++;
+}
+
+void StreamTexture1D::uploadRanges(const unsigned int * begins, const unsigned int * ends, int count, size_t bufferOffset)
+{
+	// Since there is a texture and a buffer object bound, 
+	// the "data" param of glTexSubImage is an offset into the pbo, instead of a pointer to CPU memory
+	unsigned int pixelSize = numChannels * bytesPerChannel;
+	glBindTexture(GL_TEXTURE_1D, textureID);
+	for (int i = 0; i < count; i++)
+	{
+		size_t offset = bufferOffset + (size_t)begins[i] * pixelSize;
+		glTexSubImage1D(GL_TEXTURE_1D, 0, begins[i], ends[i] - begins[i], format, type, (void *)offset);
+		numUploadedBytes += (ends[i] - begins[i]) * pixelSize;
+	}
 }
 
 void StreamTexture1D::unmapPixelBuffer()
 {
-	// Bind pbo2
-	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo2);
+	numUploads++;
+
+	// Nothing marked means the whole buffer was written
+	if (numDirtyRanges == 0)
+	{
+		dirtyBegin[0] = 0;
+		dirtyEnd[0] = width;
+		numDirtyRanges = 1;
+	}
 
-	// Release pointer to the mapping buffer
+	if (persistentRing)
+	{
+		// The slice is already visible to the gpu, so it is copied straight into the texture from its offset in the ring
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+		uploadRanges(dirtyBegin, dirtyEnd, numDirtyRanges, (size_t)currentSlice * sliceSize);
+		sliceFences[currentSlice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return;
+	}
+
+	// Bind pbo2, flush the dirty ranges, and release pointer to the mapping buffer
+	unsigned int pixelSize = numChannels * bytesPerChannel;
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo2);
+	for (int i = 0; i < numDirtyRanges; i++)
+		glFlushMappedBufferRange(GL_PIXEL_UNPACK_BUFFER, (GLintptr)dirtyBegin[i] * pixelSize, (GLsizeiptr)(dirtyEnd[i] - dirtyBegin[i]) * pixelSize);
 	glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
 
+	// A single pbo is copied now, so the data is in the texture without waiting for another getPixelBuffer() call.
+	// In double buffer mode the copy waits for the next getPixelBuffer() call, once the pbo is pbo1
+	if (pbo1 == pbo2)
+		uploadRanges(dirtyBegin, dirtyEnd, numDirtyRanges, 0);
+	else
+	{
+		std::copy(dirtyBegin, dirtyBegin + numDirtyRanges, pendingBegin);
+		std::copy(dirtyEnd, dirtyEnd + numDirtyRanges, pendingEnd);
+		numPendingRanges = numDirtyRanges;
+	}
+
 	// Unbind the PBO
 	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 }
@@ -131,4 +342,149 @@ void StreamTexture1D::unmapPixelBuffer()
 int StreamTexture1D::bufferLength()
 {
 	return dataSize / bytesPerChannel;
-}
\ No newline at end of file
+}
+
+StreamTexture2D::StreamTexture2D(
+	unsigned int internalFormat,
+	unsigned int width,
+	unsigned int numRows,
+	unsigned int format,
+	unsigned int type,
+	unsigned int numChannels,
+	unsigned int bytesPerChannel) :
+	StreamTexture2D(GL_TEXTURE_2D, internalFormat, width, numRows, 1, format, type, numChannels, bytesPerChannel)
+{
+}
+
+StreamTexture2D::StreamTexture2D(
+	unsigned int target,
+	unsigned int internalFormat,
+	unsigned int width,
+	unsigned int numRows,
+	unsigned int numLayers,
+	unsigned int format,
+	unsigned int type,
+	unsigned int numChannels,
+	unsigned int bytesPerChannel) :
+	target(target),
+	internalFormat(internalFormat),
+	width(width),
+	numRows(numRows),
+	numLayers(numLayers),
+	format(format),
+	type(type),
+	numChannels(numChannels),
+	bytesPerChannel(bytesPerChannel),
+	mappedData(nullptr),
+	numUploads(0),
+	numUploadedBytes(0)
+{
+	// Generate the texture. Rows repeat so that sampling between the oldest and newest row blends them like any other two rows
+	glGenTextures(1, &textureID);
+	glBindTexture(target, textureID);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(target, 0);
+
+	glGenBuffers(1, &pbo);
+	createStorage();
+}
+
+StreamTexture2D::~StreamTexture2D()
+{
+	glDeleteBuffers(1, &pbo);
+	glDeleteTextures(1, &textureID);
+}
+
+void StreamTexture2D::createStorage()
+{
+	// Calculate the size of one row, and of the pixel buffer that holds a row of every layer
+	rowSize = width * numChannels * bytesPerChannel;
+	dataSize = rowSize * numLayers;
+	headRow = 0;
+
+	// Start from zero instead of undefined contents, so the history fades in from silence.
+	// Rows are packed with no padding, here and in the pixel buffer, so rows whose size is not a multiple of 4 bytes
+	// (R16F, RGB8) need an unpack alignment of 1
+	char * zeros = new char[(size_t)dataSize * numRows]();
+	GLint unpackAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(target, textureID);
+	if (target == GL_TEXTURE_2D_ARRAY)
+		glTexImage3D(target, 0, internalFormat, width, numRows, numLayers, 0, format, type, zeros);
+	else
+		glTexImage2D(target, 0, internalFormat, width, numRows, 0, format, type, zeros);
+	glBindTexture(target, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+	delete[] zeros;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, dataSize, 0, GL_STREAM_DRAW);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StreamTexture2D::resize(int newWidth, int newNumRows)
+{
+	width = newWidth;
+	numRows = newNumRows;
+	createStorage();
+}
+
+char * StreamTexture2D::getRowBuffer()
+{
+	// Orphan the last row before mapping, so the gpu can still read it while the next one is written
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, dataSize, 0, GL_STREAM_DRAW);
+	mappedData = (char *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return mappedData;
+}
+
+void StreamTexture2D::writeRow(const float * sourceData)
+{
+	convertChannels(sourceData, mappedData, dataSize / bytesPerChannel, type);
+}
+
+void StreamTexture2D::pushRow()
+{
+	numUploads++;
+	numUploadedBytes += dataSize;
+	headRow = (headRow + 1) % numRows;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// Only the oldest row is replaced. For an array the layers are one row apart in the buffer,
+	// which is how a region one row high and numLayers deep is laid out when rows are not padded
+	GLint unpackAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(target, textureID);
+	if (target == GL_TEXTURE_2D_ARRAY)
+		glTexSubImage3D(target, 0, 0, headRow, 0, width, 1, numLayers, format, type, 0);
+	else
+		glTexSubImage2D(target, 0, 0, headRow, width, 1, format, type, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+int StreamTexture2D::rowLength()
+{
+	return rowSize / bytesPerChannel;
+}
+
+StreamTextureArray::StreamTextureArray(
+	unsigned int internalFormat,
+	unsigned int width,
+	unsigned int numRows,
+	unsigned int numLayers,
+	unsigned int format,
+	unsigned int type,
+	unsigned int numChannels,
+	unsigned int bytesPerChannel) :
+	StreamTexture2D(GL_TEXTURE_2D_ARRAY, internalFormat, width, numRows, numLayers, format, type, numChannels, bytesPerChannel)
+{
+}
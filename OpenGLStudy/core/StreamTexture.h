@@ -4,6 +4,22 @@
 /*
 * A class that allows efficient streaming of pixel data to openGL textures every frame
 * This uses the "streaming texture uploads" method described here: http://www.songho.ca/opengl/gl_pbo.html
+*
+* With enablePersistentRing(), uploads go through one buffer that stays mapped for the life of the texture (ARB_buffer_storage) instead.
+* It is split into a ring of slices, and a fence after each upload tells when the gpu is done reading a slice,
+* so a slice is only written again once it is free. Nothing is reallocated per upload, and the upload happens in the same frame.
+*
+* The pixel buffer holds pixels of the upload type, which can be narrower than the float data the program has.
+* writePixels() converts float data while it writes it into the buffer: to float16 for GL_HALF_FLOAT, and to normalized integers
+* for GL_UNSIGNED_BYTE and GL_UNSIGNED_SHORT. For example, a GL_R16F spectrum or a GL_RGB8 color gradient uploads
+* a half or a quarter of the bytes of the float version, and takes that much less texture cache.
+*
+* Writers can mark the ranges they changed with markDirty(). Only those ranges are flushed and copied to the texture,
+* and a texture that is not written is not copied at all, so textures that rarely change cost nothing per frame.
+*
+* StreamTexture2D and StreamTextureArray keep a history instead, for example a spectrogram. The rows of the texture are a circular buffer:
+* each upload writes one row over the oldest one and moves headRow to it, so an upload costs one row however long the history is.
+* Shaders find a row by its age relative to headRow, and wrap around the end of the texture.
 */
 
 #include "glad/glad.h"
@@ -12,6 +28,8 @@
 class StreamTexture1D
 {
 public:
+	static const int MAX_DIRTY_RANGES = 8;
+
 	unsigned int textureID;
 	unsigned int pbo1;
 	unsigned int pbo2;
@@ -23,6 +41,33 @@ public:
 	unsigned int bytesPerChannel;
 	unsigned int dataSize;
 
+	// The buffer returned by the last getPixelBuffer() call
+	char * mappedData;
+
+	// Persistent ring. Only used when persistentRing is true
+	bool persistentRing;
+	unsigned int ringBuffer;
+	unsigned int numSlices;
+	unsigned int sliceSize;
+	unsigned int currentSlice;
+	char * ringData;
+	GLsync * sliceFences;
+
+	// Dirty ranges in pixels, marked between getPixelBuffer() and unmapPixelBuffer(). No ranges means the whole buffer
+	unsigned int dirtyBegin[MAX_DIRTY_RANGES];
+	unsigned int dirtyEnd[MAX_DIRTY_RANGES];
+	int numDirtyRanges;
+
+	// Double buffer mode only. The ranges of pbo1 still to be copied to the texture by the next getPixelBuffer() call
+	unsigned int pendingBegin[MAX_DIRTY_RANGES];
+	unsigned int pendingEnd[MAX_DIRTY_RANGES];
+	int numPendingRanges;
+
+	// Upload statistics. A stall is a getPixelBuffer() call that had to wait for the gpu to finish with its slice
+	unsigned int numUploads;
+	unsigned int numStalls;
+	unsigned long long numUploadedBytes;
+
 	StreamTexture1D(
 		unsigned int internalFormat,
 		unsigned int width,
@@ -36,10 +81,13 @@ public:
 	* Pre:
 	*	internalFormat, width, format, and type are used for glTexImage1D calls
 	*	see https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage1D.xhtml for documentation
+	*	internalFormat is how the texture is stored, type is how the pixel buffer holds it. writePixels() needs type to be
+	*	GL_FLOAT, GL_HALF_FLOAT, GL_UNSIGNED_BYTE or GL_UNSIGNED_SHORT
 	*	numChannels must be the number of channels in the pixel data. For example, GL_RED has 1 channel, GL_RGB has 3 channels, etc
 	*	bytesPerChannel must be the number of bytes in the pixel type used. For example, GL_SHORT would be 2 bytes, GL_FLOAT would be 4 bytes.
 	*	set doubleBufferMode to true to use two pixel buffers instead of one. 
 	*	This will result in slightly better performace, but causes a frame of delay.
+	*	With one pixel buffer, the data is copied to the texture by unmapPixelBuffer().
 	* Post:
 	*	A new StreamTexture is created. 
 	*	A texture, and two pixel buffer objects are generated with openGL.
@@ -58,22 +106,62 @@ public:
 	*   The texture and pixel buffers are resized.
 	*/
 
+	static bool persistentRingSupported();
+	/*
+	* Pre:
+	*	An openGL context is current and glad is loaded
+	* Post:
+	*	returns true if the context has ARB_buffer_storage (core in openGL 4.4)
+	*/
+
+	bool enablePersistentRing(unsigned int numSlices);
+	/*
+	* Switches to the persistent ring backend with numSlices slices of dataSize bytes.
+	* Each slice is reused numSlices uploads later, so numSlices should cover the frames the gpu can run behind. 3 is usually enough.
+	* If numStalls keeps growing, numSlices is too small.
+	* Pre:
+	*	The pixel buffer is currently unmapped. numSlices >= 2
+	* Post:
+	*	returns true if the ring is in use. Returns false and keeps the orphaning pbos when ARB_buffer_storage is missing or the buffer cannot be mapped.
+	*/
+
 	char * getPixelBuffer();
 	/*
 	* Maps the pixel buffer into client memory. Buffer will have a size of dataSize.
+	* With the persistent ring this returns the next slice instead, after waiting for the gpu to finish with it if it has to.
+	* The contents are undefined, so every pixel in the ranges marked dirty (all of them if none are marked) must be written.
 	* Pre:
 	*	unmapPixelBuffer() must be called once after the last getPixelBuffer() call
 	* Post:
 	*	returns a pointer to a new pixel buffer.
 	*/
 
+	void writePixels(const float * sourceData, unsigned int begin, unsigned int end);
+	/*
+	* Converts pixels [begin, end) from floats to type, writes them into the mapped buffer, and marks them dirty.
+	* Pre:
+	*	Called between getPixelBuffer() and unmapPixelBuffer(). sourceData holds (end - begin) * numChannels floats.
+	*	end <= width
+	*/
+
+	void markDirty(unsigned int begin, unsigned int end);
+	/*
+	* Marks pixels [begin, end) of the mapped buffer as changed. Pixels outside every marked range keep what the texture had.
+	* Ranges that touch are merged. Past MAX_DIRTY_RANGES, the ranges are merged into the one range that covers them all.
+	* Pre:
+	*	Called between getPixelBuffer() and unmapPixelBuffer()
+	*/
+
 	void unmapPixelBuffer();
 	/*
 	* Release the pointer to the pixel buffer.
 	* Pre:
 	*	Call this once after getPixelBuffer() and filling the buffer with data.
 	* Post:
-	*	unmaps the pixel buffer
+	*	Flushes the dirty ranges and unmaps the pixel buffer.
+	*	With the persistent ring or a single pixel buffer, the ranges are copied to the texture now.
+	*	numUploadedBytes counts the bytes of the ranges once they are copied.
+	*	With the persistent ring, a fence is placed after the copy.
 	*/
 
 	int bufferLength();
@@ -84,6 +172,145 @@ public:
 	* Post:
 	*	returns datasize / bytesPerChannel
 	*/
+
+private:
+	void createRing();
+	void releaseRing();
+	/*
+	* Creates and maps the ring buffer for numSlices slices of dataSize, or unmaps and deletes it with its fences
+	*/
+
+	void uploadRanges(const unsigned int * begins, const unsigned int * ends, int count, size_t bufferOffset);
+	/*
+	* Copies pixel ranges from the bound pixel unpack buffer, starting at bufferOffset, to the same pixels of the texture
+	*/
+};
+
+class StreamTexture2D
+{
+public:
+	unsigned int textureID;
+	unsigned int pbo;
+	unsigned int target;
+	unsigned int internalFormat;
+	unsigned int width;
+	unsigned int numRows;
+	unsigned int numLayers;
+	unsigned int format;
+	unsigned int type;
+	unsigned int numChannels;
+	unsigned int bytesPerChannel;
+	unsigned int rowSize;
+	unsigned int dataSize;
+
+	// The row buffer returned by the last getRowBuffer() call
+	char * mappedData;
+
+	// The row written by the last upload. The row before it (wrapping around) is one upload older, and so on
+	unsigned int headRow;
+	unsigned int numUploads;
+	unsigned long long numUploadedBytes;
+
+	StreamTexture2D(
+		unsigned int internalFormat,
+		unsigned int width,
+		unsigned int numRows,
+		unsigned int format,
+		unsigned int type,
+		unsigned int numChannels,
+		unsigned int bytesPerChannel);
+	/*
+	* Constructor
+	* Pre:
+	*	internalFormat, format, type, numChannels, and bytesPerChannel are the same as for StreamTexture1D
+	*	width is the number of pixels in a row, and numRows is the number of rows of history
+	* Post:
+	*	A texture of width * numRows pixels and a pixel buffer object of one row are generated with openGL.
+	*	Every row starts out zero. The byte size of a row is saved in rowSize and dataSize.
+	*	The texture repeats vertically, so linear filtering between rows also works across the wrap around.
+	*/
+
+	virtual ~StreamTexture2D();
+
+	void resize(int newWidth, int newNumRows);
+	/*
+	* Pre:
+	*	The row buffer is currently unmapped.
+	* Post:
+	*	width, numRows, rowSize and dataSize are updated. The texture and pixel buffer are resized, and the history is cleared.
+	*/
+
+	char * getRowBuffer();
+	/*
+	* Maps a pixel buffer for the next row into client memory. Buffer will have a size of dataSize.
+	* The buffer is orphaned first, so this does not wait for the gpu to finish the last upload.
+	* Pre:
+	*	pushRow() must be called once after the last getRowBuffer() call
+	* Post:
+	*	returns a pointer to the new row.
+	*/
+
+	void writeRow(const float * sourceData);
+	/*
+	* Converts a whole row buffer from floats to type and writes it into the mapped row buffer, as StreamTexture1D::writePixels() does.
+	* Pre:
+	*	Called between getRowBuffer() and pushRow(). sourceData holds dataSize / bytesPerChannel floats.
+	*/
+
+	void pushRow();
+	/*
+	* Release the pointer to the row buffer, and copy it to the texture over the oldest row.
+	* Pre:
+	*	Call this once after getRowBuffer() and filling the buffer with data.
+	* Post:
+	*	headRow is the row just written. The texture is left bound.
+	*/
+
+	int rowLength();
+	/*
+	* Get the number of elements in a row of one layer (rowSize / bytesPerChannel)
+	*/
+
+protected:
+	StreamTexture2D(
+		unsigned int target,
+		unsigned int internalFormat,
+		unsigned int width,
+		unsigned int numRows,
+		unsigned int numLayers,
+		unsigned int format,
+		unsigned int type,
+		unsigned int numChannels,
+		unsigned int bytesPerChannel);
+	/*
+	* Shared by StreamTextureArray. target is GL_TEXTURE_2D with one layer, or GL_TEXTURE_2D_ARRAY
+	*/
+
+private:
+	void createStorage();
+	/*
+	* Allocates the texture and pixel buffer for the current size, and clears every row to zero
+	*/
+};
+
+class StreamTextureArray : public StreamTexture2D
+{
+public:
+	StreamTextureArray(
+		unsigned int internalFormat,
+		unsigned int width,
+		unsigned int numRows,
+		unsigned int numLayers,
+		unsigned int format,
+		unsigned int type,
+		unsigned int numChannels,
+		unsigned int bytesPerChannel);
+	/*
+	* Constructor
+	* A GL_TEXTURE_2D_ARRAY of numLayers layers that share one circular buffer of rows, for example one layer per stereo channel.
+	* The row buffer holds one row of every layer, layer 0 first, so dataSize is rowSize * numLayers.
+	* pushRow() copies the rows of all layers with a single upload.
+	*/
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads) :
+	m_task(nullptr),
+	m_count(0),
+	m_nextIndex(0),
+	m_busyWorkers(0),
+	m_generation(0),
+	m_stopping(false)
+{
+	if (numThreads <= 0)
+		numThreads = (int)std::thread::hardware_concurrency();
+	if (numThreads <= 0)
+		numThreads = 1;
+
+	// The thread that calls parallelFor() also does work, so it counts as one of the threads
+	for (int i = 0; i < numThreads - 1; i++)
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_workCondition.notify_all();
+	for (std::thread & worker : m_workers)
+		worker.join();
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)> & task)
+{
+	if (count <= 0)
+		return;
+
+	// Post the work and wake the workers
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_nextIndex.store(0);
+		m_busyWorkers = (int)m_workers.size();
+		m_generation++;
+	}
+	m_workCondition.notify_all();
+
+	// Work alongside the workers, then wait for the ones that are still finishing their last index
+	runTasks();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this] { return m_busyWorkers == 0; });
+	m_task = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+	unsigned int lastGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workCondition.wait(lock, [&] { return m_stopping || m_generation != lastGeneration; });
+			if (m_stopping)
+				return;
+			lastGeneration = m_generation;
+		}
+
+		runTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_busyWorkers--;
+		}
+		m_doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::runTasks()
+{
+	// Indices are handed out one at a time, so uneven tasks balance themselves across the threads
+	for (int i = m_nextIndex.fetch_add(1); i < m_count; i = m_nextIndex.fetch_add(1))
+		(*m_task)(i);
+}
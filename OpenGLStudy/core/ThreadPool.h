@@ -0,0 +1,63 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/*
+* A fixed set of worker threads for data parallel loops.
+* parallelFor() hands out indices to the workers and the calling thread, and returns once every index has been processed.
+*/
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+class ThreadPool
+{
+public:
+	ThreadPool(int numThreads = 0);
+	/*
+	* Constructor
+	* Pre:
+	*	numThreads is the total number of threads that run a parallelFor(), including the calling thread.
+	*	0 uses one thread per hardware thread.
+	* Post:
+	*	numThreads - 1 worker threads are started and wait for work.
+	*/
+
+	~ThreadPool();
+
+	int getNumThreads() { return (int)m_workers.size() + 1; }
+
+	void parallelFor(int count, const std::function<void(int)> & task);
+	/*
+	* Runs task(i) for every i in [0, count) across the worker threads and the calling thread.
+	* Pre:
+	*	Only one thread calls parallelFor() at a time. task is safe to call concurrently.
+	* Post:
+	*	task has been called once for every index
+	*/
+
+private:
+	void workerLoop();
+	void runTasks();
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_workCondition;
+	std::condition_variable m_doneCondition;
+
+	// State of the current parallelFor(). m_generation changes every time new work is posted
+	const std::function<void(int)> * m_task;
+	int m_count;
+	std::atomic<int> m_nextIndex;
+	int m_busyWorkers;
+	unsigned int m_generation;
+	bool m_stopping;
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool & operator=(const ThreadPool &) = delete;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+/*
+* A wait-free triple buffer for handing the newest value from one producer thread to one consumer thread.
+* The producer fills the write buffer and publishes it, the consumer picks up the newest published buffer.
+* Neither side ever blocks, and the consumer always sees a complete value. Values that are published
+* faster than the consumer reads them are simply replaced by newer ones.
+*/
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer();
+
+	T & getWriteBuffer() { return m_buffers[m_writeIndex]; }
+	/*
+	* Producer only. Returns the buffer that will be published by the next publish() call.
+	* The contents are whatever was in the buffer the last time it was swapped in, so it must be fully overwritten.
+	*/
+
+	void publish();
+	/*
+	* Producer only. Makes the write buffer the newest value and takes a free buffer as the new write buffer.
+	*/
+
+	bool update();
+	/*
+	* Consumer only. Swaps in the newest published buffer if there is one.
+	* Returns true if the read buffer changed.
+	*/
+
+	T & getReadBuffer() { return m_buffers[m_readIndex]; }
+	/*
+	* Consumer only. Returns the buffer picked up by the last update() call
+	*/
+
+private:
+	// The middle index holds the buffer that is waiting to be picked up by the consumer.
+	// The dirty bit is set when it holds a value that the consumer has not seen yet.
+	static const int DIRTY_BIT = 4;
+	static const int INDEX_MASK = 3;
+
+	T m_buffers[3];
+	int m_writeIndex;
+	int m_readIndex;
+	std::atomic<int> m_middleIndex;
+
+	TripleBuffer(const TripleBuffer &) = delete;
+	TripleBuffer & operator=(const TripleBuffer &) = delete;
+};
+
+// TEMPLATE DEFINTIONS
+
+template <class T>
+TripleBuffer<T>::TripleBuffer() :
+	m_writeIndex(0),
+	m_readIndex(1),
+	m_middleIndex(2)
+{
+}
+
+template <class T>
+void TripleBuffer<T>::publish()
+{
+	// acq_rel: release the written data to the consumer, and acquire the buffer the consumer gave back
+	int oldMiddle = m_middleIndex.exchange(m_writeIndex | DIRTY_BIT, std::memory_order_acq_rel);
+	m_writeIndex = oldMiddle & INDEX_MASK;
+}
+
+template <class T>
+bool TripleBuffer<T>::update()
+{
+	if (!(m_middleIndex.load(std::memory_order_relaxed) & DIRTY_BIT))
+		return false;
+
+	// Exchanging clears the dirty bit, since the read index is stored without it
+	int oldMiddle = m_middleIndex.exchange(m_readIndex, std::memory_order_acq_rel);
+	m_readIndex = oldMiddle & INDEX_MASK;
+	return true;
+}
+
+#endif
@@ -1,5 +1,11 @@
 #include <loopback.h>
 
+#ifdef _WIN32
+
+#include <Audioclient.h>
+#include <audiopolicy.h>
+#include <mmdeviceapi.h>
+
 int loopback_initialized = 0;
 IAudioCaptureClient * pAudioCaptureClient;
 WAVEFORMATEX * pwfx;
@@ -40,7 +46,7 @@ int loopback_init()
 	return 0;
 }
 
-int loopback_getSound(float * soundBuffer, int bufferSize)
+int loopback_getSound(AudioRingBuffer * ringBuffer, AudioRingBuffer * leftRingBuffer, AudioRingBuffer * rightRingBuffer)
 {
 	if (!loopback_initialized)
 		return 0;
@@ -64,30 +70,46 @@ int loopback_getSound(float * soundBuffer, int bufferSize)
 		int numFloats =  (numBytes / sizeof(float)) / pwfx->nChannels;
 		totalSamples += numFloats;
 
-		// Shift contents of buffer to the front to make room for the new samples
-		for (int i = 0; i < (bufferSize - numFloats); i++)
-			soundBuffer[i] = soundBuffer[i + numFloats];
+		// Get the space for the new samples at the back of the ring buffer. 
+		// This is at most two spans, and if the packet is larger than the ring buffer only the newest samples are kept
+		float * spans[2];
+		int spanSizes[2];
+		int numSamples = ringBuffer->getWriteSpans(numFloats, &spans[0], &spanSizes[0], &spans[1], &spanSizes[1]);
+		float * packetFrame = packetBuffer + (numFloats - numSamples) * pwfx->nChannels;
 
-		// Copy in the new audio samples to the back of the audio buffer
-		for (int i = 0; i < min(bufferSize, numFloats); i++)
+		// Mix the channels down to mono and write the samples directly into the ring buffer
+		for (int s = 0; s < 2; s++)
 		{
-			float & sample = soundBuffer[bufferSize - i - 1];
-			sample = 0.0;
-			for (int ch = 0; ch < pwfx->nChannels; ch++)
-				sample += packetBuffer[(numFloats - i - 1) * pwfx->nChannels + ch];
-			sample /= pwfx->nChannels;
+			for (int i = 0; i < spanSizes[s]; i++)
+			{
+				float sample = 0.0f;
+				for (int ch = 0; ch < pwfx->nChannels; ch++)
+					sample += packetFrame[ch];
+				spans[s][i] = sample / pwfx->nChannels;
+				packetFrame += pwfx->nChannels;
+			}
 		}
+		ringBuffer->commitWrite(numSamples);
 
-		/*
-		for (int i = 0; i < numFloats; i++)
+		// Deinterleave the first two channels into their own ring buffers
+		AudioRingBuffer * channelRingBuffers[2] = { leftRingBuffer, rightRingBuffer };
+		for (int c = 0; c < 2; c++)
 		{
-			float & sample = soundBuffer[bufferSize - numFloats + i];
-			sample = 0.0;
-			for (int c = 0; c < pwfx->nChannels; c++)
-				sample += packetBuffer[i * pwfx->nChannels + c];
-			sample /= pwfx->nChannels;
+			if (!channelRingBuffers[c])
+				continue;
+			int channel = c < pwfx->nChannels ? c : 0;
+			channelRingBuffers[c]->getWriteSpans(numSamples, &spans[0], &spanSizes[0], &spans[1], &spanSizes[1]);
+			packetFrame = packetBuffer + (numFloats - numSamples) * pwfx->nChannels + channel;
+			for (int s = 0; s < 2; s++)
+			{
+				for (int i = 0; i < spanSizes[s]; i++)
+				{
+					spans[s][i] = *packetFrame;
+					packetFrame += pwfx->nChannels;
+				}
+			}
+			channelRingBuffers[c]->commitWrite(numSamples);
 		}
-		*/
 
 		// Release the buffer
 		hr = pAudioCaptureClient->ReleaseBuffer(numFramesToRead);
@@ -100,3 +122,32 @@ int loopback_samplesPerSec()
 {
 	return pwfx->nSamplesPerSec;
 }
+
+int loopback_numChannels()
+{
+	return pwfx->nChannels;
+}
+
+#else
+
+int loopback_init()
+{
+	return -1;
+}
+
+int loopback_getSound(AudioRingBuffer * /*ringBuffer*/, AudioRingBuffer * /*leftRingBuffer*/, AudioRingBuffer * /*rightRingBuffer*/)
+{
+	return 0;
+}
+
+int loopback_samplesPerSec()
+{
+	return 0;
+}
+
+int loopback_numChannels()
+{
+	return 0;
+}
+
+#endif
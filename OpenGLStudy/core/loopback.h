@@ -6,15 +6,27 @@
 // https://msdn.microsoft.com/en-us/library/windows/desktop/dd371399(v=vs.85).aspx < IMMDeviceEnumerator
 // https://msdn.microsoft.com/en-us/library/windows/desktop/ms686615(v=vs.85).aspx < CoCreateInstance
 
+// Loopback capture uses WASAPI and is only available on Windows.
+// On other platforms loopback_init() fails and no samples are ever captured.
+
 #include <iostream>
-#include <Audioclient.h>
-#include <audiopolicy.h>
-#include <mmdeviceapi.h>
+
+#include "AudioRingBuffer.h"
 
 int loopback_init();
+/*
+* Starts capturing the default render device. Returns 0 on success.
+*/
 
-int loopback_getSound(float * soundBuffer, int bufferSize);
+int loopback_getSound(AudioRingBuffer * ringBuffer, AudioRingBuffer * leftRingBuffer = nullptr, AudioRingBuffer * rightRingBuffer = nullptr);
+/*
+* Reads all available audio packets, mixes them down to mono, and appends the samples to ringBuffer.
+* If leftRingBuffer and rightRingBuffer are given, the first two channels are also appended to them (the first channel to both for mono devices).
+* Returns the number of new samples.
+*/
 
 int loopback_samplesPerSec();
 
+int loopback_numChannels();
+
 #endif
\ No newline at end of file
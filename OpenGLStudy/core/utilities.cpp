@@ -1,4 +1,8 @@
 #include "utilities.h"
+#include "FFTPlanCache.h"
+#include "SpectrumKernels.h"
+
+#include <cstring>
 
 namespace utl
 {
@@ -46,46 +50,73 @@ namespace utl
 
 	void fft(float * inBuffer, float * outBuffer, unsigned int size)
 	{
-		// Declarations and initialize cfg
-		static bool fftInit = false;
-		static int lastSize = 0;
-		static kiss_fft_cpx * fout;
-		static kiss_fftr_cfg cfg;
-
 		// outSize for a real only fft
 		int outSize = size / 2 + 1;
 
-		// initialize an outbuffer and the kissft config object the first time this function is called
-		if (!fftInit)
-		{
-			fftInit = true;
-			lastSize = size;
-			fout = new kiss_fft_cpx[outSize];
-			cfg = kiss_fftr_alloc(size, 0, NULL, NULL);
-		}
+		// The plan is shared and the output goes in this thread's scratch buffer, so this is safe to call from any thread
+		const FFTPlan * plan = FFTPlanCache::getInstance().getRealPlan(size);
+		kiss_fft_cpx * fout = (kiss_fft_cpx *)FFTPlanCache::getThreadScratch(outSize * 2);
+
+		// Do the real only fft
+		FFTPlanCache::realForward(plan, inBuffer, fout);
+
+		// copy magnitude of output into the outBuffer
+		simd::complexMagnitude((float *)fout, outBuffer, outSize, 1.0f / (float)outSize);
+	}
 
-		// reinitialize buffer and cfg if the size of the fft ever changes
-		if (size != lastSize)
+	unsigned short floatToHalf(float value)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(float));
+		unsigned int sign = (bits >> 16) & 0x8000;
+		unsigned int absBits = bits & 0x7FFFFFFF;
+
+		// NaN stays NaN, and anything too large for a half becomes infinity
+		if (absBits > 0x7F800000)
+			return (unsigned short)(sign | 0x7E00);
+		if (absBits >= 0x477FF000)
+			return (unsigned short)(sign | 0x7C00);
+
+		// Values below the smallest normal half become denormals. 
+		// Adding 0.5 shifts the mantissa into place and the float add does the rounding
+		if (absBits < 0x38800000)
 		{
-			lastSize = size;
-			delete[] fout;
-			free(cfg);
-			fout = new kiss_fft_cpx[outSize];
-			cfg = kiss_fftr_alloc(size, 0, NULL, NULL);
+			float absValue;
+			memcpy(&absValue, &absBits, sizeof(float));
+			absValue += 0.5f;
+			unsigned int denormBits;
+			memcpy(&denormBits, &absValue, sizeof(float));
+			return (unsigned short)(sign | (denormBits - 0x3F000000));
 		}
 
-		kiss_fft_scalar * fin = (kiss_fft_scalar *)inBuffer;
-
-		// Do the real only fft
-		kiss_fftr(cfg, fin, fout);
+		// Rebias the exponent from 127 to 15 and round the mantissa to nearest even
+		unsigned int mantissaOdd = (absBits >> 13) & 1;
+		absBits += 0xC8000FFF + mantissaOdd;
+		return (unsigned short)(sign | (absBits >> 13));
+	}
 
-		// copy magnitude of output into the outBuffer
-		for (int i = 0; i < outSize; i++)
+	float halfToFloat(unsigned short value)
+	{
+		unsigned int sign = (unsigned int)(value & 0x8000) << 16;
+		unsigned int exponent = (value >> 10) & 0x1F;
+		unsigned int mantissa = value & 0x3FF;
+		unsigned int bits;
+
+		if (exponent == 0x1F)
+			bits = sign | 0x7F800000 | (mantissa << 13);
+		else if (exponent != 0)
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		else
 		{
-			float rl = fout[i].r;
-			float im = fout[i].i;
-			outBuffer[i] = sqrt(rl * rl + im * im) / (float)outSize;
+			// Denormals are exactly representable as mantissa * 2^-24
+			float denormal = (float)mantissa * (1.0f / 16777216.0f);
+			memcpy(&bits, &denormal, sizeof(float));
+			bits |= sign;
 		}
+
+		float result;
+		memcpy(&result, &bits, sizeof(float));
+		return result;
 	}
 
 	void linearPeaks(float * data, int dataSize, float peakRadius)
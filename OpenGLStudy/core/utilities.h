@@ -4,6 +4,7 @@
 #include "glm/glm.hpp"
 #include "kissfft/kiss_fft.h"
 #include "kissfft/kiss_fftr.h"
+#include "DomainShiftTable.h"
 
 namespace utl
 {
@@ -92,6 +93,20 @@ namespace utl
 	*	outBuffer contains magnitude of the frequency domain of the signal
 	*/
 
+	unsigned short floatToHalf(float value);
+	/*
+	* Converts a 32 bit float to a 16 bit IEEE half float, rounding to nearest even
+	* Pre:
+	*	None. Values too large for a half become infinity, values too small become zero or a denormal.
+	* Post:
+	*	returns the bits of the half float
+	*/
+
+	float halfToFloat(unsigned short value);
+	/*
+	* Converts the bits of a 16 bit IEEE half float back to a 32 bit float
+	*/
+
 	void linearPeaks(float * data, int dataSize, float blurRadius);
 	/*
 	*/
@@ -149,12 +164,10 @@ namespace utl
 	template <class T>
 	void expDomainShift(T * inBuffer, int inSize, T * outBuffer, int outSize, float exponent)
 	{
-		for (int i = 0; i < outSize; i++)
-		{
-			float t = (float)i / (float)(outSize - 1);
-			t = 1.0f - pow(1.0f - t, exponent);
-			outBuffer[i] = getValueLerp(inBuffer, inSize, t);
-		}
+		// The table is only rebuilt when the exponent or a size changes between calls on the same thread
+		thread_local DomainShiftTable table;
+		table.update(exponent, inSize, outSize);
+		table.applyGeneric(inBuffer, outBuffer);
 	}
 }
 
@@ -5,6 +5,8 @@ int textures();
 int sphereParticles();
 int audioVisualizer();
 int fluidSimulation();
+int spectrogramBatch();
+int spectrumBenchmark();
 
 int main()
 {
@@ -14,12 +14,17 @@
 #include "imgui_color_gradient.h"
 
 #include "Shader.h"
+#include "StreamBuffer.h"
 #include "StreamTexture.h"
 #include "SceneManager.h"
 
-#include "loopback.h"
-#include "SpectrumAnalyzer.h"
+#include "AudioAnalysisThread.h"
+#include "ConstantQAnalyzer.h"
+#include "MultiResolutionAnalyzer.h"
+#include "ThreadPool.h"
+#include "FFTPlanCache.h"
 #include "SpectrumFilter.h"
+#include "SpectrumPipeline.h"
 
 int audioVisualizer()
 {
@@ -93,11 +98,10 @@ int audioVisualizer()
 	glEnableVertexAttribArray(1);
 
 	
-	// Setup SpectrumAnalyzer and set default filter settings
+	// Default analysis and filter settings
 	int numSpectrumsInAverage = 18;
 	int numFreqBins = 1024;
 	float domainShiftFactor = 10.0f;
-	SpectrumAnalyzer analyzer = SpectrumAnalyzer(4096);
 
 	// Constant sizes
 	const int bezierCurveSize = 4096;
@@ -105,10 +109,28 @@ int audioVisualizer()
 	const int soundTextureSize = 1024;
 
 	// initialize stream textures
-	StreamTexture1D * soundTexture = new StreamTexture1D(GL_R32F, soundTextureSize, GL_RED, GL_FLOAT, 1, 4, true);
-	StreamTexture1D * frequencyTexture = new StreamTexture1D(GL_R32F, numFreqBins, GL_RED, GL_FLOAT, 1, 4, true);
-	StreamTexture1D * frequencyColorCurve = new StreamTexture1D(GL_RGB32F, gradientSize, GL_RGB, GL_FLOAT, 3, 4, false);
-	StreamTexture1D * lightColorCurve = new StreamTexture1D(GL_RGB32F, gradientSize, GL_RGB, GL_FLOAT, 3, 4, false);
+	// The audio and spectrum are stored as float16 and the gradients as 8 bit colors. writePixels() converts the float data while uploading it
+	StreamTexture1D * soundTexture = new StreamTexture1D(GL_R16F, soundTextureSize, GL_RED, GL_HALF_FLOAT, 1, 2, true);
+	StreamTexture1D * frequencyTexture = new StreamTexture1D(GL_RG16F, numFreqBins, GL_RG, GL_HALF_FLOAT, 2, 2, true);
+	StreamTexture1D * frequencyColorCurve = new StreamTexture1D(GL_RGB8, gradientSize, GL_RGB, GL_UNSIGNED_BYTE, 3, 1, false);
+	StreamTexture1D * lightColorCurve = new StreamTexture1D(GL_RGB8, gradientSize, GL_RGB, GL_UNSIGNED_BYTE, 3, 1, false);
+
+	// Float data for the textures, before it is converted
+	float * soundPixels = new float[soundTextureSize];
+	float * frequencyPixels = new float[numFreqBins * 2]();
+	glm::vec3 gradientColors[gradientSize];
+
+	// The textures written every frame upload through a persistent mapped ring when the driver supports it, without a frame of delay
+	soundTexture->enablePersistentRing(3);
+	frequencyTexture->enablePersistentRing(3);
+
+	// Spectrogram history. One row of the frequency texture is added per new spectrum over the oldest row, so the upload stays one row
+	// however many rows of history are shown
+	int spectrogramRows = 512;
+	StreamTexture2D * spectrogramTexture = new StreamTexture2D(GL_RG16F, numFreqBins, spectrogramRows, GL_RG, GL_HALF_FLOAT, 2, 2);
+
+	// The spectrum can also go to a buffer texture, which the shader reads without a copy into a texture, and which is not limited by the max texture size
+	StreamBuffer * frequencyBuffer = new StreamBuffer(GL_RG32F, numFreqBins, 2, 4);
 
 	// initialize frequency amplitude curve
 	float * frequencyAmplitudeCurve = new float[bezierCurveSize]();
@@ -119,24 +141,74 @@ int audioVisualizer()
 
 	// initialize peak smoothing curve
 	float peakRadius = 0.04f;
+	// The curve is allocated once for the largest blur radius, so changing the radius never allocates
+	const float maxPeakRadius = 0.1f;
+	const int peakCurveCapacity = (int)((float)numFreqBins * maxPeakRadius) + 1;
 	int peakCurveSize = (int)((float)numFreqBins * peakRadius);
-	float * peakCurve = new float[peakCurveSize]();
+	float * peakCurve = new float[peakCurveCapacity]();
 	ImVec2 peakControlPoints[2] = { { 1.00f, 0.00f },{ 0.35f, 1.00f } };
 	glm::vec2 peakCurvePoints[bezierCurveSize];
 	utl::bezierTable((glm::vec2 *)peakControlPoints, peakCurvePoints, bezierCurveSize);
 	utl::curve2Dto1D(peakCurvePoints, bezierCurveSize, peakCurve, peakCurveSize);
 
-	// Initialize spectrum filters
-	AmplitudeFilter amplitudeFilter(frequencyAmplitudeCurve, bezierCurveSize);
-	DomainShiftFilter domainShiftFilter(domainShiftFactor, numFreqBins);
-	PeakFilter peakFilter(peakCurve, peakCurveSize);
-	AverageFilter averageFilter(numSpectrumsInAverage);
+	// Initialize spectrum filters. There is one chain for the mono (mid) spectrum, and one each for the left and right channels
+	const int numFilterChains = 3;
+	AmplitudeFilter * amplitudeFilters[numFilterChains];
+	DomainShiftFilter * domainShiftFilters[numFilterChains];
+	PeakFilter * peakFilters[numFilterChains];
+	AverageFilter * averageFilters[numFilterChains];
+	SpectrumPipeline * filterPipelines[numFilterChains];
+	for (int i = 0; i < numFilterChains; i++)
+	{
+		amplitudeFilters[i] = new AmplitudeFilter(frequencyAmplitudeCurve, bezierCurveSize);
+		domainShiftFilters[i] = new DomainShiftFilter(domainShiftFactor, numFreqBins);
+		peakFilters[i] = new PeakFilter(peakCurve, peakCurveSize, peakCurveCapacity);
+		averageFilters[i] = new AverageFilter(numSpectrumsInAverage);
+
+		// The amplitude curve and the domain shift run fused in one pass, peak runs after it.
+		// The average follows the pipeline as its own filter, so with lazy filters the pipeline only runs for spectrums that are displayed
+		filterPipelines[i] = new SpectrumPipeline();
+		filterPipelines[i]->addFilter(amplitudeFilters[i]);
+		filterPipelines[i]->addFilter(domainShiftFilters[i]);
+		filterPipelines[i]->addFilter(peakFilters[i]);
+	}
 
-	// Setup loopback audio capture
-	loopback_init();
-	int frameGap = 128;
-	int numAudioSamples = analyzer.getFrameSize() * 2;
-	float * audioBuffer = new float[numAudioSamples]();
+	// Setup audio capture and analysis on its own thread
+	// The ring buffer is sized for the largest frame size allowed in the settings, so changing the frame size never reallocates it
+	const int maxFrameSize = 65536;
+	LoopbackAudioSource audioSource;
+	AudioAnalysisThread analysisThread(&audioSource, 4096, 128, maxFrameSize);
+	analysisThread.addFilter(filterPipelines[0]);
+	analysisThread.addFilter(averageFilters[0]);
+
+	// Stereo capture costs one complex fft instead of a real one, and feeds the left/right split view.
+	// The channels are always captured, but only analyzed while the split view is on
+	analysisThread.enableStereo();
+	StereoSpectrumAnalyzer::Channel stereoChannels[2] = { StereoSpectrumAnalyzer::CHANNEL_LEFT, StereoSpectrumAnalyzer::CHANNEL_RIGHT };
+	for (int i = 0; i < 2; i++)
+	{
+		analysisThread.addChannelFilter(stereoChannels[i], filterPipelines[i + 1]);
+		analysisThread.addChannelFilter(stereoChannels[i], averageFilters[i + 1]);
+	}
+	bool stereoSplit = false;
+	analysisThread.setStereoAnalysis(stereoSplit);
+	analysisThread.start();
+	const AudioRingBuffer * audioRingBuffer = analysisThread.getRingBuffer();
+	int numAudioSamples = analysisThread.getFrameSize() * 2;
+
+	// Alternative analyzers that can replace the fft from the settings window.
+	// Constant Q analysis produces log spaced bins directly, so it also replaces the domain shift filter.
+	// The multi resolution bank runs long frames for the bass and short frames for the treble.
+	// Its bands only go to the worker threads once the frame size is raised far enough for their ffts to outweigh waking the workers
+	int analysisSampleRate = analysisThread.getSampleRate() > 0 ? analysisThread.getSampleRate() : 48000;
+	ConstantQAnalyzer constantQAnalyzer(analysisThread.getFrameSize(), analysisSampleRate, 20.0f, 20000.0f, numFreqBins);
+	ThreadPool analysisThreadPool(3);
+	MultiResolutionAnalyzer multiResolutionAnalyzer(analysisSampleRate, &analysisThreadPool);
+	multiResolutionAnalyzer.addBand(8192, 1024, 300.0f);
+	multiResolutionAnalyzer.addBand(2048, 256, 2500.0f);
+	multiResolutionAnalyzer.addBand(512, 128, (float)analysisSampleRate);
+	FrequencyAnalyzer * analyzers[3] = { nullptr, &constantQAnalyzer, &multiResolutionAnalyzer };
+	int analyzerType = 0;
 
 	// initialize frequency color gradient
 	ImGradient frequencyGradient;
@@ -145,15 +217,14 @@ int audioVisualizer()
 	frequencyGradient.addMark(0.25f, ImColor(0xFF, 0x26, 0x26));
 	frequencyGradient.addMark(0.5f, ImColor(0xEE, 0xBF, 0x1B));
 	frequencyGradient.addMark(1.0f, ImColor(0xFF, 0xF1, 0xAD));
-	glm::vec3 * freqColors = (glm::vec3 *)frequencyColorCurve->getPixelBuffer();
 	int numColors = frequencyColorCurve->width;
 	for (int i = 0; i < numColors; i++)
 	{
 		ImVec4 color = frequencyGradient.getColorAt((float)i / (float)(numColors - 1));
-		freqColors[i] = glm::vec3(color.x, color.y, color.z);
+		gradientColors[i] = glm::vec3(color.x, color.y, color.z);
 	}
-	frequencyColorCurve->unmapPixelBuffer();
-	frequencyColorCurve->getPixelBuffer(); // bug workadound. StreamTexture doesnt initialize properly without this
+	frequencyColorCurve->getPixelBuffer();
+	frequencyColorCurve->writePixels((float *)gradientColors, 0, numColors);
 	frequencyColorCurve->unmapPixelBuffer();
 
 	// initialize light gradient
@@ -162,15 +233,14 @@ int audioVisualizer()
 	lightGradient.addMark(0.0f, ImColor(0x00, 0x00, 0x00));
 	lightGradient.addMark(0.8f, ImColor(0x33, 0x33, 0x33));
 	lightGradient.addMark(1.0f, ImColor(0xFF, 0xFF, 0xFF));
-	glm::vec3 * lightColors = (glm::vec3 *)lightColorCurve->getPixelBuffer();
 	numColors = lightColorCurve->width;
 	for (int i = 0; i < numColors; i++)
 	{
 		ImVec4 color = lightGradient.getColorAt((float)i / (float)(numColors - 1));
-		lightColors[i] = glm::vec3(color.x, color.y, color.z);
+		gradientColors[i] = glm::vec3(color.x, color.y, color.z);
 	}
-	lightColorCurve->unmapPixelBuffer();
 	lightColorCurve->getPixelBuffer();
+	lightColorCurve->writePixels((float *)gradientColors, 0, numColors);
 	lightColorCurve->unmapPixelBuffer();
 
 	// tell opengl for each sampler to which texture unit it belongs to
@@ -179,6 +249,8 @@ int audioVisualizer()
 	audioShader.setInt("frequencyTexture", frequencyTexture->textureID);
 	audioShader.setInt("frequencyColorCurve", frequencyColorCurve->textureID);
 	audioShader.setInt("lightColorCurve", lightColorCurve->textureID);
+	audioShader.setInt("spectrogramTexture", 5);
+	audioShader.setInt("frequencyBuffer", 6);
 
 	// Main loop
 	sceneManager->newFrame();
@@ -192,51 +264,151 @@ int audioVisualizer()
 		// Debug window
 		ImGui::Begin("Settings");
 		static float lightHeight = 0.0f;
+		static bool showSpectrogram = true;
+		static bool useFrequencyBuffer = false;
 		{
 			ImGui::PushItemWidth(-190);
 
 			// Control audio frame size size with arrow buttons
-			int ival = analyzer.getFrameSize();
-			if (ImGui::expArrowButtons("audio frame size: %d", &ival, 2, 65536))
+			int frameSize = numAudioSamples / 2;
+			int ival = frameSize;
+			if (ImGui::expArrowButtons("audio frame size: %d", &ival, 2, maxFrameSize))
 			{
-				analyzer.setFrameSize(ival);
-				numAudioSamples = ival * 2;
-				delete[] audioBuffer;
-				audioBuffer = new float[numAudioSamples]();
+				frameSize = ival;
+				analysisThread.setFrameSize(frameSize);
+				numAudioSamples = frameSize * 2;
 			}
 			ImGui::SameLine(); ImGui::ShowHelpMarker("Number of audio samples used in the fourier transform.\nHigher values have more frequency information, but less time information.");
 
 			// Control audio frame rate with arrow buttons
-			int audioFPS = loopback_samplesPerSec() / frameGap;
+			int sampleRate = analysisThread.getSampleRate();
+			int frameGap = analysisThread.getFrameGap();
+			int audioFPS = sampleRate / frameGap;
 			if (ImGui::SliderInt("audio frames per sec", &audioFPS, 20, 600))
 			{
 				audioFPS = utl::clamp(audioFPS, 1, 3000);
-				frameGap = loopback_samplesPerSec() / audioFPS;
+				frameGap = sampleRate / audioFPS;
+				analysisThread.setFrameGap(frameGap);
 			}
 			ImGui::SameLine(); ImGui::ShowHelpMarker("Controls how many fourier transforms happen per second.\nThis is essentially the framerate of the frequency spectrum.");
 
 			// Control number of audio frames with a slider
-			ival = averageFilter.getNumSpectrumsInAverage();
+			ival = averageFilters[0]->getNumSpectrumsInAverage();
 			if (ImGui::SliderInt("audio frames used", &ival, 1, 40))
-				averageFilter.setNumSpectrumsInAverage(utl::clamp(ival, 1, 200));
+			{
+				for (int i = 0; i < numFilterChains; i++)
+					averageFilters[i]->setNumSpectrumsInAverage(utl::clamp(ival, 1, 200));
+			}
 			ImGui::SameLine(); ImGui::ShowHelpMarker("The final displayed frequency spectrum is an average of this many spectrums.\nRaise to increase smoothness.");
 
+			// Choose how spectrums are averaged over time
+			int averageMode = (int)averageFilters[0]->getAverageMode();
+			if (ImGui::Combo("average mode", &averageMode, "moving\0exponential\0attack / release\0"))
+			{
+				for (int i = 0; i < numFilterChains; i++)
+					averageFilters[i]->setAverageMode((AverageFilter::AverageMode)averageMode);
+			}
+			ImGui::SameLine(); ImGui::ShowHelpMarker("moving: the mean of the last audio frames.\
+				\nexponential: a weighted mean where older frames fade out, about as smooth as the moving mean of the same number of frames.\
+				\nattack / release: rises and falls at separate speeds, so peaks show up quickly and decay slowly.");
+			if (averageMode == AverageFilter::AVERAGE_ATTACK_RELEASE)
+			{
+				float attack = averageFilters[0]->getAttack();
+				float release = averageFilters[0]->getRelease();
+				bool attackChanged = ImGui::SliderFloat("attack", &attack, 0.01f, 1.0f);
+				bool releaseChanged = ImGui::SliderFloat("release", &release, 0.01f, 1.0f);
+				if (attackChanged || releaseChanged)
+				{
+					for (int i = 0; i < numFilterChains; i++)
+						averageFilters[i]->setAttackRelease(attack, release);
+				}
+			}
+
 			// Display the frame gap and total audio time.
-			int totalSamples = analyzer.getFrameSize() + frameGap * averageFilter.getNumSpectrumsInAverage();
-			ImGui::Text("time of utilized audio: %.3f sec", (float)totalSamples / (float)loopback_samplesPerSec());
+			int totalSamples = frameSize + frameGap * averageFilters[0]->getNumSpectrumsInAverage();
+			ImGui::Text("time of utilized audio: %.3f sec", (float)totalSamples / (float)sampleRate);
 
 			// Control domain shift with a slider
-			float fval = domainShiftFilter.getDomainShiftFactor();
-			ImGui::SliderFloat("log domain shift factor", &fval, 1.0f, 10.0f);
-			domainShiftFilter.setDomainShiftFactor(fval);
+			float fval = domainShiftFilters[0]->getDomainShiftFactor();
+			if (ImGui::SliderFloat("log domain shift factor", &fval, 1.0f, 10.0f))
+			{
+				for (int i = 0; i < numFilterChains; i++)
+					domainShiftFilters[i]->setDomainShiftFactor(fval);
+			}
 			ImGui::SameLine(); ImGui::ShowHelpMarker("Shifts frequency domain onto a logarithmic scale.\
 				\n1.0: all frequency bins are spaced evenly.\
 				\n10.0: frequency bins are spaced at powers of 10\
 				\nIt looks good to use values greater than 10.0 with very large frame sizes. CTRL + CLICK the slider to enter a value manually.");
+			bool areaAveraging = domainShiftFilters[0]->getAreaAveraging();
+			if (ImGui::Checkbox("area averaging", &areaAveraging))
+			{
+				for (int i = 0; i < numFilterChains; i++)
+					domainShiftFilters[i]->setAreaAveraging(areaAveraging);
+			}
+			ImGui::SameLine(); ImGui::ShowHelpMarker("When several frequency bins are squeezed into one bar, average all of them instead of sampling the nearest two.");
+
+			// Switch analyzers. Constant Q bins are already log spaced, so the domain shift is turned off while it is used
+			static float fftDomainShiftFactor = domainShiftFactor;
+			int lastAnalyzerType = analyzerType;
+			if (ImGui::Combo("analyzer", &analyzerType, "fft\0constant Q\0multi resolution\0"))
+			{
+				analysisThread.setAnalyzer(analyzers[analyzerType]);
+				analysisThread.setFrameSize(frameSize);
+				if (lastAnalyzerType != 1)
+					fftDomainShiftFactor = domainShiftFilters[0]->getDomainShiftFactor();
+				for (int i = 0; i < numFilterChains; i++)
+					domainShiftFilters[i]->setDomainShiftFactor(analyzerType == 1 ? 1.0f : fftDomainShiftFactor);
+			}
+			ImGui::SameLine(); ImGui::ShowHelpMarker("fft: one frame of the chosen size.\
+				\nconstant Q: 20 Hz to 20 kHz in log spaced bins with the same Q for every bin. Bass gets much finer resolution.\
+				\nmulti resolution: long frames for the bass and short frames for the treble, each at its own rate. The frame size sets the longest frame.");
+
+			// Toggle lazy filter evaluation
+			bool lazyEvaluation = analysisThread.getLazyEvaluation();
+			if (ImGui::Checkbox("lazy filters", &lazyEvaluation))
+				analysisThread.setLazyEvaluation(lazyEvaluation);
+			ImGui::SameLine(); ImGui::ShowHelpMarker("Averages every hop, but only shapes the spectrums that are displayed.\nSaves time at small hop sizes. The average is then taken before the amplitude and peak curves, so the result looks slightly different.");
+
+			// Choose how the analysis catches up after falling behind, and show how often it does
+			int backlogPolicy = (int)analysisThread.getBacklogPolicy();
+			int maxHops = analysisThread.getMaxHops();
+			bool backlogChanged = ImGui::Combo("backlog", &backlogPolicy, "process all\0cap hops\0skip to newest\0");
+			ImGui::SameLine(); ImGui::ShowHelpMarker("What the analysis does after falling behind, for example while the window is dragged.\
+				\nprocess all: catches up at once, which can cause a second hitch.\
+				\ncap hops: catches up a few hops at a time, so the spectrum lags for a moment.\
+				\nskip to newest: skips the older hops. The average still counts them, using the oldest hop that is processed.");
+			if (backlogPolicy != AudioAnalysisThread::BACKLOG_PROCESS_ALL)
+				backlogChanged |= ImGui::SliderInt("max hops per pass", &maxHops, 1, 64);
+			if (backlogChanged)
+				analysisThread.setBacklogPolicy((AudioAnalysisThread::BacklogPolicy)backlogPolicy, maxHops);
+			ImGui::Text("hops: %lld processed, %lld coalesced, %lld dropped, %d waiting", analysisThread.getNumProcessedHops(),
+				analysisThread.getNumCoalescedHops(), analysisThread.getNumDroppedHops(), analysisThread.getBacklog());
+
+			// Toggle the stereo split view
+			if (ImGui::Checkbox("stereo split", &stereoSplit))
+				analysisThread.setStereoAnalysis(stereoSplit);
+			ImGui::SameLine(); ImGui::ShowHelpMarker("Shows the left channel above the center line and the right channel below it.\nOnly available with the fft analyzer.");
 
 			// Control light height with a slider
 			ImGui::SliderFloat("light height", &lightHeight, 0.0f, 1.0f);
 
+			// Toggle the spectrogram, and set how many frames of history it holds
+			ImGui::Checkbox("spectrogram", &showSpectrogram);
+			ImGui::SameLine(); ImGui::ShowHelpMarker("Shows the history of the spectrum behind it, newest next to the center line.");
+			if (showSpectrogram)
+			{
+				if (ImGui::expArrowButtons("spectrogram rows: %d", &spectrogramRows, 64, 4096))
+					spectrogramTexture->resize(numFreqBins, spectrogramRows);
+				// A row is added per published spectrum, which is once per hop, or once per frame when the hops come faster than the frames
+				float hopDuration = (float)analysisThread.getFrameGap() / (float)analysisSampleRate;
+				float rowDuration = std::max(hopDuration, 1.0f / ImGui::GetIO().Framerate);
+				ImGui::Text("spectrogram history: %.2f sec", (float)spectrogramRows * rowDuration);
+			}
+
+			// Switch the spectrum between the 1D texture and the buffer texture
+			ImGui::Checkbox("texture buffer spectrum", &useFrequencyBuffer);
+			ImGui::SameLine(); ImGui::ShowHelpMarker("Writes the spectrum straight into the buffer the shader reads, instead of copying it into a 1D texture.\nAlso allows spectrums wider than the max texture size.");
+
 			// Control the frequency amplitude curve
 			bool changed = false;
 			if (ImGui::TreeNode("Frequency Amplitude Curve"))
@@ -248,24 +420,24 @@ int audioVisualizer()
 			{
 				utl::bezierTable((glm::vec2 *)fAmpControlPoints, frequencyAmplitudePoints, bezierCurveSize);
 				utl::curve2Dto1D(frequencyAmplitudePoints, bezierCurveSize, frequencyAmplitudeCurve, bezierCurveSize);
-				amplitudeFilter.setAmplitudeCurve(frequencyAmplitudeCurve, bezierCurveSize);
+				for (int i = 0; i < numFilterChains; i++)
+					amplitudeFilters[i]->setAmplitudeCurve(frequencyAmplitudeCurve, bezierCurveSize);
 			}
 
 			// Control the frequency peak curve
 			if (ImGui::TreeNode("Frequency Peak Curve"))
 			{
-				changed = ImGui::SliderFloat("Blur Radius", &peakRadius, 0.0f, 0.1f);
+				changed = ImGui::SliderFloat("Blur Radius", &peakRadius, 0.0f, maxPeakRadius);
 				changed |= ImGui::Bezier("", peakControlPoints);
 				ImGui::TreePop();
 			}
 			if (changed)
 			{
-				delete[] peakCurve;
 				peakCurveSize = (int)((float)numFreqBins * peakRadius);
-				peakCurve = new float[peakCurveSize]();
 				utl::bezierTable((glm::vec2 *)peakControlPoints, peakCurvePoints, bezierCurveSize);
 				utl::curve2Dto1D(peakCurvePoints, bezierCurveSize, peakCurve, peakCurveSize);
-				peakFilter.setPeakCurve(peakCurve, peakCurveSize);
+				for (int i = 0; i < numFilterChains; i++)
+					peakFilters[i]->setPeakCurve(peakCurve, peakCurveSize);
 			}
 
 			// Control the frequency color gradient
@@ -277,13 +449,14 @@ int audioVisualizer()
 			}
 			if (changed)
 			{
-				glm::vec3 * colors = (glm::vec3 *)frequencyColorCurve->getPixelBuffer();
 				int numColors = frequencyColorCurve->width;
 				for (int i = 0; i < numColors; i++)
 				{
 					ImVec4 color = frequencyGradient.getColorAt((float)i / (float)(numColors - 1));
-					colors[i] = glm::vec3(color.x, color.y, color.z);
+					gradientColors[i] = glm::vec3(color.x, color.y, color.z);
 				}
+				frequencyColorCurve->getPixelBuffer();
+				frequencyColorCurve->writePixels((float *)gradientColors, 0, numColors);
 				frequencyColorCurve->unmapPixelBuffer();
 			}
 
@@ -296,13 +469,14 @@ int audioVisualizer()
 			}
 			if (changed)
 			{
-				glm::vec3 * colors = (glm::vec3 *)lightColorCurve->getPixelBuffer();
 				int numColors = lightColorCurve->width;
 				for (int i = 0; i < numColors; i++)
 				{
 					ImVec4 color = lightGradient.getColorAt((float)i / (float)(numColors - 1));
-					colors[i] = glm::vec3(color.x, color.y, color.z);
+					gradientColors[i] = glm::vec3(color.x, color.y, color.z);
 				}
+				lightColorCurve->getPixelBuffer();
+				lightColorCurve->writePixels((float *)gradientColors, 0, numColors);
 				lightColorCurve->unmapPixelBuffer();
 			}
 
@@ -316,6 +490,19 @@ int audioVisualizer()
 
 			// Display fps
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+			ImGui::Text("Spectrum texture: %s, %u uploads, %u stalls", frequencyTexture->persistentRing ? "persistent ring" : "orphaned pbo",
+				frequencyTexture->numUploads, frequencyTexture->numStalls);
+
+			// Display the bytes copied to textures since the last frame. The gradients only add to it while they are edited
+			static unsigned long long lastUploadedBytes = 0;
+			unsigned long long uploadedBytes = soundTexture->numUploadedBytes + frequencyTexture->numUploadedBytes + frequencyBuffer->numUploadedBytes +
+				spectrogramTexture->numUploadedBytes + frequencyColorCurve->numUploadedBytes + lightColorCurve->numUploadedBytes;
+			ImGui::Text("Texture uploads: %llu bytes per frame", uploadedBytes - lastUploadedBytes);
+			lastUploadedBytes = uploadedBytes;
+
+			// Display fft plan reuse
+			FFTPlanCache & planCache = FFTPlanCache::getInstance();
+			ImGui::Text("FFT plans: %d, lookups: %lld, hits: %lld", planCache.getNumPlans(), planCache.getNumLookups(), planCache.getNumHits());
 		}
 		ImGui::End();
 
@@ -326,46 +513,67 @@ int audioVisualizer()
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		// Capture system audio, and keep track of the number of new samples
-		static int newSamples = 0;
-		newSamples += loopback_getSound(audioBuffer, numAudioSamples);
+		// Pick up the newest spectrum from the analysis thread
+		const FrequencySpectrum * frequencySpectrum = analysisThread.getFrequencySpectrum();
 
-		// Main audio processing loop. This runs every time there is enough new audio samples to process the next audio frame.
-		static const FrequencySpectrum * frequencySpectrum = averageFilter.getFrequencySpectrum();
-		while (newSamples >= frameGap)
-		{
-			newSamples -= frameGap;
-
-			// transfer audio samples into the fftInBuffer
-			float * inputBuffer = analyzer.getFrameInputBuffer();
-			int frameSize = analyzer.getFrameSize();
-			int frameStart = frameSize - newSamples;
-			for (int i = 0; i < frameSize; i++)
-				inputBuffer[i] = audioBuffer[frameStart + i];
-
-			analyzer.processFrame();
-			frequencySpectrum = analyzer.getFrequencySpectrum();
-			frequencySpectrum = amplitudeFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = domainShiftFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = peakFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = averageFilter.applyFilter(frequencySpectrum);
-		}
-		float * frequencyData = frequencySpectrum->data;
-
-		// Transfer audio samples from audio buffer into the soundTexture pixel buffer
-		float * soundPixelBuffer = (float *)soundTexture->getPixelBuffer();
+		// Transfer the newest numAudioSamples audio samples from the ring buffer into the soundTexture pixel buffer
+		soundTexture->getPixelBuffer();
+		long long audioStart = audioRingBuffer->getWriteIndex() - numAudioSamples;
+		float audioWidth = (float)(numAudioSamples - 1);
 		for (int i = 0; i < soundTextureSize; i++)
 		{
 			float t = (float)i / (float)soundTextureSize;
-			soundPixelBuffer[i] = utl::getValueLerp(audioBuffer, numAudioSamples, t);
+			int j = (int)(audioWidth * t);
+			float pct = audioWidth * t - (float)j;
+			soundPixels[i] = utl::mix(audioRingBuffer->getSample(audioStart + j), audioRingBuffer->getSample(audioStart + j + 1), pct);
 		}
+		soundTexture->writePixels(soundPixels, 0, soundTextureSize);
 		soundTexture->unmapPixelBuffer();
 
 		// transfer frequency data into the frequency texture pixel buffer
-		float * frequencyPixelBuffer = (float *)frequencyTexture->getPixelBuffer();
-		for (int i = 0; i < frequencySpectrum->size; i++)
-			frequencyPixelBuffer[i] = frequencyData[i];
-		frequencyTexture->unmapPixelBuffer();
+		// Red is the top half of the spectrum and green is the bottom half. They are both the mono spectrum unless the stereo split is on
+		const FrequencySpectrum * topSpectrum = frequencySpectrum;
+		const FrequencySpectrum * bottomSpectrum = frequencySpectrum;
+		if (stereoSplit && analysisThread.getChannelSpectrum(StereoSpectrumAnalyzer::CHANNEL_LEFT)->size == frequencySpectrum->size)
+		{
+			topSpectrum = analysisThread.getChannelSpectrum(StereoSpectrumAnalyzer::CHANNEL_LEFT);
+			bottomSpectrum = analysisThread.getChannelSpectrum(StereoSpectrumAnalyzer::CHANNEL_RIGHT);
+		}
+
+		// The textures hold at most numFreqBins pixels, the buffer holds the whole spectrum
+		int numPixels = std::min(frequencySpectrum->size, numFreqBins);
+		for (int i = 0; i < numPixels; i++)
+		{
+			frequencyPixels[i * 2] = topSpectrum->data[i];
+			frequencyPixels[i * 2 + 1] = bottomSpectrum->data[i];
+		}
+		if (useFrequencyBuffer)
+		{
+			// The buffer follows the size of the spectrum, however large it is
+			if ((int)frequencyBuffer->size != frequencySpectrum->size)
+				frequencyBuffer->resize(frequencySpectrum->size);
+			float * frequencyBufferData = (float *)frequencyBuffer->getBuffer();
+			for (int i = 0; i < frequencySpectrum->size; i++)
+			{
+				frequencyBufferData[i * 2] = topSpectrum->data[i];
+				frequencyBufferData[i * 2 + 1] = bottomSpectrum->data[i];
+			}
+			frequencyBuffer->unmapBuffer();
+		}
+		else
+		{
+			frequencyTexture->getPixelBuffer();
+			frequencyTexture->writePixels(frequencyPixels, 0, numPixels);
+			frequencyTexture->unmapPixelBuffer();
+		}
+
+		// Add the same spectrum to the spectrogram as its newest row, only when it is new so every row is its own hop
+		if (showSpectrogram && analysisThread.hasNewSpectrum())
+		{
+			spectrogramTexture->getRowBuffer();
+			spectrogramTexture->writeRow(frequencyPixels);
+			spectrogramTexture->pushRow();
+		}
 
 		// Update the shader, use it, and set uniforms
 		audioShader.update();
@@ -379,6 +587,12 @@ int audioVisualizer()
 		glm::vec2 mouseTextureCoords = sceneManager->mousePos / sceneManager->screenSize;
 		audioShader.setVec2("mousePos", mouseTextureCoords.x, 1.0f - mouseTextureCoords.y);
 		audioShader.setFloat("lightHeight", lightHeight);
+		audioShader.setInt("spectrogramTexture", 5);
+		audioShader.setInt("spectrogramHead", spectrogramTexture->headRow);
+		audioShader.setInt("spectrogramRows", spectrogramTexture->numRows);
+		audioShader.setFloat("spectrogramOpacity", showSpectrogram ? 1.0f : 0.0f);
+		audioShader.setInt("frequencyBuffer", 6);
+		audioShader.setBool("useFrequencyBuffer", useFrequencyBuffer);
 
 		// Bind textures on corresponding texture units
 		glActiveTexture(GL_TEXTURE1);
@@ -389,6 +603,10 @@ int audioVisualizer()
 		glBindTexture(GL_TEXTURE_1D, frequencyColorCurve->textureID);
 		glActiveTexture(GL_TEXTURE4);
 		glBindTexture(GL_TEXTURE_1D, lightColorCurve->textureID);
+		glActiveTexture(GL_TEXTURE5);
+		glBindTexture(GL_TEXTURE_2D, spectrogramTexture->textureID);
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_BUFFER, frequencyBuffer->textureID);
 
 		// Draw the texture
 		glBindVertexArray(VAO);
@@ -400,6 +618,21 @@ int audioVisualizer()
 		glfwSwapBuffers(sceneManager->window);
 	}
 
+	// Stop audio analysis before the filters go out of scope
+	analysisThread.stop();
+	analysisThread.setAnalyzer(nullptr);
+	for (int i = 0; i < numFilterChains; i++)
+	{
+		delete amplitudeFilters[i];
+		delete domainShiftFilters[i];
+		delete peakFilters[i];
+		delete averageFilters[i];
+		delete filterPipelines[i];
+	}
+	delete[] peakCurve;
+	delete[] soundPixels;
+	delete[] frequencyPixels;
+
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	glfwTerminate();
 	return 0;
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include "glad/glad.h"
@@ -15,12 +16,13 @@
 
 #include "Shader.h"
 #include "SceneManager.h"
+#include "StreamBuffer.h"
 #include "StreamTexture.h"
 #include "FluidBuffer.h"
 
-#include "SpectrumAnalyzer.h"
+#include "AudioAnalysisThread.h"
 #include "SpectrumFilter.h"
-#include "loopback.h"
+#include "SpectrumGraph.h"
 
 int fluidSimulation()
 {
@@ -97,13 +99,8 @@ int fluidSimulation()
 	const int numFreqBins = 1024;
 	const float domainShiftFactor = 10.0f;
 
-	SpectrumAnalyzer analyzer(frameSize);
-
-	loopback_init();
-	int frameGap = 128;
-	int numAudioSamples = analyzer.getFrameSize() * 2;
+	const int frameGap = 128;
 	const int bezierCurveSize = 4096;
-	float * audioBuffer = new float[numAudioSamples]();
 
 	// initialize frequency amplitude curve
 	float * frequencyAmplitudeCurve = new float[bezierCurveSize]();
@@ -114,8 +111,11 @@ int fluidSimulation()
 
 	// initialize peak smoothing curve
 	float peakRadius = 0.05f;
+	// The curve is allocated once for the largest blur radius, so changing the radius never allocates
+	const float maxPeakRadius = 0.1f;
+	const int peakCurveCapacity = (int)((float)numFreqBins * maxPeakRadius) + 1;
 	int peakCurveSize = (int)((float)numFreqBins * peakRadius);
-	float * peakCurve = new float[peakCurveSize]();
+	float * peakCurve = new float[peakCurveCapacity]();
 	ImVec2 peakControlPoints[2] = { { 1.00f, 0.00f },{ 0.0f, 1.00f } };
 	glm::vec2 peakCurvePoints[bezierCurveSize];
 	utl::bezierTable((glm::vec2 *)peakControlPoints, peakCurvePoints, bezierCurveSize);
@@ -123,10 +123,24 @@ int fluidSimulation()
 
 	AmplitudeFilter amplitudeFilter(frequencyAmplitudeCurve, bezierCurveSize);
 	DomainShiftFilter domainShiftFilter(domainShiftFactor, numFreqBins);
-	PeakFilter peakFilter(peakCurve, peakCurveSize);
+	PeakFilter peakFilter(peakCurve, peakCurveSize, peakCurveCapacity);
 	AverageFilter averageFilter(numSpectrumsInAverage);
 
-	StreamTexture1D * densityColorCurve = new StreamTexture1D(GL_RGB32F, gradientSize, GL_RGB, GL_FLOAT, 3, 4, false);
+	// The filters as a graph, with the smoothed spectrum as its tap
+	SpectrumGraph spectrumGraph;
+	int smoothedNode = spectrumGraph.addChain({ &amplitudeFilter, &domainShiftFilter, &peakFilter, &averageFilter });
+	spectrumGraph.setTap("smoothed", smoothedNode);
+
+	// Run audio capture, analysis and the filter graph on its own thread
+	LoopbackAudioSource audioSource;
+	AudioAnalysisThread analysisThread(&audioSource, frameSize, frameGap, frameSize);
+	analysisThread.setGraph(&spectrumGraph);
+	analysisThread.start();
+	int smoothedTap = analysisThread.getTapIndex("smoothed");
+
+	// 8 bit colors are enough for the gradient. writePixels() converts the float colors while uploading them
+	StreamTexture1D * densityColorCurve = new StreamTexture1D(GL_RGB8, gradientSize, GL_RGB, GL_UNSIGNED_BYTE, 3, 1, false);
+	glm::vec3 gradientColors[gradientSize];
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_1D, densityColorCurve->textureID);
 
@@ -138,23 +152,28 @@ int fluidSimulation()
 	densityGradient.addMark(0.50f, ImColor(0x8E, 0x00, 0x00));
 	densityGradient.addMark(0.25f, ImColor(0x22, 0x1D, 0x24));
 	densityGradient.addMark(0.0f, ImColor(0x00, 0x00, 0x00));
-	glm::vec3 * densityColors = (glm::vec3 *)densityColorCurve->getPixelBuffer();
 	int numColors = densityColorCurve->width;
 	for (int i = 0; i < numColors; i++)
 	{
 		ImVec4 color = densityGradient.getColorAt((float)i / (float)(numColors - 1));
-		densityColors[i] = glm::vec3(color.x, color.y, color.z);
+		gradientColors[i] = glm::vec3(color.x, color.y, color.z);
 	}
-	densityColorCurve->unmapPixelBuffer();
-	densityColorCurve->getPixelBuffer(); // bug workadound. StreamTexture doesnt initialize properly without this
+	densityColorCurve->getPixelBuffer();
+	densityColorCurve->writePixels((float *)gradientColors, 0, numColors);
 	densityColorCurve->unmapPixelBuffer();
 
-	StreamTexture1D * frequencyTexture = new StreamTexture1D(GL_R32F, numFreqBins, GL_RED, GL_FLOAT, 1, 4, true);
+	// The spectrum is stored as float16, converted by writePixels(). Zero bits are 0.0 in float16 too
+	StreamTexture1D * frequencyTexture = new StreamTexture1D(GL_R16F, numFreqBins, GL_RED, GL_HALF_FLOAT, 1, 2, true);
+	frequencyTexture->enablePersistentRing(3);
 	glActiveTexture(GL_TEXTURE3);
 	glBindTexture(GL_TEXTURE_1D, frequencyTexture->textureID);
-	float * frequencyPixelBuffer = (float *)frequencyTexture->getPixelBuffer();
-	for (int i = 0; i < frequencyTexture->width; i++)
-		frequencyPixelBuffer[i] = 0.0f;
+	memset(frequencyTexture->getPixelBuffer(), 0, frequencyTexture->dataSize);
+	frequencyTexture->unmapPixelBuffer();
+
+	// The spectrum can also go to a buffer texture, which the shader reads without a copy into a texture
+	StreamBuffer * frequencyBuffer = new StreamBuffer(GL_R32F, numFreqBins, 1, 4);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_BUFFER, frequencyBuffer->textureID);
 	
 	Shader displayShader("shaders/fluid/screenQuad.vs", "shaders/fluid/display.fs");
 	Shader advectShader("shaders/fluid/screenQuad.vs", "shaders/fluid/advection.fs");
@@ -186,6 +205,7 @@ int fluidSimulation()
 		static float spiralSplatRadius = 0.0002;
 		static float spiralVelocityAddScalar = 5.0f;
 		static float spiralDensityAddScalar = 0.8f;
+		static bool useFrequencyBuffer = false;
 		ImGui::Begin("Settings");
 		{
 			const char * displayModes[] = { "All", "Velocity", "Pressure", "Divergence", "Density", "DensityColor" };
@@ -202,6 +222,7 @@ int fluidSimulation()
 			ImGui::SliderFloat("splat radius", &spiralSplatRadius, 0.0f, 0.001f, "%.5f");
 			ImGui::SliderFloat("velocity add scalar", &spiralVelocityAddScalar, 0.0f, 5.0f);
 			ImGui::SliderFloat("density add scalar", &spiralDensityAddScalar, 0.0f, 5.0f);
+			ImGui::Checkbox("texture buffer spectrum", &useFrequencyBuffer);
 
 			// Control the frequency color gradient
 			bool changed = false;
@@ -212,13 +233,14 @@ int fluidSimulation()
 			}
 			if (changed)
 			{
-				glm::vec3 * colors = (glm::vec3 *)densityColorCurve->getPixelBuffer();
 				int numColors = densityColorCurve->width;
 				for (int i = 0; i < numColors; i++)
 				{
 					ImVec4 color = densityGradient.getColorAt((float)i / (float)(numColors - 1));
-					colors[i] = glm::vec3(color.x, color.y, color.z);
+					gradientColors[i] = glm::vec3(color.x, color.y, color.z);
 				}
+				densityColorCurve->getPixelBuffer();
+				densityColorCurve->writePixels((float *)gradientColors, 0, numColors);
 				densityColorCurve->unmapPixelBuffer();
 			}
 
@@ -239,15 +261,13 @@ int fluidSimulation()
 			// Control the frequency peak curve
 			if (ImGui::TreeNode("Frequency Peak Curve"))
 			{
-				changed = ImGui::SliderFloat("Blur Radius", &peakRadius, 0.0f, 0.1f);
+				changed = ImGui::SliderFloat("Blur Radius", &peakRadius, 0.0f, maxPeakRadius);
 				changed |= ImGui::Bezier("", peakControlPoints);
 				ImGui::TreePop();
 			}
 			if (changed)
 			{
-				delete[] peakCurve;
 				peakCurveSize = (int)((float)numFreqBins * peakRadius);
-				peakCurve = new float[peakCurveSize]();
 				utl::bezierTable((glm::vec2 *)peakControlPoints, peakCurvePoints, bezierCurveSize);
 				utl::curve2Dto1D(peakCurvePoints, bezierCurveSize, peakCurve, peakCurveSize);
 				peakFilter.setPeakCurve(peakCurve, peakCurveSize);
@@ -263,6 +283,12 @@ int fluidSimulation()
 
 			// Display fps
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+
+			// Display the bytes copied to textures since the last frame
+			static unsigned long long lastUploadedBytes = 0;
+			unsigned long long uploadedBytes = frequencyTexture->numUploadedBytes + frequencyBuffer->numUploadedBytes + densityColorCurve->numUploadedBytes;
+			ImGui::Text("Texture uploads: %llu bytes per frame", uploadedBytes - lastUploadedBytes);
+			lastUploadedBytes = uploadedBytes;
 		}
 		ImGui::End();
 
@@ -270,34 +296,31 @@ int fluidSimulation()
 		glBindTexture(GL_TEXTURE_1D, densityColorCurve->textureID);
 		glActiveTexture(GL_TEXTURE3);
 		glBindTexture(GL_TEXTURE_1D, frequencyTexture->textureID);
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_BUFFER, frequencyBuffer->textureID);
 
 		bool showDemoWindow = true;
 		//ImGui::ShowDemoWindow(&showDemoWindow);
 
 		// Audio processing step
-		static int newSamples = 0;
-		newSamples += loopback_getSound(audioBuffer, numAudioSamples);
-		static const FrequencySpectrum * frequencySpectrum = averageFilter.getFrequencySpectrum();
-		while (newSamples >= frameGap)
+		analysisThread.update();
+		const FrequencySpectrum * frequencySpectrum = analysisThread.getTapSpectrum(smoothedTap);
+		float * frequencyData = frequencySpectrum->data;
+		if (useFrequencyBuffer)
 		{
-			newSamples -= frameGap;
-			float * inputBuffer = analyzer.getFrameInputBuffer();
-			int frameSize = analyzer.getFrameSize();
-			int frameStart = frameSize - newSamples;
-			for (int i = 0; i < frameSize; i++)
-				inputBuffer[i] = audioBuffer[frameStart + i];
-			analyzer.processFrame();
-			frequencySpectrum = analyzer.getFrequencySpectrum();
-			frequencySpectrum = amplitudeFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = domainShiftFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = peakFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = averageFilter.applyFilter(frequencySpectrum);
+			if ((int)frequencyBuffer->size != frequencySpectrum->size)
+				frequencyBuffer->resize(frequencySpectrum->size);
+			float * frequencyBufferData = (float *)frequencyBuffer->getBuffer();
+			for (int i = 0; i < frequencySpectrum->size; i++)
+				frequencyBufferData[i] = frequencyData[i];
+			frequencyBuffer->unmapBuffer();
+		}
+		else
+		{
+			frequencyTexture->getPixelBuffer();
+			frequencyTexture->writePixels(frequencyData, 0, std::min(frequencySpectrum->size, numFreqBins));
+			frequencyTexture->unmapPixelBuffer();
 		}
-		float * frequencyData = frequencySpectrum->data;
-		float * frequencyPixelBuffer = (float *)frequencyTexture->getPixelBuffer();
-		for (int i = 0; i < frequencySpectrum->size; i++)
-			frequencyPixelBuffer[i] = frequencyData[i];
-		frequencyTexture->unmapPixelBuffer();
 
 		// update shaders
 		audioSpiralShader.update();
@@ -332,6 +355,8 @@ int fluidSimulation()
 			audioSpiralShader.setInt("fluid", 0);
 			audioSpiralShader.setInt("density", 1);
 			audioSpiralShader.setInt("frequency", 3);
+			audioSpiralShader.setInt("frequencyBuffer", 4);
+			audioSpiralShader.setBool("useFrequencyBuffer", useFrequencyBuffer);
 			audioSpiralShader.setFloat("timestep", sceneManager->deltaTime / standardTimestep);
 			audioSpiralShader.setFloat("utime", sceneManager->time);
 			audioSpiralShader.setVec2("pixelSize", 1.0f / glm::vec2(fluidWidth, fluidHeight));
@@ -414,6 +439,8 @@ int fluidSimulation()
 	}
 
 	// terminate glfw, clearing all previously allocated GLFW resources.
+	analysisThread.stop();
+	delete[] peakCurve;
 	glfwTerminate();
 	return 0;
 }
\ No newline at end of file
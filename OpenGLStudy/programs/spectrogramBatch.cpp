@@ -0,0 +1,83 @@
+#include <iostream>
+#include <chrono>
+
+#include "glm/glm.hpp"
+
+#include "utilities.h"
+
+#include "AudioSource.h"
+#include "SpectrumFilter.h"
+#include "SpectrogramBatch.h"
+#include "ThreadPool.h"
+
+int spectrogramBatch()
+{
+	// Input and output files
+	const char * inputPath = "audio/input.wav";
+	const char * outputPath = "audio/input.spgm";
+
+	// Same analysis and filter settings as the audio visualizer
+	const int frameSize = 4096;
+	const int frameGap = 128;
+	const int numSpectrumsInAverage = 18;
+	const int numFreqBins = 1024;
+	const float domainShiftFactor = 10.0f;
+	const int bezierCurveSize = 4096;
+
+	// Build the amplitude and peak curves once, every chunk copies them into its own filters
+	float * frequencyAmplitudeCurve = new float[bezierCurveSize]();
+	glm::vec2 fAmpControlPoints[2] = { { 0.01f, 0.01f },{ 0.0f, 0.75f } };
+	glm::vec2 * frequencyAmplitudePoints = new glm::vec2[bezierCurveSize];
+	utl::bezierTable(fAmpControlPoints, frequencyAmplitudePoints, bezierCurveSize);
+	utl::curve2Dto1D(frequencyAmplitudePoints, bezierCurveSize, frequencyAmplitudeCurve, bezierCurveSize);
+
+	int peakCurveSize = (int)((float)numFreqBins * 0.04f);
+	float * peakCurve = new float[peakCurveSize]();
+	glm::vec2 peakControlPoints[2] = { { 1.00f, 0.00f },{ 0.35f, 1.00f } };
+	glm::vec2 * peakCurvePoints = new glm::vec2[bezierCurveSize];
+	utl::bezierTable(peakControlPoints, peakCurvePoints, bezierCurveSize);
+	utl::curve2Dto1D(peakCurvePoints, bezierCurveSize, peakCurve, peakCurveSize);
+
+	SpectrogramBatch batch(frameSize, frameGap, [&]()
+	{
+		std::vector<SpectrumFilter *> filters;
+		filters.push_back(new AmplitudeFilter(frequencyAmplitudeCurve, bezierCurveSize));
+		filters.push_back(new DomainShiftFilter(domainShiftFactor, numFreqBins));
+		filters.push_back(new PeakFilter(peakCurve, peakCurveSize));
+		filters.push_back(new AverageFilter(numSpectrumsInAverage));
+		return filters;
+	});
+	batch.setWarmupFrames(numSpectrumsInAverage - 1);
+	batch.setHalfPrecision(true);
+
+	FileAudioSource audioSource(inputPath, false);
+	if (!audioSource.open())
+	{
+		std::cout << "Failed to open " << inputPath << std::endl;
+		return -1;
+	}
+
+	// Time one thread against every hardware thread. The single threaded pass is overwritten by the parallel one
+	ThreadPool singleThread(1);
+	ThreadPool allThreads;
+	ThreadPool * pools[2] = { &singleThread, &allThreads };
+	for (ThreadPool * pool : pools)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!batch.process(&audioSource, outputPath, pool))
+		{
+			std::cout << "Failed to write " << outputPath << std::endl;
+			return -1;
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double audioSeconds = (double)audioSource.getNumFrames() / (double)audioSource.getSampleRate();
+		std::cout << pool->getNumThreads() << " thread(s): " << batch.getNumFrames() << " frames x " << batch.getNumBins() << " bins in "
+			<< seconds << "s (" << audioSeconds / seconds << "x real time)" << std::endl;
+	}
+
+	delete[] frequencyAmplitudeCurve;
+	delete[] frequencyAmplitudePoints;
+	delete[] peakCurve;
+	delete[] peakCurvePoints;
+	return 0;
+}
@@ -0,0 +1,614 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "AudioRingBuffer.h"
+#include "SpectrumAnalyzer.h"
+#include "MultiResolutionAnalyzer.h"
+#include "StereoSpectrumAnalyzer.h"
+#include "ThreadPool.h"
+#include "FFTPlanCache.h"
+#include "SpectrumKernels.h"
+#include "SpectrumPipeline.h"
+#include "SpectrumBandIndex.h"
+#include "kissfft/kiss_fftr.h"
+
+namespace
+{
+	// A few tones over low level noise, so every bin has something in it
+	float testSignal(long long n)
+	{
+		float t = (float)n / 48000.0f;
+		float noise = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+		return 0.5f * sinf(6.2831853f * 440.0f * t) + 0.25f * sinf(6.2831853f * 3150.0f * t) + 0.01f * noise;
+	}
+
+	struct AnalyzerResult
+	{
+		double microsecondsPerHop;
+		double maxError;		// largest difference from a full fft in any tracked bin, relative to the largest magnitude
+	};
+
+	AnalyzerResult benchmarkAnalyzer(int frameSize, int frameGap, SpectrumAnalyzer::AnalysisMode mode, int numTrackedBins, int numHops)
+	{
+		AudioRingBuffer ringBuffer(frameSize * 4);
+		SpectrumAnalyzer analyzer(frameSize);
+		analyzer.setAnalysisMode(mode);
+		analyzer.setTrackedBins(0, numTrackedBins);
+		SpectrumAnalyzer reference(frameSize);
+
+		// Fill one frame so the first hop has a full window
+		srand(1);
+		float * hopSamples = new float[frameSize];
+		for (int i = 0; i < frameSize; i++)
+			hopSamples[i] = testSignal(i);
+		ringBuffer.write(hopSamples, frameSize);
+
+		AnalyzerResult result = { 0.0, 0.0 };
+		double seconds = 0.0;
+		for (int hop = 0; hop < numHops; hop++)
+		{
+			long long start = ringBuffer.getWriteIndex();
+			for (int i = 0; i < frameGap; i++)
+				hopSamples[i] = testSignal(start + i);
+			ringBuffer.write(hopSamples, frameGap);
+			long long frameEnd = ringBuffer.getWriteIndex();
+
+			std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+			analyzer.readFrame(&ringBuffer, frameEnd);
+			analyzer.processFrame();
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count();
+
+			// Compare against a full fft of the same frame, outside the timed section
+			reference.readFrame(&ringBuffer, frameEnd);
+			reference.processFrame();
+			const float * expected = reference.getFrequencySpectrum()->data;
+			const float * actual = analyzer.getFrequencySpectrum()->data;
+			int numBins = (numTrackedBins < 0 || numTrackedBins > frameSize / 2 + 1) ? frameSize / 2 + 1 : numTrackedBins;
+			float maxMagnitude = 0.0f;
+			float maxDifference = 0.0f;
+			for (int i = 0; i < numBins; i++)
+			{
+				maxMagnitude = fmaxf(maxMagnitude, expected[i]);
+				maxDifference = fmaxf(maxDifference, fabsf(expected[i] - actual[i]));
+			}
+			result.maxError = fmax(result.maxError, (double)(maxDifference / maxMagnitude));
+		}
+		delete[] hopSamples;
+
+		result.microsecondsPerHop = seconds * 1000000.0 / (double)numHops;
+		return result;
+	}
+
+	double benchmarkFrequencyAnalyzer(FrequencyAnalyzer * analyzer, int frameGap, int numHops)
+	{
+		AudioRingBuffer ringBuffer(analyzer->getFrameSize() * 4);
+		srand(1);
+		float * hopSamples = new float[analyzer->getFrameSize()];
+		for (int i = 0; i < analyzer->getFrameSize(); i++)
+			hopSamples[i] = testSignal(i);
+		ringBuffer.write(hopSamples, analyzer->getFrameSize());
+
+		double seconds = 0.0;
+		for (int hop = 0; hop < numHops; hop++)
+		{
+			long long start = ringBuffer.getWriteIndex();
+			for (int i = 0; i < frameGap; i++)
+				hopSamples[i] = testSignal(start + i);
+			ringBuffer.write(hopSamples, frameGap);
+
+			std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+			analyzer->readFrame(&ringBuffer, ringBuffer.getWriteIndex());
+			analyzer->processFrame();
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count();
+		}
+		delete[] hopSamples;
+		return seconds * 1000000.0 / (double)numHops;
+	}
+}
+
+int spectrumBenchmark()
+{
+	// Frame size and hop pairs, from the visualizer default to the highest hop rates
+	const int configs[][2] = { { 4096, 32 }, { 4096, 128 }, { 4096, 512 }, { 2048, 64 }, { 8192, 128 } };
+	const int numHops = 2000;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Full fft against sliding dft (all bins, and the lowest 256 bins), microseconds per hop" << std::endl;
+	for (const int * config : configs)
+	{
+		int frameSize = config[0];
+		int frameGap = config[1];
+		AnalyzerResult full = benchmarkAnalyzer(frameSize, frameGap, SpectrumAnalyzer::FULL_FFT, -1, numHops);
+		AnalyzerResult slidingAll = benchmarkAnalyzer(frameSize, frameGap, SpectrumAnalyzer::SLIDING_DFT, -1, numHops);
+		AnalyzerResult sliding256 = benchmarkAnalyzer(frameSize, frameGap, SpectrumAnalyzer::SLIDING_DFT, 256, numHops);
+
+		std::cout << "frame " << std::setw(5) << frameSize << " hop " << std::setw(4) << frameGap
+			<< " | full fft " << std::setw(8) << full.microsecondsPerHop
+			<< " | sliding all " << std::setw(8) << slidingAll.microsecondsPerHop
+			<< " (error " << std::scientific << std::setprecision(1) << slidingAll.maxError << std::fixed << std::setprecision(2) << ")"
+			<< " | sliding 256 " << std::setw(8) << sliding256.microsecondsPerHop
+			<< " (error " << std::scientific << std::setprecision(1) << sliding256.maxError << std::fixed << std::setprecision(2) << ")"
+			<< std::endl;
+	}
+
+	// One large frame at a small hop, against a bank where only the treble runs at that hop.
+	// The bank runs serially, on the pool with the default parallel frame size, and on the pool for every frame
+	ThreadPool threadPool(3);
+	const int bankConfigs[][6] = { { 8192, 2048, 512, 1024, 256, 128 }, { 32768, 16384, 8192, 1024, 512, 256 } };
+	for (const int * config : bankConfigs)
+	{
+		std::cout << std::endl << "Single " << config[0] << " frame at hop " << config[5] << " against " << config[0] << "/" << config[1] << "/" << config[2]
+			<< " bands at hops " << config[3] << "/" << config[4] << "/" << config[5] << ", microseconds per hop" << std::endl;
+		SpectrumAnalyzer single(config[0]);
+		MultiResolutionAnalyzer serialBank(48000, nullptr);
+		MultiResolutionAnalyzer defaultBank(48000, &threadPool);
+		MultiResolutionAnalyzer parallelBank(48000, &threadPool);
+		parallelBank.setParallelFrameSize(0);
+		MultiResolutionAnalyzer * banks[3] = { &serialBank, &defaultBank, &parallelBank };
+		for (MultiResolutionAnalyzer * bank : banks)
+		{
+			bank->addBand(config[0], config[3], 300.0f);
+			bank->addBand(config[1], config[4], 2500.0f);
+			bank->addBand(config[2], config[5], 24000.0f);
+		}
+		std::cout << "single fft " << benchmarkFrequencyAnalyzer(&single, config[5], numHops)
+			<< " | bank serial " << benchmarkFrequencyAnalyzer(&serialBank, config[5], numHops)
+			<< " | bank default " << benchmarkFrequencyAnalyzer(&defaultBank, config[5], numHops)
+			<< " | bank always on " << threadPool.getNumThreads() << " threads " << benchmarkFrequencyAnalyzer(&parallelBank, config[5], numHops) << std::endl;
+	}
+
+	// Two real ffts against one packed complex fft, and the largest difference between their left and right spectrums
+	std::cout << std::endl << "Two real ffts against one stereo complex fft, microseconds per frame" << std::endl;
+	for (int frameSize : { 1024, 4096, 16384 })
+	{
+		SpectrumAnalyzer leftAnalyzer(frameSize);
+		SpectrumAnalyzer rightAnalyzer(frameSize);
+		StereoSpectrumAnalyzer stereoAnalyzer(frameSize);
+		srand(1);
+		for (int i = 0; i < frameSize; i++)
+		{
+			leftAnalyzer.getFrameInputBuffer()[i] = stereoAnalyzer.getFrameInputBuffer()[i] = testSignal(i);
+			rightAnalyzer.getFrameInputBuffer()[i] = stereoAnalyzer.getRightInputBuffer()[i] = testSignal(i + 1000);
+		}
+
+		const int numFrames = 500;
+		std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+		for (int i = 0; i < numFrames; i++)
+		{
+			leftAnalyzer.processFrame();
+			rightAnalyzer.processFrame();
+		}
+		std::chrono::steady_clock::time_point timeMiddle = std::chrono::steady_clock::now();
+		for (int i = 0; i < numFrames; i++)
+			stereoAnalyzer.processFrame();
+		std::chrono::steady_clock::time_point timeEnd = std::chrono::steady_clock::now();
+
+		float maxDifference = 0.0f;
+		for (int i = 0; i < frameSize / 2 + 1; i++)
+		{
+			maxDifference = fmaxf(maxDifference, fabsf(leftAnalyzer.getFrequencySpectrum()->data[i] - stereoAnalyzer.getChannelSpectrum(StereoSpectrumAnalyzer::CHANNEL_LEFT)->data[i]));
+			maxDifference = fmaxf(maxDifference, fabsf(rightAnalyzer.getFrequencySpectrum()->data[i] - stereoAnalyzer.getChannelSpectrum(StereoSpectrumAnalyzer::CHANNEL_RIGHT)->data[i]));
+		}
+		std::cout << "frame " << std::setw(5) << frameSize
+			<< " | two real " << std::setw(8) << std::chrono::duration<double>(timeMiddle - timeStart).count() * 1000000.0 / numFrames
+			<< " | stereo " << std::setw(8) << std::chrono::duration<double>(timeEnd - timeMiddle).count() * 1000000.0 / numFrames
+			<< " (max difference " << std::scientific << std::setprecision(1) << maxDifference << std::fixed << std::setprecision(2) << ")" << std::endl;
+	}
+
+	// Cached real plans against kiss_fftr, then the cost of switching frame sizes once every size has a plan
+	std::cout << std::endl << "Cached real fft against kiss_fftr, and frame size switches, microseconds" << std::endl;
+	FFTPlanCache & planCache = FFTPlanCache::getInstance();
+	for (int frameSize : { 1024, 4096, 16384 })
+	{
+		float * timeData = new float[frameSize];
+		kiss_fft_cpx * cachedOut = new kiss_fft_cpx[frameSize / 2 + 1];
+		kiss_fft_cpx * referenceOut = new kiss_fft_cpx[frameSize / 2 + 1];
+		srand(1);
+		for (int i = 0; i < frameSize; i++)
+			timeData[i] = testSignal(i);
+		kiss_fftr_cfg referenceConfig = kiss_fftr_alloc(frameSize, 0, NULL, NULL);
+		const FFTPlan * plan = planCache.getRealPlan(frameSize);
+
+		const int numFrames = 500;
+		std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+		for (int i = 0; i < numFrames; i++)
+			kiss_fftr(referenceConfig, timeData, referenceOut);
+		std::chrono::steady_clock::time_point timeMiddle = std::chrono::steady_clock::now();
+		for (int i = 0; i < numFrames; i++)
+			FFTPlanCache::realForward(plan, timeData, cachedOut);
+		std::chrono::steady_clock::time_point timeEnd = std::chrono::steady_clock::now();
+
+		float maxDifference = 0.0f;
+		for (int i = 0; i < frameSize / 2 + 1; i++)
+		{
+			maxDifference = fmaxf(maxDifference, fabsf(cachedOut[i].r - referenceOut[i].r));
+			maxDifference = fmaxf(maxDifference, fabsf(cachedOut[i].i - referenceOut[i].i));
+		}
+		std::cout << "frame " << std::setw(5) << frameSize
+			<< " | kiss_fftr " << std::setw(8) << std::chrono::duration<double>(timeMiddle - timeStart).count() * 1000000.0 / numFrames
+			<< " | cached plan " << std::setw(8) << std::chrono::duration<double>(timeEnd - timeMiddle).count() * 1000000.0 / numFrames
+			<< " (max difference " << std::scientific << std::setprecision(1) << maxDifference << std::fixed << std::setprecision(2) << ")" << std::endl;
+
+		free(referenceConfig);
+		delete[] timeData;
+		delete[] cachedOut;
+		delete[] referenceOut;
+	}
+
+	SpectrumAnalyzer switchingAnalyzer(4096);
+	const int frameSizes[] = { 1024, 2048, 4096, 8192, 16384 };
+	const int numSwitches = 200;
+	std::chrono::steady_clock::time_point switchStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSwitches; i++)
+		switchingAnalyzer.setFrameSize(frameSizes[i % 5]);
+	std::cout << "setFrameSize " << std::chrono::duration<double>(std::chrono::steady_clock::now() - switchStart).count() * 1000000.0 / numSwitches
+		<< " | plan lookups " << planCache.getNumLookups() << ", hits " << planCache.getNumHits() << ", plans " << planCache.getNumPlans() << std::endl;
+
+	// Magnitude, power and decibel kernels at every level the cpu supports, against the scalar versions
+	std::cout << std::endl << "Spectrum kernels on 8193 bins, microseconds per call (best level " << simd::getLevelName(simd::getBestLevel()) << ")" << std::endl;
+	const int numKernelBins = 8193;
+	float * complexData = new float[numKernelBins * 2];
+	float * referenceData = new float[numKernelBins * 3];
+	float * kernelData = new float[numKernelBins];
+	srand(1);
+	for (int i = 0; i < numKernelBins * 2; i++)
+		complexData[i] = testSignal(i) * 100.0f;
+	simd::Level activeLevel = simd::getLevel();
+	for (int level = simd::LEVEL_SCALAR; level <= simd::getBestLevel(); level++)
+	{
+		simd::setLevel((simd::Level)level);
+		std::cout << std::setw(6) << simd::getLevelName((simd::Level)level);
+		for (int kernel = 0; kernel < 3; kernel++)
+		{
+			const int numCalls = 2000;
+			std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+			for (int i = 0; i < numCalls; i++)
+			{
+				if (kernel == 0)
+					simd::complexMagnitude(complexData, kernelData, numKernelBins, 1.0f / numKernelBins);
+				else if (kernel == 1)
+					simd::complexPower(complexData, kernelData, numKernelBins, 1.0f / numKernelBins);
+				else
+					simd::complexDecibels(complexData, kernelData, numKernelBins, 1.0f / numKernelBins, -120.0f);
+			}
+			double microseconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count() * 1000000.0 / numCalls;
+
+			// The scalar level is the reference, every other level reports its largest difference from it
+			float * reference = referenceData + kernel * numKernelBins;
+			float maxDifference = 0.0f;
+			for (int i = 0; i < numKernelBins; i++)
+			{
+				if (level == simd::LEVEL_SCALAR)
+					reference[i] = kernelData[i];
+				maxDifference = fmaxf(maxDifference, fabsf(kernelData[i] - reference[i]) / fmaxf(fabsf(reference[i]), 1e-30f));
+			}
+			const char * kernelNames[3] = { "magnitude", "power", "decibels" };
+			std::cout << " | " << kernelNames[kernel] << " " << std::setw(6) << microseconds
+				<< " (relative error " << std::scientific << std::setprecision(1) << maxDifference << std::fixed << std::setprecision(2) << ")";
+		}
+		std::cout << std::endl;
+	}
+	simd::setLevel(activeLevel);
+	delete[] complexData;
+	delete[] referenceData;
+	delete[] kernelData;
+
+	// Filter kernels at every level against the scalar versions, from small to large spectrums.
+	// The kernels promise the scalar result bit for bit, so the difference is counted in units in the last place
+	std::cout << std::endl << "Filter kernels, microseconds per call and largest difference from scalar in ulps" << std::endl;
+	{
+		const int numKernels = 7;
+		const char * kernelNames[numKernels] = { "curve", "sum", "accumulate", "scale", "exponential", "attack/release", "gather" };
+		const int maxBins = 16384;
+		const int curveSize = 1000;
+		float * curve = new float[curveSize];
+		for (int i = 0; i < curveSize; i++)
+			curve[i] = sqrtf((float)i / (float)(curveSize - 1));
+		float * inputData = new float[maxBins];
+		float * stateData = new float[maxBins];
+		float * outData = new float[maxBins];
+		float * referenceData = new float[maxBins * numKernels];
+		int * gatherIndices = new int[maxBins];
+		float * gatherFractions = new float[maxBins];
+		srand(1);
+		for (int i = 0; i < maxBins; i++)
+			inputData[i] = (float)rand() / (float)RAND_MAX * 1.2f - 0.1f;
+
+		for (int numBins = 256; numBins <= maxBins; numBins *= 4)
+		{
+			// The gather reads along a cubic warp of the input, like the interpolated rows of a domain shift
+			for (int i = 0; i < numBins; i++)
+			{
+				float t = (float)i / (float)numBins;
+				float position = (1.0f - (1.0f - t) * (1.0f - t) * (1.0f - t)) * (float)(numBins - 2);
+				gatherIndices[i] = (int)position;
+				gatherFractions[i] = position - (float)gatherIndices[i];
+			}
+			for (int level = simd::LEVEL_SCALAR; level <= simd::getBestLevel(); level++)
+			{
+				simd::setLevel((simd::Level)level);
+				std::cout << std::setw(5) << numBins << " bins " << std::setw(6) << simd::getLevelName((simd::Level)level);
+				for (int kernel = 0; kernel < numKernels; kernel++)
+				{
+					auto runKernel = [&]()
+					{
+						if (kernel == 0)
+							simd::curveLookup(curve, curveSize, inputData, outData, numBins);
+						else if (kernel == 1)
+							simd::replaceInSum(outData, stateData, inputData, numBins);
+						else if (kernel == 2)
+							simd::accumulate(outData, inputData, numBins);
+						else if (kernel == 3)
+							simd::scale(inputData, outData, numBins, 1.0f / 6.0f);
+						else if (kernel == 4)
+							simd::exponentialAverage(stateData, inputData, numBins, 2.0f / 7.0f);
+						else if (kernel == 5)
+							simd::attackRelease(stateData, inputData, numBins, 0.5f, 0.1f);
+						else
+							simd::lerpGather(inputData, gatherIndices, gatherFractions, outData, numBins);
+					};
+					// Kernels that update state in place start from the same state, so every level sees the same data
+					for (int i = 0; i < numBins; i++)
+					{
+						stateData[i] = 0.5f;
+						outData[i] = 0.25f;
+					}
+					runKernel();
+					const float * result = (kernel == 4 || kernel == 5) ? stateData : outData;
+					float * reference = referenceData + kernel * maxBins;
+					int maxUlps = 0;
+					for (int i = 0; i < numBins; i++)
+					{
+						if (level == simd::LEVEL_SCALAR)
+							reference[i] = result[i];
+						int resultBits, referenceBits;
+						memcpy(&resultBits, &result[i], sizeof(int));
+						memcpy(&referenceBits, &reference[i], sizeof(int));
+						maxUlps = std::max(maxUlps, std::abs(resultBits - referenceBits));
+					}
+
+					const int numCalls = 4000000 / numBins;
+					std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+					for (int i = 0; i < numCalls; i++)
+						runKernel();
+					double microseconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count() * 1000000.0 / numCalls;
+					std::cout << " | " << kernelNames[kernel] << " " << std::setw(5) << microseconds << " (" << maxUlps << ")";
+				}
+				std::cout << std::endl;
+			}
+		}
+		simd::setLevel(activeLevel);
+		delete[] curve;
+		delete[] inputData;
+		delete[] stateData;
+		delete[] outData;
+		delete[] referenceData;
+		delete[] gatherIndices;
+		delete[] gatherFractions;
+	}
+
+	// The visualizer's filter chain through virtual applyFilter() calls, against the same filters in a SpectrumPipeline,
+	// and against a fixed chain written with the stage templates
+	std::cout << std::endl << "Filter chain against fused pipeline, 4096 frame into 1024 bins, microseconds per hop" << std::endl;
+	{
+		const int curveSize = 1000;
+		float * amplitudeCurve = new float[curveSize];
+		float * peakCurve = new float[curveSize];
+		for (int i = 0; i < curveSize; i++)
+		{
+			float t = (float)i / (float)(curveSize - 1);
+			amplitudeCurve[i] = sqrtf(t);
+			peakCurve[i] = t * t;
+		}
+		AmplitudeFilter chainAmplitude(amplitudeCurve, curveSize), pipelineAmplitude(amplitudeCurve, curveSize);
+		DomainShiftFilter chainDomainShift(3.0f, 1024), pipelineDomainShift(3.0f, 1024);
+		PeakFilter chainPeak(peakCurve, 50), pipelinePeak(peakCurve, 50);
+		AverageFilter chainAverage(6), pipelineAverage(6);
+		SpectrumFilter * chain[4] = { &chainAmplitude, &chainDomainShift, &chainPeak, &chainAverage };
+		SpectrumPipeline pipeline;
+		pipeline.addFilter(&pipelineAmplitude);
+		pipeline.addFilter(&pipelineDomainShift);
+		pipeline.addFilter(&pipelinePeak);
+		pipeline.addFilter(&pipelineAverage);
+
+		const int numSpectrums = 16;
+		FrequencySpectrum * spectrums[numSpectrums];
+		srand(1);
+		for (int i = 0; i < numSpectrums; i++)
+		{
+			spectrums[i] = new FrequencySpectrum(2049);
+			for (int j = 0; j < 2049; j++)
+				spectrums[i]->data[j] = (float)rand() / (float)RAND_MAX * 0.1f;
+		}
+
+		const int numFilterHops = 5000;
+		float maxDifference = 0.0f;
+		std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+		for (int i = 0; i < numFilterHops; i++)
+		{
+			const FrequencySpectrum * spectrum = spectrums[i % numSpectrums];
+			for (SpectrumFilter * filter : chain)
+				spectrum = filter->applyFilter(spectrum);
+		}
+		std::chrono::steady_clock::time_point timeMiddle = std::chrono::steady_clock::now();
+		for (int i = 0; i < numFilterHops; i++)
+			pipeline.applyFilter(spectrums[i % numSpectrums]);
+		std::chrono::steady_clock::time_point timeEnd = std::chrono::steady_clock::now();
+		const FrequencySpectrum * chainOutput = chainAverage.getFrequencySpectrum();
+		const FrequencySpectrum * pipelineOutput = pipeline.getFrequencySpectrum();
+		for (int i = 0; i < chainOutput->size; i++)
+			maxDifference = fmaxf(maxDifference, fabsf(chainOutput->data[i] - pipelineOutput->data[i]));
+
+		// Only the fused pass, written as a fixed chain so both curve lookups inline into the gather loop
+		DomainShiftTable gatherTable;
+		gatherTable.update(1.0f / 3.0f, 2049, 1024);
+		FrequencySpectrum fixedOutput(1024);
+		pipelineStages::AmplitudeCurve amplitudeStage = { amplitudeCurve, curveSize };
+		std::chrono::steady_clock::time_point fixedStart = std::chrono::steady_clock::now();
+		for (int i = 0; i < numFilterHops; i++)
+			pipelineStages::gather(gatherTable, spectrums[i % numSpectrums]->data, fixedOutput.data, amplitudeStage, pipelineStages::Identity());
+		std::chrono::steady_clock::time_point fixedEnd = std::chrono::steady_clock::now();
+
+		std::cout << "virtual chain " << std::chrono::duration<double>(timeMiddle - timeStart).count() * 1000000.0 / numFilterHops
+			<< " | pipeline (" << pipeline.getNumPasses() << " passes) " << std::chrono::duration<double>(timeEnd - timeMiddle).count() * 1000000.0 / numFilterHops
+			<< " (max difference " << std::scientific << std::setprecision(1) << maxDifference << std::fixed << std::setprecision(2) << ")"
+			<< " | fixed amplitude + gather only " << std::chrono::duration<double>(fixedEnd - fixedStart).count() * 1000000.0 / numFilterHops << std::endl;
+
+		for (int i = 0; i < numSpectrums; i++)
+			delete spectrums[i];
+		delete[] amplitudeCurve;
+		delete[] peakCurve;
+	}
+
+	// Band means and maximums over 1000 random ranges, summed bin by bin against the index,
+	// one query at a time and in one batch at every level
+	std::cout << std::endl << "Band queries, 1000 random ranges, microseconds for all of them" << std::endl;
+	for (int numBins : { 1024, 16384 })
+	{
+		FrequencySpectrum spectrum(numBins);
+		srand(1);
+		for (int i = 0; i < numBins; i++)
+			spectrum.data[i] = (float)rand() / (float)RAND_MAX;
+		const int numRanges = 1000;
+		int * begins = new int[numRanges];
+		int * ends = new int[numRanges];
+		for (int i = 0; i < numRanges; i++)
+		{
+			begins[i] = rand() % numBins;
+			ends[i] = begins[i] + 1 + rand() % (numBins - begins[i]);
+		}
+		float * means = new float[numRanges];
+		float * maxes = new float[numRanges];
+		const int numRepeats = 200;
+
+		std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < numRepeats; repeat++)
+		{
+			for (int i = 0; i < numRanges; i++)
+			{
+				float sum = 0.0f;
+				float maximum = spectrum.data[begins[i]];
+				for (int j = begins[i]; j < ends[i]; j++)
+				{
+					sum += spectrum.data[j];
+					maximum = fmaxf(maximum, spectrum.data[j]);
+				}
+				means[i] = sum / (float)(ends[i] - begins[i]);
+				maxes[i] = maximum;
+			}
+		}
+		double loopMicroseconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count() * 1000000.0 / numRepeats;
+
+		SpectrumBandIndex bandIndex(true);
+		std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < numRepeats; repeat++)
+			bandIndex.build(&spectrum);
+		double buildMicroseconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count() * 1000000.0 / numRepeats;
+
+		std::chrono::steady_clock::time_point singleStart = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < numRepeats; repeat++)
+		{
+			for (int i = 0; i < numRanges; i++)
+			{
+				means[i] = bandIndex.getMean(begins[i], ends[i]);
+				maxes[i] = bandIndex.getMax(begins[i], ends[i]);
+			}
+		}
+		double singleMicroseconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - singleStart).count() * 1000000.0 / numRepeats;
+
+		std::cout << std::setw(5) << numBins << " bins | bin loop " << std::setw(8) << loopMicroseconds
+			<< " | build index " << std::setw(6) << buildMicroseconds << " | single queries " << std::setw(6) << singleMicroseconds;
+		for (int level = simd::LEVEL_SCALAR; level <= simd::getBestLevel(); level++)
+		{
+			simd::setLevel((simd::Level)level);
+			std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now();
+			for (int repeat = 0; repeat < numRepeats; repeat++)
+			{
+				bandIndex.getMeans(begins, ends, means, numRanges);
+				bandIndex.getMaxes(begins, ends, maxes, numRanges);
+			}
+			std::cout << " | batch " << simd::getLevelName((simd::Level)level) << " "
+				<< std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count() * 1000000.0 / numRepeats;
+		}
+		simd::setLevel(activeLevel);
+		std::cout << std::endl;
+
+		delete[] begins;
+		delete[] ends;
+		delete[] means;
+		delete[] maxes;
+	}
+
+	// Conversions from float to the narrower upload types of the stream textures, at every level against the scalar versions
+	std::cout << std::endl << "Upload conversions on 16384 values, microseconds per call and values different from scalar" << std::endl;
+	{
+		const int numValues = 16384;
+		float * inputData = new float[numValues];
+		uint16_t * halfData = new uint16_t[numValues];
+		uint8_t * unorm8Data = new uint8_t[numValues];
+		uint16_t * unorm16Data = new uint16_t[numValues];
+		uint16_t * referenceHalf = new uint16_t[numValues];
+		uint8_t * referenceUnorm8 = new uint8_t[numValues];
+		uint16_t * referenceUnorm16 = new uint16_t[numValues];
+		srand(1);
+		for (int i = 0; i < numValues; i++)
+			inputData[i] = (float)rand() / (float)RAND_MAX * 1.2f - 0.1f;
+
+		for (int level = simd::LEVEL_SCALAR; level <= simd::getBestLevel(); level++)
+		{
+			simd::setLevel((simd::Level)level);
+			std::cout << std::setw(6) << simd::getLevelName((simd::Level)level);
+			const int numCalls = 2000;
+			const char * kernelNames[3] = { "half", "unorm8", "unorm16" };
+			for (int kernel = 0; kernel < 3; kernel++)
+			{
+				auto runKernel = [&]()
+				{
+					if (kernel == 0)
+						simd::floatToHalf(inputData, halfData, numValues);
+					else if (kernel == 1)
+						simd::floatToUnorm8(inputData, unorm8Data, numValues);
+					else
+						simd::floatToUnorm16(inputData, unorm16Data, numValues);
+				};
+				std::chrono::steady_clock::time_point timeStart = std::chrono::steady_clock::now();
+				for (int i = 0; i < numCalls; i++)
+					runKernel();
+				double microseconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count() * 1000000.0 / numCalls;
+
+				int numDifferent = 0;
+				for (int i = 0; i < numValues; i++)
+				{
+					if (level == simd::LEVEL_SCALAR)
+					{
+						referenceHalf[i] = halfData[i];
+						referenceUnorm8[i] = unorm8Data[i];
+						referenceUnorm16[i] = unorm16Data[i];
+					}
+					if (kernel == 0)
+						numDifferent += halfData[i] != referenceHalf[i];
+					else if (kernel == 1)
+						numDifferent += unorm8Data[i] != referenceUnorm8[i];
+					else
+						numDifferent += unorm16Data[i] != referenceUnorm16[i];
+				}
+				std::cout << " | " << kernelNames[kernel] << " " << std::setw(6) << microseconds << " (" << numDifferent << ")";
+			}
+			std::cout << std::endl;
+		}
+		simd::setLevel(activeLevel);
+		delete[] inputData;
+		delete[] halfData;
+		delete[] unorm8Data;
+		delete[] unorm16Data;
+		delete[] referenceHalf;
+		delete[] referenceUnorm8;
+		delete[] referenceUnorm16;
+	}
+	return 0;
+}
@@ -15,9 +15,10 @@
 #include "SimpleCamera.h"
 #include "SceneManager.h"
 
-#include "loopback.h"
-#include "SpectrumAnalyzer.h"
+#include "AudioAnalysisThread.h"
+#include "SpectrumBandIndex.h"
 #include "SpectrumFilter.h"
+#include "SpectrumGraph.h"
 #include "utilities.h"
 
 #include <cstdlib>
@@ -154,13 +155,8 @@ int sphereParticles()
 	const int numFreqBins = 1024;
 	const float domainShiftFactor = 10.0f;
 
-	SpectrumAnalyzer analyzer(frameSize);
-	
-	loopback_init();
-	int frameGap = 128;
-	int numAudioSamples = analyzer.getFrameSize() * 2;
+	const int frameGap = 128;
 	const int bezierCurveSize = 4096;
-	float * audioBuffer = new float[numAudioSamples]();
 
 	// initialize frequency amplitude curve
 	float * frequencyAmplitudeCurve = new float[bezierCurveSize]();
@@ -183,6 +179,25 @@ int sphereParticles()
 	PeakFilter peakFilter(peakCurve, peakCurveSize);
 	AverageFilter averageFilter(numSpectrumsInAverage);
 
+	// The filters as a graph, with the smoothed spectrum as its tap
+	SpectrumGraph spectrumGraph;
+	int smoothedNode = spectrumGraph.addChain({ &amplitudeFilter, &domainShiftFilter, &peakFilter, &averageFilter });
+	spectrumGraph.setTap("smoothed", smoothedNode);
+
+	// Run audio capture, analysis and the filter graph on its own thread
+	LoopbackAudioSource audioSource;
+	AudioAnalysisThread analysisThread(&audioSource, frameSize, frameGap, frameSize);
+	analysisThread.setGraph(&spectrumGraph);
+	analysisThread.start();
+	int smoothedTap = analysisThread.getTapIndex("smoothed");
+
+	// Band energies, one band of the spectrum per object, queried from an index built once per frame
+	const int maxObjects = 1000;
+	SpectrumBandIndex bandIndex;
+	int bandBegins[maxObjects];
+	int bandEnds[maxObjects];
+	float bandEnergies[maxObjects];
+
 	// View
 	View * view = new View;
 
@@ -216,9 +231,11 @@ int sphereParticles()
 		static float shininess = 2.0f;
 		static bool blinn = true;
 		static float gamma = 2.2f;
+		static bool bandEnergy = false;
 		{
 			ImGui::Text("Use WASD to move, SPACE to rise, LEFT SHIFT to fall.");
-			ImGui::SliderInt("number of objects", &numObjects, 1, 1000);
+			ImGui::SliderInt("number of objects", &numObjects, 1, maxObjects);
+			ImGui::Checkbox("band energy", &bandEnergy);
 			ImGui::SliderFloat("object size", &objectScale, 0.00f, 0.5f);
 			ImGui::SliderFloat("speed", &timeScale, 0.0f, 20.0f);
 			ImGui::SliderFloat("object yaw scalar", &objectRotationScalar, 0.0f, 50.0f);
@@ -258,31 +275,20 @@ int sphereParticles()
 		glClearColor(clearColor.x, clearColor.y, clearColor.z, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Capture system audio, and keep track of the number of new samples
-		static int newSamples = 0;
-		newSamples += loopback_getSound(audioBuffer, numAudioSamples); 
+		// Pick up the newest spectrums from the analysis thread
+		analysisThread.update();
+		const FrequencySpectrum * frequencySpectrum = analysisThread.getTapSpectrum(smoothedTap);
+		float * frequencyData = frequencySpectrum->data;
+		bool hasSpectrum = frequencySpectrum->size > 0;
 
-		// Main audio processing loop. This runs every time there is enough new audio samples to process the next audio frame.
-		static const FrequencySpectrum * frequencySpectrum = analyzer.getFrequencySpectrum();
-		while (newSamples >= frameGap)
+		// Instead of sampling the spectrum at one point, each object can take the mean of its own slice of the spectrum
+		if (bandEnergy && hasSpectrum)
 		{
-			newSamples -= frameGap;
-
-			// transfer audio samples into the fftInBuffer
-			float * inputBuffer = analyzer.getFrameInputBuffer();
-			int frameSize = analyzer.getFrameSize();
-			int frameStart = frameSize - newSamples;
-			for (int i = 0; i < frameSize; i++)
-				inputBuffer[i] = audioBuffer[frameStart + i];
-
-			analyzer.processFrame();
-			frequencySpectrum = analyzer.getFrequencySpectrum();
-			frequencySpectrum = amplitudeFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = domainShiftFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = peakFilter.applyFilter(frequencySpectrum);
-			frequencySpectrum = averageFilter.applyFilter(frequencySpectrum);
+			bandIndex.build(frequencySpectrum);
+			for (int i = 0; i < numObjects; i++)
+				bandIndex.getBinRange((float)i / (float)numObjects, (float)(i + 1) / (float)numObjects, &bandBegins[i], &bandEnds[i]);
+			bandIndex.getMeans(bandBegins, bandEnds, bandEnergies, numObjects);
 		}
-		float * frequencyData = frequencySpectrum->data;
 
 		// get view and projection matrices
 		updateView2(view, sceneManager);
@@ -325,7 +331,9 @@ int sphereParticles()
 		{
 			float x = (float)i / (float)numObjects;
 			float time = (float)glfwGetTime() * timeScale;
-			float freq = utl::getValueLerp(frequencyData, numFreqBins, x);
+			float freq = 0.0f;
+			if (hasSpectrum)
+				freq = bandEnergy ? bandEnergies[i] : utl::getValueLerp(frequencyData, frequencySpectrum->size, x);
 			freqAccumulation += freq;
 
 			glm::mat4 model;
@@ -349,6 +357,7 @@ int sphereParticles()
 	}
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
+	analysisThread.stop();
 	glfwTerminate();
 	return 0;
 }
@@ -4,10 +4,20 @@ out vec4 FragColor;
 in vec2 UV;
 
 uniform sampler1D soundTexture;
-uniform sampler1D frequencyTexture;
+uniform sampler1D frequencyTexture; // red is the top half of the spectrum, green is the bottom half
 uniform sampler1D frequencyColorCurve;
 uniform sampler1D lightColorCurve;
 
+// The same spectrum in a buffer texture, read instead of frequencyTexture when useFrequencyBuffer is set
+uniform samplerBuffer frequencyBuffer;
+uniform bool useFrequencyBuffer;
+
+// The spectrogram is a circular buffer of frequency texture rows. spectrogramHead is the newest row, the row before it is one frame older
+uniform sampler2D spectrogramTexture;
+uniform int spectrogramHead;
+uniform int spectrogramRows;
+uniform float spectrogramOpacity;
+
 uniform float time;
 uniform vec2 texturePixelSize;
 uniform vec2 mousePos;
@@ -321,6 +331,27 @@ vec3 hsv2rgb(vec3 c)
     return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
 }
 
+// Sample the spectrum at x on [0, 1]. Buffer textures have no filtering,
+// so the two nearest texels are fetched and blended the way a linear filter with clamp to edge would
+vec2 sampleFrequency(float x)
+{
+  if (!useFrequencyBuffer)
+    return texture(frequencyTexture, x).rg;
+  int size = textureSize(frequencyBuffer);
+  float texel = x * float(size) - 0.5;
+  int left = clamp(int(floor(texel)), 0, size - 1);
+  int right = clamp(int(floor(texel)) + 1, 0, size - 1);
+  return mix(texelFetch(frequencyBuffer, left).rg, texelFetch(frequencyBuffer, right).rg, fract(texel));
+}
+
+// Sample the spectrogram at a frequency x and an age in frames, where 0 is the newest row.
+// Rows before row 0 wrap around to the end of the texture, which repeats vertically
+vec2 sampleSpectrogram(float x, float age)
+{
+  float row = float(spectrogramHead) - age + 0.5;
+  return texture(spectrogramTexture, vec2(x, row / float(spectrogramRows))).rg;
+}
+
 void main()
 {
   
@@ -349,16 +380,20 @@ void main()
   // where the entire spectrum is rotated around the x axis to form a 3d object
   // the position on the solid, as well as a surface normal vector at the current fragment is needed for lighting effects
   
+  // Fragments above the center line use the red channel of the frequency texture, fragments below it use the green channel.
+  // The two are the same for mono, and the left and right channel in the stereo split view
+  float linePos = 0.333;
+  vec2 channelMask = UV.y >= linePos ? vec2(1.0, 0.0) : vec2(0.0, 1.0);
+
   // Get the frequency magnitudes at the current fragment, as well as the fragments to the left and right.
-  float freqLeft = texture(frequencyTexture, UV.x - texturePixelSize.x).r;
-  float freqMid = texture(frequencyTexture, UV.x).r;
-  float freqRight = texture(frequencyTexture, UV.x + texturePixelSize.x).r;
+  float freqLeft = dot(sampleFrequency(UV.x - texturePixelSize.x), channelMask);
+  float freqMid = dot(sampleFrequency(UV.x), channelMask);
+  float freqRight = dot(sampleFrequency(UV.x + texturePixelSize.x), channelMask);
   
   // Caclulates the freqeuncy map. 
   // freqMap has a value of 1.0 for fragments that are part of the frequency specturm, 
   // and a value of 0.0 for fragments that are not
   // Any fragments that have a y value in the range [freqLower:freqUpper] are set to 1.0
-  float linePos = 0.333;
   float lineWidth = texturePixelSize.y*0.5;
   float freqLower = linePos - lineWidth - freqMid;
   float freqUpper = linePos + lineWidth + freqMid;
@@ -403,6 +438,15 @@ void main()
   vec4 ambientColor = vec4(pow(texture(frequencyColorCurve, freqMid).rgb, vec3(gamma)), 1.0);
   
   vec4 finalColor = (diffuseColor + ambientColor + specular) * freqMap;
+
+  // Fill the rest with the spectrogram. It moves away from the center line, so the whole history fits above and below it
+  if (spectrogramOpacity > 0.0)
+  {
+    float age = UV.y >= linePos ? (UV.y - linePos) / (1.0 - linePos) : (linePos - UV.y) / linePos;
+    float history = dot(sampleSpectrogram(UV.x, age * float(spectrogramRows - 1)), channelMask);
+    vec4 historyColor = vec4(pow(texture(frequencyColorCurve, history).rgb, vec3(gamma)), 1.0) * history * spectrogramOpacity;
+    finalColor = mix(historyColor, finalColor, freqMap);
+  }
   
   finalColor.rgb = rgb2hsv(finalColor.rgb);
   //freqColor.r += UV.x * 5.1;
@@ -13,6 +13,8 @@ in vec2 TexCoords;
 uniform sampler2D fluid;
 uniform sampler2D density;
 uniform sampler1D frequency;
+uniform samplerBuffer frequencyBuffer;
+uniform bool useFrequencyBuffer;
 uniform float timestep;
 uniform float utime;
 uniform vec2 pixelSize;
@@ -30,6 +32,18 @@ vec2 getVelocity(vec4 color) {return color.rg * 2.0 - 1.0;}
 // Multiply by 0.5 and add 0.5 to shift back to color range
 vec2 packVelocity(vec2 vel) {return vel * 0.5 + 0.5;}
 
+// Sample the spectrum from the 1D texture, or blend the two nearest texels of the buffer texture, which has no filtering
+float sampleFrequency(float x)
+{
+  if (!useFrequencyBuffer)
+    return texture(frequency, x).r;
+  int size = textureSize(frequencyBuffer);
+  float texel = x * float(size) - 0.5;
+  int left = clamp(int(floor(texel)), 0, size - 1);
+  int right = clamp(int(floor(texel)) + 1, 0, size - 1);
+  return mix(texelFetch(frequencyBuffer, left).r, texelFetch(frequencyBuffer, right).r, fract(texel));
+}
+
 float gauss(vec2 p, float r)
 {
   return exp(-dot(p, p) / r);
@@ -56,7 +70,7 @@ void main()
   }
 
   float splat = gauss(smallestDeltaPos, splatRadius);
-  float frequencySample = texture(frequency, smallestkPct).r;
+  float frequencySample = sampleFrequency(smallestkPct);
 
   vec2 velocityAdd = velocityDir * splat * frequencySample * velocityAddScalar;
   float densityAdd = splat * frequencySample * densityAddScalar;